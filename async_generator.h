@@ -1,6 +1,9 @@
 #pragma once
 
 #include "coroutine.h"
+#include "coro_queue.h"
+#include <mutex>
+#include <span>
 #include <vector>
 namespace MINICORO_NAMESPACE {
 
@@ -281,6 +284,341 @@ template<typename T, typename Param = void, coro_allocator Alloc = objstdalloc>
 using generator = async_generator<T, Param, Alloc>;
 
 
+///generator adaptor which runs the generator ahead of the consumer
+/**
+ * The adaptor runs the generator in a background coroutine (pump), which stores
+ * yielded values into a ring buffer of up to N items. The consumer retrieves values
+ * from the buffer, so fetching of next values can overlap with processing
+ * of the current value. The generator is suspended when the buffer is full.
+ *
+ * @code
+ * buffered_generator<Page, 2> pages(read_cursor(db));
+ * for (auto p = pages(); co_await p.has_value(); p = pages()) {
+ *      process(p);
+ * }
+ * @endcode
+ *
+ * @tparam T type of value
+ * @tparam N size of the buffer
+ * @tparam Executor optional executor, which has function schedule() returning
+ * an awaiter (for example coro_thread_pool). If specified, the generator is started in the
+ * executor and it is rescheduled to the executor every time when it is resumed after
+ * the buffer was full. Otherwise the generator runs in the thread which resumes it.
+ *
+ * @note the consumer can have only one pending call at time (as async_generator).
+ * The destructor stops the generator and waits until its current step is complete
+ */
+template<typename T, unsigned int N = 4, typename Executor = void>
+class buffered_generator {
+public:
+
+    static_assert(N > 0);
+
+    using value_type = T;
+
+    ///construct the adaptor and start the generator
+    /**
+     * @param gen generator
+     */
+    explicit buffered_generator(async_generator<T> gen) requires(std::is_void_v<Executor>)
+        :_gen(std::move(gen)) {
+        start();
+    }
+
+    ///construct the adaptor and start the generator in the executor
+    /**
+     * @param gen generator
+     * @param executor executor
+     */
+    template<typename E = Executor>
+    requires(!std::is_void_v<E>)
+    buffered_generator(async_generator<T> gen, E &executor)
+        :_gen(std::move(gen)), _executor(&executor) {
+        start();
+    }
+
+    buffered_generator(const buffered_generator &) = delete;
+    buffered_generator &operator=(const buffered_generator &) = delete;
+
+    ///stops generator
+    ~buffered_generator() {
+        prepared_coro resm;
+        lock_guard _(_mx);
+        _stop = true;
+        if (_producer) resm = _producer(false);
+    }
+
+    ///retrieve next value
+    /**
+     * @return awaitable which receives the value. It is resolved with no-value when
+     * the generator is finished
+     */
+    awaitable<T> operator()() {
+        prepared_coro resm;
+        lock_guard _(_mx);
+        if (!_items.is_empty()) {
+            awaitable<T> out = _items.pop();
+            resm = unpark();
+            return out;
+        }
+        if (_done) return nullptr;
+        return [this](typename awaitable<T>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            prepared_coro resm;
+            lock_guard _(me->_mx);
+            //the pump could add an item meanwhile
+            if (!me->_items.is_empty()) {
+                awaitable<T> v = me->_items.pop();
+                resm = me->unpark();
+                return transfer(std::move(r), v);
+            }
+            if (me->_done) return r = std::nullopt;
+            me->_consumer = std::move(r);
+            return {};
+        };
+    }
+
+    ///retrieve count of values ready in the buffer
+    unsigned int ready() const {
+        lock_guard _(_mx);
+        return _items.size();
+    }
+
+protected:
+
+    using executor_ptr = std::conditional_t<std::is_void_v<Executor>, std::nullptr_t, Executor *>;
+
+    async_generator<T> _gen;
+    executor_ptr _executor = {};
+    mutable std::mutex _mx;
+    limited_queue<awaitable<T>, N> _items;
+    //value which doesn't fit to the buffer
+    std::optional<awaitable<T> > _parked;
+    //pending consumer
+    typename awaitable<T>::result _consumer;
+    //parked producer
+    awaitable<bool>::result _producer;
+    bool _stop = false;
+    bool _done = false;
+    awaitable<void> _pump = {nullptr};
+    //joins the pump during destruction (must be last)
+    when_all _join;
+
+    void start() {
+        _pump = pump();
+        _join.add(_pump);
+    }
+
+    awaitable<void> pump() {
+        if constexpr(!std::is_void_v<Executor>) co_await _executor->schedule();
+        while (true) {
+            awaitable<T> v = _gen();
+            bool has_value = co_await v.has_value();
+            if (!has_value) break;
+            auto p = put(std::move(v));
+            bool parked = !p.is_ready();
+            if (!co_await p) co_return;
+            if constexpr(!std::is_void_v<Executor>) {
+                if (parked) co_await _executor->schedule();
+            }
+        }
+        prepared_coro resm;
+        lock_guard _(_mx);
+        _done = true;
+        if (_consumer) resm = (_consumer = std::nullopt);
+    }
+
+    //store value, returns false if the generator must stop
+    awaitable<bool> put(awaitable<T> &&v) {
+        prepared_coro resm;
+        lock_guard _(_mx);
+        if (_stop) return false;
+        if (_consumer) {
+            resm = transfer(std::move(_consumer), v);
+            return true;
+        }
+        if (!_items.is_full()) {
+            _items.push(std::move(v));
+            return true;
+        }
+        _parked.emplace(std::move(v));
+        return [this](awaitable<bool>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            lock_guard _(me->_mx);
+            if (me->_stop) return r(false);
+            //already consumed
+            if (!me->_parked) return r(true);
+            me->_producer = std::move(r);
+            return {};
+        };
+    }
+
+    //move parked value to the buffer, returns producer to resume
+    prepared_coro unpark() {
+        if (!_parked) return {};
+        _items.push(std::move(*_parked));
+        _parked.reset();
+        if (_producer) return _producer(true);
+        return {};
+    }
+
+    //resolve consumer by the stored value
+    static prepared_coro transfer(typename awaitable<T>::result r, awaitable<T> &v) {
+        try {
+            return r(std::move(v.await_resume()));
+        } catch (...) {
+            return r = std::current_exception();
+        }
+    }
+};
+
+///element-wise access to a generator which yields chunks of values
+/**
+ * The generator yields std::span of values, which stays valid until the generator
+ * is resumed. The adaptor returns values one by one, the generator is resumed
+ * only when the current chunk is exhausted. Element-wise loop costs one switch
+ * per chunk.
+ *
+ * @code
+ * async_generator<std::span<const Row> > parse(Input &in) {
+ *      std::vector<Row> rows;
+ *      while (fill_rows(in, rows)) {
+ *          co_yield std::span<const Row>(rows);
+ *      }
+ * }
+ *
+ * for (const Row &r: chunked_generator(parse(in))) {
+ *      //process row
+ * }
+ * @endcode
+ *
+ * @tparam T type of element of the span (can be const)
+ */
+template<typename T>
+class chunked_generator {
+public:
+
+    using value_type = std::remove_cv_t<T>;
+    using chunk_type = std::span<T>;
+
+    ///construct adaptor
+    /**
+     * @param gen generator which yields chunks
+     */
+    chunked_generator(async_generator<chunk_type> gen):_gen(std::move(gen)) {}
+
+    chunked_generator(const chunked_generator &) = delete;
+    chunked_generator &operator=(const chunked_generator &) = delete;
+
+    ///retrieve next element
+    /**
+     * @return awaitable which receives a copy of next element. It is resolved with no-value
+     * at the end of the generator
+     */
+    awaitable<value_type> operator()() {
+        if (_pos < _chunk.size()) return awaitable<value_type>(std::in_place, _chunk[_pos++]);
+        return [this](typename awaitable<value_type>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            me->_r = std::move(r);
+            return me->_cb.await(me->_gen(), me);
+        };
+    }
+
+    ///retrieve rest of current chunk, or next chunk if the current is exhausted
+    /**
+     * @return awaitable with the span. It is resolved with no-value at the end of the generator
+     * @note chunks are returned as they are yielded, so the span can be empty
+     */
+    awaitable<chunk_type> next_chunk() {
+        if (_pos < _chunk.size()) {
+            auto out = _chunk.subspan(_pos);
+            _pos = _chunk.size();
+            return out;
+        }
+        _chunk = {};
+        _pos = 0;
+        return _gen();
+    }
+
+    ///input iterator
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::remove_cv_t<T>;
+        using difference_type = std::ptrdiff_t;
+        using reference = T &;
+        using pointer = T *;
+
+        ///construct end iterator
+        iterator() = default;
+        ///construct iterator and fetch first element
+        iterator(chunked_generator *owner):_owner(owner) {
+            if (_owner->_pos >= _owner->_chunk.size() && !_owner->fetch()) _owner = nullptr;
+        }
+        ///comparison only returns true, if both iterators points to end
+        bool operator==(const iterator &other) const {
+            return _owner == other._owner;
+        }
+        reference operator*() const {
+            return _owner->_chunk[_owner->_pos];
+        }
+        pointer operator->() const {
+            return &_owner->_chunk[_owner->_pos];
+        }
+        iterator &operator++() {
+            if (++_owner->_pos >= _owner->_chunk.size() && !_owner->fetch()) _owner = nullptr;
+            return *this;
+        }
+    protected:
+        chunked_generator *_owner = nullptr;
+    };
+
+    ///start iterating (fetches first chunk synchronously)
+    iterator begin() {return this;}
+    ///end iterator
+    iterator end() {return {};}
+
+protected:
+    async_generator<chunk_type> _gen;
+    chunk_type _chunk = {};
+    std::size_t _pos = 0;
+    typename awaitable<value_type>::result _r;
+
+    //fetch next non-empty chunk synchronously
+    bool fetch() {
+        do {
+            awaitable<chunk_type> c = _gen();
+            bool has_value = c.has_value();
+            if (!has_value) return false;
+            _chunk = c.await_resume();
+            _pos = 0;
+        } while (_chunk.empty());
+        return true;
+    }
+
+    prepared_coro on_chunk(awaitable<chunk_type> &awt) {
+        try {
+            bool has_value = awt.has_value();
+            if (!has_value) return _r = std::nullopt;
+            _chunk = awt.await_resume();
+            _pos = 0;
+        } catch (...) {
+            return _r = std::current_exception();
+        }
+        //skip empty chunks
+        if (_chunk.empty()) return _cb.await_cont(_gen());
+        return _r(_chunk[_pos++]);
+    }
+
+    await_member_callback<chunk_type, chunked_generator *, &chunked_generator::on_chunk> _cb;
+};
+
+template<typename T>
+chunked_generator(async_generator<std::span<T> >) -> chunked_generator<T>;
+
 template<typename T, typename Param, typename Allocator>
 async_generator<T, Param, Allocator> generator_agregator(Allocator &, std::vector<generator<T, Param> > g) {
 /*
@@ -0,0 +1,43 @@
+#include "../coro_barrier.h"
+#include "../coro_distributor.h"
+#include "bench.h"
+
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<void> barrier_worker(coro_barrier<> &b, std::size_t phases) {
+    for (std::size_t i = 0; i < phases; ++i) co_await b.arrive_and_wait();
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+    char name[100];
+
+    //one op is one phase of 8 coroutines
+    bench::run("barrier/phase_8_coroutines", 1000000, [](std::size_t n){
+        coro_barrier<> b(8);
+        std::vector<awaitable<void> > w;
+        for (int i = 0; i < 8; ++i) w.push_back(barrier_worker(b, n));
+        sync_await(when_all(w));
+    });
+    bench::run("event/set_reset_8_waiters", 1000000, [](std::size_t n){
+        coro_event ev;
+        for (std::size_t i = 0; i < n; ++i) {
+            awaitable<void> w[8];
+            for (auto &x: w) x = ev.wait();
+            when_all all(w);
+            ev.set();
+            ev.reset();
+        }
+    });
+    for (auto t: bench::thread_counts()) {
+        if (t < 2) continue;
+        coro_barrier<> b(t);
+        std::snprintf(name, sizeof(name), "barrier/phase_threads_%u", t);
+        bench::run_mt(name, t, 100000, [&](std::size_t n, unsigned int){
+            barrier_worker(b, n).wait();
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+///Minimal benchmark harness
+/**
+ * Each benchmark prints one JSON object per line to stdout
+ *
+ * @code
+ * {"name":"coro/create_resume_destroy","threads":1,"ops":1000000,"ns_per_op":35.1,"ops_per_sec":28490028,"allocs_per_op":1}
+ * @endcode
+ *
+ * A benchmark executable accepts optional filter as the first argument. Only
+ * benchmarks which contain the filter in the name are executed.
+ *
+ * The header replaces global operator new to count allocations, so it must be
+ * included only by one translation unit of the executable
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace bench {
+
+inline std::atomic<std::size_t> alloc_count = {0};
+
+inline std::string_view filter;
+
+///initialize harness from command line
+inline void init(int argc, char **argv) {
+    if (argc > 1) filter = argv[1];
+}
+
+///prevent optimizer to remove the value
+template<typename T>
+inline void do_not_optimize(T &&val) {
+#ifdef _MSC_VER
+    static const void * volatile sink;
+    sink = &val;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "g"(&val) : "memory");
+#endif
+}
+
+inline void report(std::string_view name, unsigned int threads, std::size_t ops,
+                   std::chrono::nanoseconds elapsed, std::size_t allocs) {
+    double ns = static_cast<double>(elapsed.count());
+    double dops = static_cast<double>(ops);
+    std::printf("{\"name\":\"%.*s\",\"threads\":%u,\"ops\":%zu,\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f,\"allocs_per_op\":%.3f}\n",
+            static_cast<int>(name.size()), name.data(), threads, ops,
+            ns / dops, dops * 1e9 / ns, static_cast<double>(allocs) / dops);
+    std::fflush(stdout);
+}
+
+///run benchmark from the current thread
+/**
+ * @param name name of benchmark
+ * @param threads count of threads reported, use when the operations are
+ * distributed to other threads (a thread pool)
+ * @param ops count of operations
+ * @param fn function which receives count of operations and performs them
+ */
+template<typename Fn>
+void run(std::string_view name, unsigned int threads, std::size_t ops, Fn &&fn) {
+    if (name.find(filter) == name.npos) return;
+    auto a = alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    fn(ops);
+    auto stop = std::chrono::steady_clock::now();
+    report(name, threads, ops, stop - start, alloc_count.load() - a);
+}
+
+///run single thread benchmark
+/**
+ * @param name name of benchmark
+ * @param ops count of operations
+ * @param fn function which receives count of operations and performs them
+ */
+template<typename Fn>
+void run(std::string_view name, std::size_t ops, Fn &&fn) {
+    run(name, 1, ops, std::forward<Fn>(fn));
+}
+
+///run benchmark in multiple threads
+/**
+ * @param name name of benchmark
+ * @param threads count of threads
+ * @param ops count of operations per thread
+ * @param fn function which receives count of operations and index of thread
+ *
+ * Reported count of operations is total count of all threads
+ */
+template<typename Fn>
+void run_mt(std::string_view name, unsigned int threads, std::size_t ops, Fn &&fn) {
+    if (name.find(filter) == name.npos) return;
+    std::atomic<unsigned int> ready = {0};
+    std::atomic<bool> go = {false};
+    std::vector<std::thread> thr;
+    for (unsigned int i = 0; i < threads; ++i) {
+        thr.emplace_back([&, i]{
+            ready.fetch_add(1);
+            while (!go.load()) std::this_thread::yield();
+            fn(ops, i);
+        });
+    }
+    while (ready.load() != threads) std::this_thread::yield();
+    auto a = alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto &t: thr) t.join();
+    auto stop = std::chrono::steady_clock::now();
+    report(name, threads, ops * threads, stop - start, alloc_count.load() - a);
+}
+
+///returns list of thread counts to test (1, 2, 4 ... hardware concurrency, at least 4)
+inline std::vector<unsigned int> thread_counts() {
+    std::vector<unsigned int> out;
+    unsigned int hw = std::max(4U, std::thread::hardware_concurrency());
+    for (unsigned int i = 1; i < hw; i *= 2) out.push_back(i);
+    out.push_back(hw);
+    return out;
+}
+
+}
+
+void *operator new(std::size_t sz) {
+    bench::alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(sz ? sz : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t sz) {
+    bench::alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(sz ? sz : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {std::free(p);}
+void operator delete[](void *p) noexcept {std::free(p);}
+void operator delete(void *p, std::size_t) noexcept {std::free(p);}
+void operator delete[](void *p, std::size_t) noexcept {std::free(p);}
@@ -0,0 +1,101 @@
+#include "../coroutine.h"
+#include "bench.h"
+
+using namespace MINICORO_NAMESPACE;
+
+coroutine<int> leaf(int v) {
+    co_return v;
+}
+
+coroutine<int> chain(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) sum += co_await leaf(i);
+    co_return sum;
+}
+
+awaitable<int> leaf_awaitable(int v) {
+    co_return v;
+}
+
+awaitable<int> chain_awaitable(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) sum += co_await leaf_awaitable(i);
+    co_return sum;
+}
+
+//awaitable resolved through callback
+awaitable<int> leaf_callback(int v) {
+    return [v](awaitable<int>::result r) {
+        return r(v);
+    };
+}
+
+awaitable<int> chain_callback(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) sum += co_await leaf_callback(i);
+    co_return sum;
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+
+    bench::run("coro/create_resume_destroy", 1000000, [](std::size_t n){
+        int v = chain(static_cast<int>(n));
+        bench::do_not_optimize(v);
+    });
+    bench::run("awaitable/coroutine", 1000000, [](std::size_t n){
+        int v = chain_awaitable(static_cast<int>(n));
+        bench::do_not_optimize(v);
+    });
+    bench::run("awaitable/callback", 1000000, [](std::size_t n){
+        int v = chain_callback(static_cast<int>(n));
+        bench::do_not_optimize(v);
+    });
+    bench::run("awaitable/value", 10000000, [](std::size_t n){
+        for (std::size_t i = 0; i < n; ++i) {
+            awaitable<int> a(static_cast<int>(i));
+            int v = a;
+            bench::do_not_optimize(v);
+        }
+    });
+    bench::run("awaitable/set_callback", 1000000, [](std::size_t n){
+        awaitable<int>::result r;
+        for (std::size_t i = 0; i < n; ++i) {
+            awaitable<int> a([&](awaitable<int>::result x){r = std::move(x);});
+            int v = 0;
+            a >> [&](awaitable<int> &x){v = x;};
+            r(static_cast<int>(i));
+            bench::do_not_optimize(v);
+        }
+    });
+
+    constexpr std::size_t fan = 100;
+    bench::run("when_all/fan_in_100", 100000 * fan, [](std::size_t n){
+        std::vector<awaitable<int>::result> res(fan);
+        std::vector<awaitable<int> > lst;
+        lst.reserve(fan);
+        for (std::size_t k = 0; k < n / fan; ++k) {
+            lst.clear();
+            for (auto &r: res) lst.push_back([&r](awaitable<int>::result x){r = std::move(x);});
+            when_all all(lst);
+            for (auto &r: res) r(1);
+            all.wait();
+        }
+    });
+    bench::run("when_each/fan_in_100", 100000 * fan, [](std::size_t n){
+        std::vector<awaitable<int>::result> res(fan);
+        std::vector<awaitable<int> > lst;
+        lst.reserve(fan);
+        for (std::size_t k = 0; k < n / fan; ++k) {
+            lst.clear();
+            for (auto &r: res) lst.push_back([&r](awaitable<int>::result x){r = std::move(x);});
+            when_each<fan> each(lst);
+            for (auto &r: res) r(1);
+            while (each) {
+                std::size_t idx = each.wait();
+                bench::do_not_optimize(idx);
+            }
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "../coro_distributor.h"
+#include "bench.h"
+
+#include <array>
+
+using namespace MINICORO_NAMESPACE;
+
+using message = std::array<char, 4096>;
+
+//ops are deliveries of 4KB message to listeners
+template<typename Dist, typename Fn>
+void message_bench(const char *name, Fn &&publish) {
+    constexpr std::size_t listeners = 10000;
+    bench::run(name, 20 * listeners, [&](std::size_t n){
+        Dist dist;
+        std::vector<typename Dist::awaitable> lst(listeners);
+        long sum = 0;
+        message msg = {};
+        for (std::size_t k = 0; k < n / listeners; ++k) {
+            for (auto &a: lst) {
+                a = dist();
+                a >> [&](typename Dist::awaitable &){++sum;};
+            }
+            publish(dist, msg);
+        }
+        bench::do_not_optimize(sum);
+    });
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+
+    constexpr std::size_t listeners = 10000;
+    //ops are deliveries to listeners
+    bench::run("distributor/broadcast_10k", 100 * listeners, [](std::size_t n){
+        distributor<int> dist;
+        std::vector<awaitable<int> > lst(listeners);
+        std::vector<prepared_coro> buffer;
+        long sum = 0;
+        for (std::size_t k = 0; k < n / listeners; ++k) {
+            for (auto &a: lst) {
+                a = dist();
+                a >> [&](awaitable<int> &x){sum += x.await_resume();};
+            }
+            dist.broadcast(buffer, static_cast<int>(k));
+            buffer.clear();
+        }
+        bench::do_not_optimize(sum);
+    });
+    bench::run("sharded_distributor/broadcast_10k", 100 * listeners, [](std::size_t n){
+        sharded_distributor<int> dist;
+        std::vector<awaitable<int> > lst(listeners);
+        long sum = 0;
+        for (std::size_t k = 0; k < n / listeners; ++k) {
+            for (auto &a: lst) {
+                a = dist();
+                a >> [&](awaitable<int> &x){sum += x.await_resume();};
+            }
+            dist.broadcast(static_cast<int>(k));
+        }
+        bench::do_not_optimize(sum);
+    });
+    static char idents[listeners];
+    bench::run("distributor/kick_out_10k", listeners, [](std::size_t n){
+        distributor<int> dist;
+        std::vector<awaitable<int> > lst(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            lst[i] = dist(idents + i);
+            lst[i] >> [](awaitable<int> &){};
+        }
+        for (std::size_t i = 0; i < n; ++i) dist.kick_out(idents + i);
+    });
+    bench::run("sharded_distributor/kick_out_10k", listeners, [](std::size_t n){
+        sharded_distributor<int> dist;
+        std::vector<awaitable<int> > lst(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            lst[i] = dist(idents + i);
+            lst[i] >> [](awaitable<int> &){};
+        }
+        for (std::size_t i = 0; i < n; ++i) dist.kick_out(idents + i);
+    });
+    message_bench<distributor<message> >("distributor/message_4k_copy", [](auto &dist, const message &msg){
+        dist.broadcast(msg);
+    });
+    message_bench<distributor<const message &> >("distributor/message_4k_ref", [](auto &dist, const message &msg){
+        dist.broadcast(msg);
+    });
+    message_bench<shared_distributor<message> >("distributor/message_4k_shared", [](auto &dist, const message &msg){
+        dist.publish(msg);
+    });
+    return 0;
+}
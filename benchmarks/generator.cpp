@@ -0,0 +1,39 @@
+#include "../async_generator.h"
+#include "bench.h"
+
+using namespace MINICORO_NAMESPACE;
+
+generator<int> items(std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) co_yield static_cast<int>(i);
+}
+
+generator<std::span<const int> > chunks(std::size_t n, std::size_t chunk) {
+    std::vector<int> buff(chunk);
+    for (std::size_t i = 0; i < n; i += chunk) {
+        std::size_t cnt = std::min(chunk, n - i);
+        for (std::size_t j = 0; j < cnt; ++j) buff[j] = static_cast<int>(i + j);
+        co_yield std::span<const int>(buff.data(), cnt);
+    }
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+
+    bench::run("generator/per_item", 1000000, [](std::size_t n){
+        long sum = 0;
+        for (int v: items(n)) sum += v;
+        bench::do_not_optimize(sum);
+    });
+    bench::run("generator/chunked_64", 10000000, [](std::size_t n){
+        long sum = 0;
+        for (int v: chunked_generator(chunks(n, 64))) sum += v;
+        bench::do_not_optimize(sum);
+    });
+    bench::run("generator/buffered_4", 1000000, [](std::size_t n){
+        long sum = 0;
+        buffered_generator<int, 4> gen(items(n));
+        for (auto v = gen(); v.has_value(); v = gen()) sum += v;
+        bench::do_not_optimize(sum);
+    });
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "../coro_mutex.h"
+#include "bench.h"
+
+using namespace MINICORO_NAMESPACE;
+
+template<typename Mutex>
+awaitable<void> locker(Mutex &mx, std::size_t n, long &counter) {
+    for (std::size_t i = 0; i < n; ++i) {
+        auto own = co_await mx.lock();
+        ++counter;
+    }
+}
+
+awaitable<void> shared_locker(coro_shared_mutex &mx, std::size_t n, unsigned int idx, long &counter) {
+    for (std::size_t i = 0; i < n; ++i) {
+        if ((i + idx) % 16 == 0) {
+            auto own = co_await mx.lock();
+            ++counter;
+        } else {
+            auto own = co_await mx.lock_shared();
+            bench::do_not_optimize(counter);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+    char name[100];
+
+    bench::run("mutex/uncontended", 10000000, [](std::size_t n){
+        coro_mutex mx;
+        for (std::size_t i = 0; i < n; ++i) {
+            auto own = mx.try_lock();
+            bench::do_not_optimize(own);
+        }
+    });
+
+    for (auto t: bench::thread_counts()) {
+        coro_mutex mx;
+        long counter = 0;
+        std::snprintf(name, sizeof(name), "mutex/contended_%u", t);
+        bench::run_mt(name, t, 200000, [&](std::size_t n, unsigned int){
+            locker(mx, n, counter).wait();
+        });
+    }
+    for (auto t: bench::thread_counts()) {
+        coro_barging_mutex mx;
+        long counter = 0;
+        std::snprintf(name, sizeof(name), "mutex/barging_contended_%u", t);
+        bench::run_mt(name, t, 200000, [&](std::size_t n, unsigned int){
+            locker(mx, n, counter).wait();
+        });
+    }
+    for (auto t: bench::thread_counts()) {
+        coro_shared_mutex mx;
+        long counter = 0;
+        std::snprintf(name, sizeof(name), "shared_mutex/read_mostly_%u", t);
+        bench::run_mt(name, t, 200000, [&](std::size_t n, unsigned int idx){
+            shared_locker(mx, n, idx, counter).wait();
+        });
+    }
+    return 0;
+}
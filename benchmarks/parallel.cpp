@@ -0,0 +1,30 @@
+#include "../coro_parallel.h"
+#include "../coro_thread_pool.h"
+#include "bench.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+    constexpr std::size_t count = 10000000;
+    std::vector<float> data(count);
+    for (std::size_t i = 0; i < count; ++i) data[i] = static_cast<float>(i % 1000) * 0.001f;
+    char name[100];
+    for (auto t: bench::thread_counts()) {
+        coro_thread_pool pool(t);
+        std::snprintf(name, sizeof(name), "parallel/for_10M_%u", t);
+        bench::run(name, t, count, [&](std::size_t){
+            parallel_for(pool, data, 4096, [](float &x){x = std::sqrt(x);}).await();
+        });
+        std::snprintf(name, sizeof(name), "parallel/transform_reduce_10M_%u", t);
+        bench::run(name, t, count, [&](std::size_t){
+            double s = parallel_transform_reduce(pool, data, 4096, 0.0, std::plus<>(),
+                    [](float x){return static_cast<double>(x) * x;});
+            bench::do_not_optimize(s);
+        });
+    }
+    return 0;
+}
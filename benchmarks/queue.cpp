@@ -0,0 +1,74 @@
+#include "../coro_queue.h"
+#include "bench.h"
+
+using namespace MINICORO_NAMESPACE;
+
+template<typename Queue>
+awaitable<void> producer(Queue &q, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) co_await q.push(static_cast<int>(i));
+}
+
+template<typename Queue>
+awaitable<long> consumer(Queue &q, std::size_t n) {
+    long sum = 0;
+    for (std::size_t i = 0; i < n; ++i) sum += co_await q.pop();
+    co_return sum;
+}
+
+//half of threads produce, other half consume
+template<typename Queue>
+void pair_bench(const char *name, unsigned int threads, std::size_t ops) {
+    Queue q;
+    bench::run_mt(name, threads, ops, [&](std::size_t n, unsigned int idx){
+        if (idx & 1) {
+            long s = consumer(q, n);
+            bench::do_not_optimize(s);
+        } else {
+            producer(q, n).wait();
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+    char name[100];
+
+    bench::run("queue/push_pop_single_thread", 10000000, [](std::size_t n){
+        coro_queue<int, 16> q;
+        for (std::size_t i = 0; i < n; ++i) {
+            q.push(static_cast<int>(i));
+            int v = q.pop();
+            bench::do_not_optimize(v);
+        }
+    });
+    bench::run("queue/batch_32", 10000000, [](std::size_t n){
+        coro_queue<int, 32> q;
+        int buff[32];
+        for (std::size_t i = 0; i < n; i += 32) {
+            q.push_range(std::begin(buff), std::end(buff));
+            auto cnt = q.pop_many(buff);
+            bench::do_not_optimize(cnt);
+        }
+    });
+    bench::run("queue/segmented_fill_drain_4096", 10000000, [](std::size_t n){
+        coro_segmented_queue<int> q;
+        for (std::size_t i = 0; i < n; i += 4096) {
+            for (int j = 0; j < 4096; ++j) q.push(j);
+            for (int j = 0; j < 4096; ++j) {
+                int v = q.pop();
+                bench::do_not_optimize(v);
+            }
+        }
+    });
+
+    pair_bench<coro_queue<int, 64> >("queue/spsc_mutex", 2, 1000000);
+    pair_bench<coro_mpmc_queue<int, 64> >("queue/spsc_mpmc", 2, 1000000);
+    for (auto t: bench::thread_counts()) {
+        if (t < 4) continue;
+        std::snprintf(name, sizeof(name), "queue/mpmc_mutex_%u", t);
+        pair_bench<coro_queue<int, 64> >(name, t, 200000);
+        std::snprintf(name, sizeof(name), "queue/mpmc_lockfree_%u", t);
+        pair_bench<coro_mpmc_queue<int, 64> >(name, t, 200000);
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "../coro_scheduler.h"
+#include "../coro_mt_scheduler.h"
+#include "bench.h"
+
+#include <random>
+
+using namespace MINICORO_NAMESPACE;
+
+using tp = std::chrono::system_clock::time_point;
+
+template<typename Impl>
+void timers_bench(const char *prefix, Impl &impl) {
+    constexpr std::size_t count = 1000000;
+    static char idents[count];
+    std::vector<tp> times(count);
+    std::mt19937 rnd(42);
+    tp base = std::chrono::system_clock::now();
+    for (auto &t: times) t = base + std::chrono::milliseconds(rnd() % 60000);
+    std::string name(prefix);
+
+    bench::run(name + "/insert_1M", count, [&](std::size_t n){
+        for (std::size_t i = 0; i < n; ++i) impl.schedule_at(static_cast<int>(i), times[i], idents + i);
+    });
+    bench::run(name + "/cancel_1M", count, [&](std::size_t n){
+        for (std::size_t i = 0; i < n; ++i) {
+            auto v = impl.remove_by_ident(idents + (i * 7919) % count);
+            bench::do_not_optimize(v);
+        }
+    });
+    for (std::size_t i = 0; i < count; ++i) impl.schedule_at(static_cast<int>(i), times[i], idents + i);
+    bench::run(name + "/remove_first_1M", count, [&](std::size_t n){
+        for (std::size_t i = 0; i < n; ++i) {
+            auto v = impl.remove_first();
+            bench::do_not_optimize(v);
+        }
+    });
+}
+
+//arm a timeout and cancel it, as a request with a deadline does
+template<typename Sch>
+void arm_cancel(Sch &sch, std::size_t n) {
+    char ident[1];
+    for (std::size_t i = 0; i < n; ++i) {
+        auto awt = sch.sleep_for(std::chrono::seconds(30), ident);
+        awt >> [](awaitable<void> &){};
+        sch.cancel(ident);
+    }
+}
+
+int main(int argc, char **argv) {
+    bench::init(argc, argv);
+    {
+        generic_scheduler<int, tp, const void *> heap;
+        timers_bench("scheduler/heap", heap);
+    }
+    {
+        timer_wheel<int, tp, const void *> wheel;
+        timers_bench("scheduler/timer_wheel", wheel);
+    }
+    char name[64];
+    for (auto t: bench::thread_counts()) {
+        scheduler sch;
+        auto thr = sch.create_thread();
+        std::snprintf(name, sizeof(name), "scheduler/arm_cancel_%u", t);
+        bench::run_mt(name, t, 200000, [&](std::size_t n, unsigned int){
+            arm_cancel(sch, n);
+        });
+    }
+    for (auto t: bench::thread_counts()) {
+        mt_scheduler sch(t);
+        std::snprintf(name, sizeof(name), "mt_scheduler/arm_cancel_%u", t);
+        bench::run_mt(name, t, 200000, [&](std::size_t n, unsigned int){
+            arm_cancel(sch, n);
+        });
+    }
+    return 0;
+}
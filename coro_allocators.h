@@ -0,0 +1,350 @@
+#pragma once
+
+#include "coroutine.h"
+
+#include <bit>
+#include <cstdint>
+#include <mutex>
+
+namespace MINICORO_NAMESPACE {
+
+///thread safe pool allocator for coroutine frames and callbacks
+/**
+ * Memory is divided into size classes (64, 128, 256 ... 8192 bytes). Each
+ * thread has own cache of free blocks for each class, so most of allocations
+ * don't need any lock. When the cache is empty, it is refilled by a batch
+ * of blocks from the global pool. When the cache holds too many blocks, a batch
+ * is returned to the global pool. Blocks can be released by any thread.
+ *
+ * Larger blocks are allocated by standard operator new
+ *
+ * The allocator is stateless, no instance is needed in argument list
+ *
+ * @code
+ * coroutine<T, pool_allocator> my_coro(args...)
+ * @endcode
+ *
+ * @note memory of the pool is never returned to the system. This is
+ * intentional as the frames can be released during destruction of static objects
+ */
+class pool_allocator {
+public:
+
+    ///size of smallest block
+    static constexpr std::size_t min_block_size = 64;
+    ///count of size classes
+    static constexpr unsigned int class_count = 8;
+    ///size of largest block which is allocated from the pool
+    static constexpr std::size_t max_block_size = min_block_size << (class_count - 1);
+    ///count of blocks moved between thread cache and global pool at once
+    static constexpr unsigned int batch_size = 32;
+
+    struct overrides {
+        template<typename ... Args>
+        void *operator new(std::size_t sz, Args && ...) {
+            return pool_allocator::alloc(sz);
+        }
+        void operator delete(void *ptr, std::size_t sz) {
+            pool_allocator::dealloc(ptr, sz);
+        }
+    };
+
+    ///allocate block
+    /**
+     * @param sz requested size
+     * @return pointer to allocated block
+     */
+    static void *alloc(std::size_t sz) {
+        if (sz > max_block_size) return ::operator new(sz);
+        auto cls = size_class(sz);
+        thread_cache *c = cache();
+        if (!c) return take_one(cls);
+        block *b = c->_free[cls];
+        if (!b) {
+            b = global().take(cls);
+            c->_count[cls] = b->count;
+        }
+        c->_free[cls] = b->next;
+        --c->_count[cls];
+        return b;
+    }
+
+    ///release block
+    /**
+     * @param ptr pointer to block
+     * @param sz size of the block, must be same as was requested
+     */
+    static void dealloc(void *ptr, std::size_t sz) {
+        if (sz > max_block_size) {
+            ::operator delete(ptr);
+            return;
+        }
+        auto cls = size_class(sz);
+        thread_cache *c = cache();
+        block *b = reinterpret_cast<block *>(ptr);
+        if (!c) {
+            //cache is already destroyed, return the block directly
+            b->next = nullptr;
+            b->count = 1;
+            global().put(cls, b);
+            return;
+        }
+        b->next = c->_free[cls];
+        c->_free[cls] = b;
+        if (++c->_count[cls] >= 2 * batch_size) {
+            c->give_back(cls, batch_size);
+        }
+    }
+
+protected:
+
+    //free block, the first block of a chain carries count of blocks in chain
+    struct block {
+        block *next;
+        block *next_chain;
+        unsigned int count;
+    };
+
+    static_assert(sizeof(block) <= min_block_size);
+
+    static constexpr unsigned int size_class(std::size_t sz) {
+        return static_cast<unsigned int>(std::bit_width((std::max(sz, min_block_size) - 1) / min_block_size));
+    }
+
+    class global_pool {
+    public:
+        //retrieve chain of free blocks
+        block *take(unsigned int cls) {
+            {
+                std::lock_guard _(_mx[cls]);
+                block *b = _chains[cls];
+                if (b) {
+                    _chains[cls] = b->next_chain;
+                    return b;
+                }
+            }
+            return carve(cls);
+        }
+        //return chain of free blocks
+        void put(unsigned int cls, block *chain) {
+            std::lock_guard _(_mx[cls]);
+            chain->next_chain = _chains[cls];
+            _chains[cls] = chain;
+        }
+    protected:
+        std::mutex _mx[class_count];
+        block *_chains[class_count] = {};
+
+        static block *carve(unsigned int cls) {
+            std::size_t sz = min_block_size << cls;
+            char *mem = reinterpret_cast<char *>(::operator new(sz * batch_size));
+            block *first = nullptr;
+            for (unsigned int i = batch_size; i > 0; --i) {
+                block *b = reinterpret_cast<block *>(mem + (i - 1) * sz);
+                b->next = first;
+                first = b;
+            }
+            first->count = batch_size;
+            return first;
+        }
+    };
+
+    struct thread_cache {
+        block *_free[class_count] = {};
+        unsigned int _count[class_count] = {};
+
+        //move count blocks to global pool
+        void give_back(unsigned int cls, unsigned int count) {
+            block *chain = _free[cls];
+            block *last = chain;
+            for (unsigned int i = 1; i < count; ++i) last = last->next;
+            _free[cls] = last->next;
+            last->next = nullptr;
+            chain->count = count;
+            _count[cls] -= count;
+            global().put(cls, chain);
+        }
+
+        thread_cache() {cache_alive() = true;}
+        ~thread_cache() {
+            cache_alive() = false;
+            for (unsigned int cls = 0; cls < class_count; ++cls) {
+                while (_count[cls]) give_back(cls, std::min(_count[cls], batch_size));
+            }
+        }
+    };
+
+    static global_pool &global() {
+        //never destroyed, blocks can be released during destruction of statics,
+        //then they are returned here directly (see cache())
+        static global_pool *pool = new global_pool;
+        return *pool;
+    }
+
+    //set while the cache of current thread exists. Trivial thread_local is never
+    //destroyed, so it can be tested after the cache is gone
+    static bool &cache_alive() {
+        static thread_local bool alive = false;
+        return alive;
+    }
+
+    //thread_local objects of the main thread are destroyed before static objects, so
+    //a block can be released after the cache is gone. Returns nullptr in this case
+    static thread_cache *cache() {
+        static thread_local bool created = false;
+        if (created && !cache_alive()) return nullptr;
+        created = true;
+        static thread_local thread_cache c;
+        return &c;
+    }
+
+    //allocate without the cache
+    static block *take_one(unsigned int cls) {
+        block *b = global().take(cls);
+        if (b->next) {
+            b->next->count = b->count - 1;
+            global().put(cls, b->next);
+        }
+        return b;
+    }
+
+};
+
+///monotonic allocator for a group of coroutines which are destroyed together
+/**
+ * Frames and callbacks are allocated from chunks of memory by moving a pointer.
+ * Releasing of a frame does nothing, all memory is released at once when the
+ * arena is destroyed or reset.
+ *
+ * To use this allocator, coroutine must be declared with this allocator and
+ * reference to the arena must be in argument list (similar to reusable_allocator)
+ *
+ * @code
+ * coroutine<T, coro_arena> my_coro(coro_arena &, addition_args...)
+ * @endcode
+ *
+ * The arena can also allocate callbacks
+ *
+ * @code
+ * awt.set_callback(cb, arena);
+ * @endcode
+ *
+ * @tparam Lock lock used to protect the arena if the allocations can happen
+ * in multiple threads. Default is no lock
+ *
+ * @note all coroutines and callbacks must be finished before the arena is destroyed
+ */
+template<basic_lockable Lock = empty_lockable>
+class basic_coro_arena {
+public:
+
+    ///create arena
+    /**
+     * @param chunk_size size of chunk. Larger allocations get own chunk
+     */
+    explicit basic_coro_arena(std::size_t chunk_size = 4096):_chunk_size(chunk_size) {}
+    basic_coro_arena(const basic_coro_arena &) = delete;
+    basic_coro_arena &operator=(const basic_coro_arena &) = delete;
+    ~basic_coro_arena() {
+        release(nullptr);
+    }
+
+    struct overrides {
+
+        template<typename ... Args>
+        requires((std::is_same_v<basic_coro_arena &, Args> ||...))
+        void *operator new(std::size_t sz, Args && ... args) {
+            basic_coro_arena *me = nullptr;
+            auto finder = [&](auto &&k) {
+                if constexpr(std::is_same_v<decltype(k),basic_coro_arena &>) me = &k;
+            };
+            (finder(args),...);
+            return me->alloc(sz);
+        }
+
+        void operator delete(void *, std::size_t) {}
+    };
+
+    ///allocate memory
+    /**
+     * @param sz size of block
+     * @return pointer to block aligned to default alignment
+     */
+    void *alloc(std::size_t sz) {
+        sz = (sz + alignment - 1) & ~(alignment - 1);
+        lock_guard _(_mx);
+        if (!_chunks || _chunks->size - _used < sz) {
+            std::size_t chunk_size = std::max(sz, _chunk_size);
+            chunk *c;
+            if (_spare && _spare->size >= chunk_size) {
+                //reuse chunk kept by reset()
+                c = std::exchange(_spare, nullptr);
+            } else {
+                c = reinterpret_cast<chunk *>(::operator new(header_size + chunk_size));
+                c->size = chunk_size;
+            }
+            c->next = _chunks;
+            _chunks = c;
+            _used = 0;
+        }
+        void *out = reinterpret_cast<char *>(_chunks) + header_size + _used;
+        _used += sz;
+        _total += sz;
+        return out;
+    }
+
+    ///release all memory except the first chunk, which is kept for reuse
+    /**
+     * @note all coroutines and callbacks allocated in the arena must be finished
+     */
+    void reset() {
+        lock_guard _(_mx);
+        chunk *c = _chunks;
+        if (!c) return;
+        while (c->next) c = c->next;
+        release(c);
+        _spare = c;
+        _chunks = nullptr;
+        _used = 0;
+        _total = 0;
+    }
+
+    ///retrieve count of bytes allocated since construction or last reset
+    std::size_t used() const {
+        return _total;
+    }
+
+protected:
+
+    struct chunk {
+        chunk *next;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    static constexpr std::size_t header_size = (sizeof(chunk) + alignment - 1) & ~(alignment - 1);
+
+    Lock _mx;
+    std::size_t _chunk_size;
+    chunk *_chunks = nullptr;
+    chunk *_spare = nullptr;
+    std::size_t _used = 0;
+    std::size_t _total = 0;
+
+    //release all chunks except keep
+    void release(chunk *keep) {
+        chunk *c = _chunks;
+        while (c) {
+            chunk *n = c->next;
+            if (c != keep) ::operator delete(c);
+            c = n;
+        }
+        if (_spare && _spare != keep) ::operator delete(_spare);
+        _spare = nullptr;
+    }
+};
+
+///monotonic allocator for single thread (see basic_coro_arena)
+using coro_arena = basic_coro_arena<>;
+
+}
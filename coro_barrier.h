@@ -0,0 +1,439 @@
+#pragma once
+
+#include "coroutine.h"
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+
+namespace MINICORO_NAMESPACE {
+
+namespace _details {
+
+//waiting coroutine, stored in the temporary state of awaitable<void>
+struct sync_slot {
+    //next item in linked list
+    sync_slot *_next;
+    //pointer to awaitable to be resolved
+    awaitable<void> *_resume;
+};
+
+//resumes lists of waiting coroutines as one prepared_coro
+/*
+ * The chain doesn't touch itself once the list is detached, so a resumed
+ * coroutine can destroy the primitive which owns the chain. Lists added
+ * by resumed coroutines (for example next phase of a barrier) are appended to the
+ * queue of the thread which already drains a list, so coroutines are
+ * resumed iteratively, without recursion
+ */
+class wake_chain: public coro_frame<wake_chain> {
+public:
+
+    wake_chain() = default;
+    wake_chain(const wake_chain &) = delete;
+    wake_chain &operator=(const wake_chain &) = delete;
+
+    //add list of slots (newest first, terminated by nullptr)
+    //returns prepared coroutine, which resumes the slots, or nothing if the chain
+    //is already scheduled
+    prepared_coro add(sync_slot *lst) {
+        if (!lst) return {};
+        auto last = lst;
+        while (last->_next) last = last->_next;
+        auto h = _pending.load(std::memory_order_relaxed);
+        do {
+            last->_next = h;
+        } while (!_pending.compare_exchange_weak(h, lst, std::memory_order_release, std::memory_order_relaxed));
+        if (h == nullptr) return get_handle();
+        return {};
+    }
+
+protected:
+
+    friend class coro_frame<wake_chain>;
+
+    //queue of slots drained by current thread
+    struct drain_queue {
+        sync_slot *_first = nullptr;
+        sync_slot *_last = nullptr;
+    };
+
+    //stack of slots to resume, nullptr - not scheduled
+    std::atomic<sync_slot *> _pending = {nullptr};
+
+    static drain_queue *&current_drain() {
+        static thread_local drain_queue *cur = nullptr;
+        return cur;
+    }
+
+    void do_resume() {
+        //after this line, the object can be destroyed
+        drain(_pending.exchange(nullptr, std::memory_order_acquire));
+    }
+
+    static void drain(sync_slot *lst) {
+        //reverse to resume in order of arrival
+        drain_queue add;
+        add._last = lst;
+        while (lst) {
+            auto n = lst->_next;
+            lst->_next = add._first;
+            add._first = lst;
+            lst = n;
+        }
+        auto &cur = current_drain();
+        if (cur) {
+            //this thread is already resuming, just append
+            if (add._first) {
+                if (cur->_first) cur->_last->_next = add._first; else cur->_first = add._first;
+                cur->_last = add._last;
+            }
+            return;
+        }
+        cur = &add;
+        while (add._first) {
+            //slot is destroyed by resumption, read next first
+            auto s = add._first;
+            add._first = s->_next;
+            awaitable<void>::result r(s->_resume);
+            r().resume();
+        }
+        cur = nullptr;
+    }
+};
+
+//completion function which does nothing
+struct empty_completion {
+    void operator()() const noexcept {}
+};
+
+}
+
+///single use countdown latch
+/**
+ * Coroutines wait until the counter reaches zero. Then all waiting coroutines are
+ * resumed and the latch stays open.
+ *
+ * Waiting doesn't allocate memory, the request is stored in the temporary
+ * state of the awaitable (similar to coro_mutex)
+ *
+ * @code
+ * coro_latch done(workers);
+ * //each worker
+ * done.count_down();
+ * //coordinator
+ * co_await done.wait();
+ * @endcode
+ */
+class coro_latch {
+public:
+
+    ///construct latch
+    /**
+     * @param count initial value of the counter
+     */
+    explicit coro_latch(std::ptrdiff_t count):_count(count) {
+        if (count <= 0) _waiters.store(get_open(), std::memory_order_relaxed);
+    }
+    coro_latch(const coro_latch &) = delete;
+    coro_latch &operator=(const coro_latch &) = delete;
+
+    ///decrease the counter
+    /**
+     * @param n value to subtract
+     * @return prepared coroutine which resumes all waiting coroutines, when the
+     * counter reached zero. You can schedule its resumption
+     */
+    prepared_coro count_down(std::ptrdiff_t n = 1) {
+        if (_count.fetch_sub(n, std::memory_order_acq_rel) != n) return {};
+        return _chain.add(_waiters.exchange(get_open(), std::memory_order_acq_rel));
+    }
+
+    ///test whether counter reached zero
+    bool try_wait() const {
+        return _waiters.load(std::memory_order_acquire) == get_open();
+    }
+
+    ///wait until the counter reaches zero
+    /**
+     * @return awaitable
+     */
+    awaitable<void> wait() {
+        if (try_wait()) return {};
+        return [this](awaitable<void>::result r) mutable -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            auto s = awaitable<void>::get_temp_state<slot>(r);
+            if (!s) return {};
+            s->_resume = r.release();
+            s->_next = me->_waiters.load(std::memory_order_relaxed);
+            do {
+                //latch opened meanwhile
+                if (s->_next == get_open()) {
+                    awaitable<void>::result res(s->_resume);
+                    return res();
+                }
+            } while (!me->_waiters.compare_exchange_weak(s->_next, s, std::memory_order_release, std::memory_order_relaxed));
+            return {};
+        };
+    }
+
+    ///decrease the counter and wait
+    /**
+     * @param n value to subtract
+     * @return awaitable
+     */
+    awaitable<void> arrive_and_wait(std::ptrdiff_t n = 1) {
+        count_down(n);
+        return wait();
+    }
+
+protected:
+
+    using slot = _details::sync_slot;
+
+    constexpr static slot open_mark = {};
+
+    std::atomic<std::ptrdiff_t> _count;
+    //stack of waiting coroutines, open_mark when open
+    std::atomic<slot *> _waiters = {nullptr};
+    _details::wake_chain _chain;
+
+    static slot *get_open() {return const_cast<slot *>(&open_mark);}
+};
+
+///reusable barrier for phased work
+/**
+ * Each phase is complete when expected count of participants arrive. The last
+ * participant calls the completion function, then all waiting participants are
+ * resumed and the next phase starts.
+ *
+ * Waiting doesn't allocate memory. Participants are resumed by the last participant
+ * of the phase, one by one.
+ *
+ * @code
+ * coro_barrier sync(workers, [&]{++step;});
+ * for (...) {
+ *      do_step(k);
+ *      co_await sync.arrive_and_wait();
+ * }
+ * @endcode
+ *
+ * @tparam Completion function called when the phase is complete (before
+ * participants are resumed)
+ */
+template<std::invocable<> Completion = _details::empty_completion>
+class coro_barrier {
+public:
+
+    ///construct barrier
+    /**
+     * @param expected count of participants
+     * @param fn completion function
+     */
+    explicit coro_barrier(std::ptrdiff_t expected, Completion fn = {})
+        :_expected(expected), _count(expected), _fn(std::move(fn)) {}
+    coro_barrier(const coro_barrier &) = delete;
+    coro_barrier &operator=(const coro_barrier &) = delete;
+
+    ///arrive and wait for completion of the phase
+    /**
+     * @return awaitable. The participant arrives when co_await is initiated
+     */
+    awaitable<void> arrive_and_wait() {
+        return [this](awaitable<void>::result r) mutable -> prepared_coro {
+            auto me = this;
+            if (!r) return me->arrive();
+            auto s = awaitable<void>::get_temp_state<slot>(r);
+            if (!s) return me->arrive();
+            s->_resume = r.release();
+            s->_next = me->_waiters.load(std::memory_order_relaxed);
+            while (!me->_waiters.compare_exchange_weak(s->_next, s, std::memory_order_release, std::memory_order_relaxed));
+            return me->arrive();
+        };
+    }
+
+    ///arrive without waiting
+    /**
+     * @return prepared coroutine which resumes waiting participants when
+     * the phase is complete. You can schedule its resumption
+     */
+    prepared_coro arrive() {
+        if (_count.fetch_sub(1, std::memory_order_acq_rel) != 1) return {};
+        return complete_phase();
+    }
+
+    ///arrive and decrease count of participants for next phases
+    /**
+     * @return prepared coroutine which resumes waiting participants when
+     * the phase is complete.
+     */
+    prepared_coro arrive_and_drop() {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return arrive();
+    }
+
+    ///retrieve count of completed phases
+    std::size_t phase() const {
+        return _phase.load(std::memory_order_acquire);
+    }
+
+protected:
+
+    using slot = _details::sync_slot;
+
+    std::ptrdiff_t _expected;
+    std::atomic<std::ptrdiff_t> _count;
+    std::atomic<std::ptrdiff_t> _dropped = {0};
+    std::atomic<std::size_t> _phase = {0};
+    //stack of waiting participants of current phase
+    std::atomic<slot *> _waiters = {nullptr};
+    Completion _fn;
+    _details::wake_chain _chain;
+
+    prepared_coro complete_phase() {
+        //all participants arrived, nobody can join this phase
+        slot *lst = _waiters.exchange(nullptr, std::memory_order_acq_rel);
+        _fn();
+        _expected -= _dropped.exchange(0, std::memory_order_relaxed);
+        _phase.fetch_add(1, std::memory_order_release);
+        //open the next phase
+        _count.store(_expected, std::memory_order_release);
+        return _chain.add(lst);
+    }
+};
+
+///event for coroutines
+/**
+ * In manual reset mode, the event stays signaled until reset() is called and
+ * all waiting coroutines are resumed. In auto reset mode, set() resumes one
+ * waiting coroutine, or the event stays signaled until a coroutine starts to wait.
+ *
+ * Requests are registered in a lock-free stack and distributed by one thread at
+ * time (similar to coro_semaphore). Waiting doesn't allocate memory.
+ *
+ * @code
+ * coro_event ready;
+ * //consumers
+ * co_await ready.wait();
+ * //producer
+ * ready.set();
+ * @endcode
+ */
+class coro_event {
+public:
+
+    ///construct event
+    /**
+     * @param auto_reset true for auto reset mode, false for manual reset mode
+     * @param signaled initial state
+     */
+    explicit coro_event(bool auto_reset = false, bool signaled = false)
+        :_auto_reset(auto_reset), _signaled(signaled) {}
+    coro_event(const coro_event &) = delete;
+    coro_event &operator=(const coro_event &) = delete;
+
+    ///signal the event
+    /**
+     * @return prepared coroutine which resumes released coroutines. You can
+     * schedule its resumption
+     */
+    prepared_coro set() {
+        _signaled.store(true);
+        return _chain.add(process());
+    }
+
+    ///reset the event (manual reset mode)
+    /**
+     * @note coroutines are released by set() when the event is not busy. Otherwise
+     * the release can happen later, and coroutines can miss the signal when
+     * the event is reset immediately after set()
+     */
+    void reset() {
+        _signaled.store(false);
+    }
+
+    ///determine whether event is signaled
+    bool is_set() const {
+        return _signaled.load(std::memory_order_acquire);
+    }
+
+    ///try to pass the event without waiting
+    /**
+     * @retval true event is signaled (in auto reset mode, it is reset)
+     * @retval false not signaled
+     */
+    bool try_wait() {
+        if (_auto_reset) return _signaled.exchange(false, std::memory_order_acquire);
+        return is_set();
+    }
+
+    ///wait for the event
+    /**
+     * @return awaitable
+     */
+    awaitable<void> wait() {
+        if (try_wait()) return {};
+        return [this](awaitable<void>::result r) mutable -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            auto s = awaitable<void>::get_temp_state<slot>(r);
+            if (!s) return {};
+            s->_resume = r.release();
+            s->_next = me->_requests.load(std::memory_order_relaxed);
+            while (!me->_requests.compare_exchange_weak(s->_next, s));
+            return me->_chain.add(me->process());
+        };
+    }
+
+protected:
+
+    using slot = _details::sync_slot;
+
+    bool _auto_reset;
+    std::atomic<bool> _signaled;
+    //stack of requests - added between processing
+    std::atomic<slot *> _requests = {nullptr};
+    //true while a thread processes the queue
+    std::atomic<bool> _busy = {false};
+    //true if the queue is not empty
+    std::atomic<bool> _has_queue = {false};
+    //queue of requests - accessed only with _busy
+    slot *_queue = nullptr;
+    slot *_queue_last = nullptr;
+    _details::wake_chain _chain;
+
+    //move requests to the queue and release them if the event is signaled
+    //returns list of released requests (newest first)
+    slot *process() {
+        slot *ready = nullptr;
+        do {
+            if (_busy.exchange(true)) break;
+            slot *s = _requests.exchange(nullptr);
+            slot *chunk = nullptr;
+            slot *chunk_last = s;
+            while (s) {
+                auto n = s->_next;
+                s->_next = chunk;
+                chunk = s;
+                s = n;
+            }
+            if (chunk) {
+                if (_queue) _queue_last->_next = chunk; else _queue = chunk;
+                _queue_last = chunk_last;
+            }
+            while (_queue && (_auto_reset ? _signaled.exchange(false) : _signaled.load())) {
+                slot *f = _queue;
+                _queue = f->_next;
+                f->_next = ready;
+                ready = f;
+            }
+            _has_queue.store(_queue != nullptr);
+            _busy.store(false);
+            //recheck, other thread could fail to enter while we were busy
+        } while (_requests.load() || (_has_queue.load() && _signaled.load()));
+        return ready;
+    }
+};
+
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include "coroutine.h"
+
+#include <atomic>
+#include <optional>
+#include <stop_token>
+
+namespace MINICORO_NAMESPACE {
+
+///hierarchical source of cancellation
+/**
+ * The source is canceled explicitly by cancel() or when its parent is canceled. The
+ * token (std::stop_token) is passed down to child coroutines, which can create own
+ * source with the token as the parent. Primitives accept the token and resolve
+ * waiting coroutines with no value once the token is signaled.
+ *
+ * @code
+ * awaitable<void> handle_client(std::stop_token parent) {
+ *      cancel_source src(parent);      //canceled with parent
+ *      auto msg = co_await queue.pop(src.get_token());
+ *      co_await sch.sleep_for(timeout, src.get_token());
+ * }
+ * @endcode
+ *
+ * @note the object is not movable, child registration refers to it
+ */
+class cancel_source {
+public:
+
+    ///construct root source
+    cancel_source() = default;
+    ///construct child source
+    /**
+     * @param parent token of parent. If the parent is signaled, this source is canceled
+     */
+    explicit cancel_source(std::stop_token parent)
+        :_parent(std::in_place, std::move(parent), forward{&_src}) {}
+
+    cancel_source(const cancel_source &) = delete;
+    cancel_source &operator=(const cancel_source &) = delete;
+
+    ///retrieve token
+    std::stop_token get_token() const noexcept {return _src.get_token();}
+    ///cancel the source and all children
+    /**
+     * @retval true canceled
+     * @retval false already canceled
+     */
+    bool cancel() noexcept {return _src.request_stop();}
+    ///determine whether source is canceled
+    bool is_canceled() const noexcept {return _src.stop_requested();}
+
+protected:
+    struct forward {
+        std::stop_source *_src;
+        void operator()() const noexcept {_src->request_stop();}
+    };
+
+    std::stop_source _src;
+    std::optional<std::stop_callback<forward> > _parent;
+};
+
+///waiting operation which can be canceled by a stop token (used by with_cancel())
+/**
+ * @tparam T type of result
+ * @tparam Canceler function which removes the request from the primitive
+ * @tparam abandon if true, Canceler is not used. Outer awaitable is resolved on cancel,
+ * result of the inner awaitable is dropped later
+ */
+template<typename T, typename Canceler, bool abandon = false>
+class cancelable_wait: public coro_frame<cancelable_wait<T, Canceler, abandon> > {
+public:
+
+    cancelable_wait(awaitable_result<T> &&outer, Canceler &&canceler)
+        :_outer(std::move(outer)), _canceler(std::move(canceler)) {}
+
+    ///start waiting
+    /**
+     * @param inner awaitable of the primitive, its request is identified by this object
+     * @param tkn stop token
+     * @return prepared coroutine to resume
+     */
+    prepared_coro start(awaitable<T> &&inner, std::stop_token tkn) {
+        _inner = std::move(inner);
+        _reg.emplace(std::move(tkn), on_stop{this});
+        prepared_coro p = call_await_suspend(_inner, this->get_handle());
+        prepared_coro q;
+        if (_flags.fetch_or(started) & stopped) q = cancel_inner();
+        release();
+        //p can resume this frame, so q is resolved first
+        q.resume();
+        return p;
+    }
+
+protected:
+
+    friend class coro_frame<cancelable_wait>;
+
+    static constexpr unsigned int started = 1;
+    static constexpr unsigned int stopped = 2;
+
+    struct on_stop {
+        cancelable_wait *me;
+        void operator()() const {
+            if (me->_flags.fetch_or(stopped) & started) {
+                //cancel_inner() doesn't resume, resumption is last action here
+                me->cancel_inner();
+            }
+        }
+    };
+
+    awaitable<T> _inner = {nullptr};
+    awaitable_result<T> _outer;
+    Canceler _canceler;
+    std::atomic<unsigned int> _flags = {0};
+    //start() + completion of inner
+    std::atomic<unsigned int> _refs = {2};
+    std::atomic<bool> _outer_done = {false};
+    std::optional<std::stop_callback<on_stop> > _reg;
+
+    //ask primitive to resolve the inner awaitable, or abandon it
+    prepared_coro cancel_inner() {
+        if constexpr(abandon) {
+            //resolve outer now, the result is dropped later
+            if (_outer_done.exchange(true)) return {};
+            return _outer = std::nullopt;
+        } else {
+            //if the request is not found, it is being resolved
+            return _canceler(static_cast<const void *>(this), _inner);
+        }
+    }
+
+    void release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    //inner awaitable is resolved
+    void do_resume() {
+        _reg.reset();
+        prepared_coro out;
+        if (!_outer_done.exchange(true)) {
+            bool hv = _inner.has_value();
+            if (!hv) {
+                out = (_outer = std::nullopt);
+            } else {
+                try {
+                    if constexpr(std::is_void_v<T>) {
+                        _inner.await_resume();
+                        out = _outer();
+                    } else {
+                        out = _outer(_inner.await_resume());
+                    }
+                } catch (...) {
+                    out = (_outer = std::current_exception());
+                }
+            }
+        }
+        release();
+    }
+};
+
+namespace _details {
+
+template<typename T, bool abandon, typename Factory, typename Canceler>
+awaitable<T> with_cancel_impl(std::stop_token tkn, Factory &&factory, Canceler &&canceler) {
+    using State = cancelable_wait<T, std::decay_t<Canceler>, abandon>;
+    return [tkn = std::move(tkn), factory = std::forward<Factory>(factory),
+            canceler = std::forward<Canceler>(canceler)](awaitable_result<T> r) mutable -> prepared_coro {
+        if (!r) return {};
+        if (tkn.stop_requested()) return r = std::nullopt;
+        auto st = new State(std::move(r), std::move(canceler));
+        return st->start(factory(static_cast<const void *>(st)), std::move(tkn));
+    };
+}
+
+}
+
+///make an operation of a primitive cancelable by a stop token
+/**
+ * @param tkn stop token
+ * @param factory function which starts the operation. It receives an identity
+ * (const void *) of the request and returns awaitable<T>
+ * @param canceler function which receives the identity and reference to the inner awaitable.
+ * It must remove the request from the primitive and return prepared coroutine of the
+ * inner awaitable resolved with no value. It must not resume anything. If the request is
+ * not found (because it is being resolved), it returns empty object
+ * @return awaitable, resolved with result of the operation or with no value, when
+ * the token is signaled
+ *
+ * @note the operation allocates a small state on heap
+ */
+template<typename T, std::invocable<const void *> Factory, typename Canceler>
+awaitable<T> with_cancel(std::stop_token tkn, Factory &&factory, Canceler &&canceler) {
+    return _details::with_cancel_impl<T, false>(std::move(tkn), std::forward<Factory>(factory), std::forward<Canceler>(canceler));
+}
+
+///make an operation cancelable by abandoning it
+/**
+ * @param tkn stop token
+ * @param factory function which starts operation
+ * @return awaitable resolved with no value when the token is signaled. The operation
+ * continues and its result is dropped.
+ *
+ * @note use only for operations where dropping the result is safe (for example
+ * lock of a mutex - the ownership is released)
+ */
+template<typename T, std::invocable<const void *> Factory>
+awaitable<T> with_cancel(std::stop_token tkn, Factory &&factory) {
+    return _details::with_cancel_impl<T, true>(std::move(tkn), std::forward<Factory>(factory),
+            [](const void *, awaitable<T> &) {return prepared_coro{};});
+}
+
+}
@@ -1,13 +1,28 @@
 #pragma once
 
 #include "coroutine.h"
+#include "coro_cancel.h"
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "alert_flag.h"
 
 namespace MINICORO_NAMESPACE {
 
 
+///distributes value to multiple awaiting coroutines
+/**
+ * @tparam T type of broadcasted value. Each listener receives own copy of the value.
+ * If T is a reference (for example distributor<const Msg &>), listeners receive
+ * reference to the single value, which is passed to broadcast(). No copy is made,
+ * but the value must stay valid until all listeners are resumed
+ * (see also shared_distributor)
+ * @tparam Lock lock which protects internal state
+ */
 template<typename T, basic_lockable Lock = empty_lockable>
 class distributor {
 public:
@@ -47,16 +62,28 @@ public:
         };
     }
 
+    ///register coroutine to receive broadcast, cancelable
+    /**
+     * @param tkn stop token. When signaled, the coroutine is kicked out, the awaitable
+     * is resolved with no value
+     * @return awaitable
+     */
+    awaitable operator()(std::stop_token tkn) {
+        return with_cancel<T>(std::move(tkn), [this](ident id) {
+            return (*this)(id);
+        }, [this](ident id, awaitable &) {
+            return kick_out(id);
+        });
+    }
+
     void add_listener(result_object r, ident id = {}) {
         lock_guard _(_mx);
-        _results.push_back({std::move(r), id});
-
+        add(std::move(r), id);
     }
     void add_listener(alert_flag_type &a, result_object r) {
         lock_guard _(_mx);
         if (a) return;
-        _results.push_back({std::move(r), &a});
-
+        add(std::move(r), &a);
     }
 
     ///broadcast the value
@@ -76,6 +103,26 @@ public:
             buffer.push_back(r.r(args...));
         }
         _results.clear();
+        _index.clear();
+    }
+
+    ///broadcast the value
+    /**
+     * @param lst list which receives prepared coroutines. Coroutines are resumed
+     * by lst.resume_all()
+     * @param args arguments need to construct value
+     *
+     * @note This function is MT-Safe if the Lock is std::mutex
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<value_type, Args...>)
+    void broadcast(resume_list &lst, Args && ... args) {
+        lock_guard _(_mx);
+        for (auto &r: _results) {
+            lst.push(r.r(args...));
+        }
+        _results.clear();
+        _index.clear();
     }
 
     ///broadcast the value and resume awaiting coroutines in current thread
@@ -84,12 +131,15 @@ public:
      * @note This function is not MT-Safe for this function, only one
      * thread can call broadcast() at the same time. For other functions
      * this function is MT-Safe.
+     *
+     * @note If a resumed coroutine broadcasts again, its listeners are resumed
+     * after the current listeners by the same loop, the stack doesn't grow
      */
     template<typename ... Args>
     requires(std::is_constructible_v<value_type, Args...>)
     void broadcast(Args && ... args) {
         broadcast(_ready_to_run, std::forward<Args>(args)...);
-        _ready_to_run.clear();
+        _ready_to_run.resume_all();
     }
 
     ///kicks out awaiting coroutine
@@ -103,23 +153,19 @@ public:
      */
     template<std::invocable<result_object> Resolver>
     prepared_coro kick_out(ident id, Resolver &&resolver) {
-        lock_guard _(_mx);
-        prepared_coro out;
-        auto iter = std::find_if(_results.begin(), _results.end(), [&](const awaiting_info &x){
-            return x.i == id;
-        });
-        if (iter != _results.end()) {
-            if constexpr(std::is_void_v<std::invoke_result_t<Resolver, result_object> >) {
-                resolver(std::move(iter->r));
-            } else {
-                out = resolver(std::move(iter->r));
-            }
-            auto last = _results.end();
-            --last;
-            if (iter != last) std::swap(*iter, *last);
-            _results.pop_back();
+        if (!id) return {};
+        result_object r;
+        {
+            lock_guard _(_mx);
+            r = remove(id);
+        }
+        if (!r) return {};
+        if constexpr(std::is_void_v<std::invoke_result_t<Resolver, result_object> >) {
+            resolver(std::move(r));
+            return {};
+        } else {
+            return resolver(std::move(r));
         }
-        return out;
     }
 
     ///kicks out awaiting coroutine sending out an exception
@@ -157,22 +203,13 @@ public:
      * @note the co_await always throws exception await_canceled_exception.
      */
     prepared_coro alert(alert_flag_type &alert_flag) {
-        prepared_coro out;
-        lock_guard _(_mx);
-        alert_flag.set();
-        auto iter = std::find_if(_results.begin(), _results.end(), [&](const awaiting_info &x){
-            return x.i == &alert_flag;
-        });
-        if (iter != _results.end()) {
-            out = (iter->r = std::nullopt);
-
-            auto last = _results.end();
-            --last;
-            if (iter != last) std::swap(*iter, *last);
-            _results.pop_back();
+        result_object r;
+        {
+            lock_guard _(_mx);
+            alert_flag.set();
+            r = remove(&alert_flag);
         }
-        return out;
-
+        return r = std::nullopt;
     }
 
     bool empty() const {
@@ -183,9 +220,394 @@ public:
 protected:
     mutable Lock _mx;
     std::vector<awaiting_info> _results;
-    std::vector<prepared_coro> _ready_to_run;
+    //ident -> position in _results, kick_out() and alert() don't scan the list
+    std::unordered_multimap<ident, std::size_t> _index;
+    resume_list _ready_to_run;
+
+    void add(result_object r, ident id) {
+        if (id) _index.emplace(id, _results.size());
+        _results.push_back({std::move(r), id});
+    }
+
+    result_object remove(ident id) {
+        auto iter = _index.find(id);
+        if (iter == _index.end()) return {};
+        auto pos = iter->second;
+        _index.erase(iter);
+        result_object out = std::move(_results[pos].r);
+        auto last = _results.size() - 1;
+        if (pos != last) {
+            _results[pos] = std::move(_results[last]);
+            reindex(_results[pos].i, last, pos);
+        }
+        _results.pop_back();
+        return out;
+    }
+
+    void reindex(ident id, std::size_t from, std::size_t to) {
+        if (!id) return;
+        auto rng = _index.equal_range(id);
+        for (auto iter = rng.first; iter != rng.second; ++iter) {
+            if (iter->second == from) {
+                iter->second = to;
+                return;
+            }
+        }
+    }
 
 };
 
 
+///distributor which shares one instance of the value with all listeners
+/**
+ * The value is constructed once and listeners receive std::shared_ptr<const T>. Unlike
+ * distributor<const T &>, the value stays valid until the last listener drops the pointer,
+ * so listeners can be resumed later and in other threads.
+ *
+ * @code
+ * shared_distributor<Msg> dist;
+ * //listener
+ * std::shared_ptr<const Msg> msg = co_await dist();
+ * //publisher
+ * dist.publish(args...);
+ * @endcode
+ *
+ * @tparam T type of value
+ * @tparam Lock lock which protects internal state
+ */
+template<typename T, basic_lockable Lock = empty_lockable>
+class shared_distributor: public distributor<std::shared_ptr<const T>, Lock> {
+public:
+
+    using value_ptr = std::shared_ptr<const T>;
+    using prepared = typename distributor<value_ptr, Lock>::prepared;
+
+    ///construct the value and broadcast it
+    /**
+     * @param buffer buffer to store prepared coroutines. You need to clear
+     * the buffer to resume all these coroutines
+     * @param args arguments to construct the value
+     * @return pointer to the value
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<T, Args...>)
+    value_ptr publish(prepared &buffer, Args && ... args) {
+        value_ptr v = std::make_shared<const T>(std::forward<Args>(args)...);
+        this->broadcast(buffer, v);
+        return v;
+    }
+
+    ///construct the value and broadcast it
+    /**
+     * @param lst list which receives prepared coroutines
+     * @param args arguments to construct the value
+     * @return pointer to the value
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<T, Args...>)
+    value_ptr publish(resume_list &lst, Args && ... args) {
+        value_ptr v = std::make_shared<const T>(std::forward<Args>(args)...);
+        this->broadcast(lst, v);
+        return v;
+    }
+
+    ///construct the value and broadcast it, resume listeners in current thread
+    /**
+     * @param args arguments to construct the value
+     * @return pointer to the value
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<T, Args...>)
+    value_ptr publish(Args && ... args) {
+        value_ptr v = std::make_shared<const T>(std::forward<Args>(args)...);
+        this->broadcast(v);
+        return v;
+    }
+};
+
+///distributor for large count of listeners
+/**
+ * Listeners are spread over shards, each shard has own lock, own list of listeners
+ * and own index ident -> position, so kick_out() and alert() don't need to
+ * scan the list.
+ *
+ * The broadcast takes the list of shard out under the lock and resolves listeners
+ * outside of the lock, so new registrations don't wait for the broadcast.
+ *
+ * @tparam T type of broadcasted value
+ * @tparam shards count of shards
+ * @tparam Lock lock which protects single shard
+ *
+ * @note all functions are MT-Safe if the Lock is std::mutex
+ */
+template<typename T, unsigned int shards = 16, basic_lockable Lock = std::mutex>
+class sharded_distributor {
+public:
+    static_assert(shards > 0);
+
+    using value_type = voidless_type<T>;
+
+    using awaitable = MINICORO_NAMESPACE::awaitable<T>;
+    using result_object = typename awaitable::result;
+    using prepared = std::vector<prepared_coro>;
+    using ident = const void *;
+
+    struct awaiting_info {
+        result_object r;
+        ident i;
+    };
+
+    ///register coroutine to receive broadcast
+    /**
+     * @param id identification of the coroutine. Listeners without identification
+     * can't be kicked out
+     * @return awaitable
+     */
+    awaitable operator()(ident id = {}) {
+        return [this,id](result_object r){
+            add_listener(std::move(r), id);
+        };
+    }
+
+    ///register coroutine to receive broadcast with alert support
+    /**
+     * @param alert_flag reference to alert flag.
+     * @see distributor::operator()(alert_flag_type &)
+     */
+    awaitable operator()(alert_flag_type &alert_flag) {
+        return [this,&alert_flag](result_object r){
+            add_listener(alert_flag, std::move(r));
+        };
+    }
+
+    ///register coroutine to receive broadcast, cancelable
+    /**
+     * @param tkn stop token. When signaled, the coroutine is kicked out, the awaitable
+     * is resolved with no value
+     * @return awaitable
+     */
+    awaitable operator()(std::stop_token tkn) {
+        return with_cancel<T>(std::move(tkn), [this](ident id) {
+            return (*this)(id);
+        }, [this](ident id, awaitable &) {
+            return kick_out(id);
+        });
+    }
+
+    void add_listener(result_object r, ident id = {}) {
+        shard &s = select(id);
+        lock_guard _(s._mx);
+        s.add(std::move(r), id);
+    }
+
+    void add_listener(alert_flag_type &a, result_object r) {
+        shard &s = select(&a);
+        lock_guard _(s._mx);
+        if (a) return;
+        s.add(std::move(r), &a);
+    }
+
+    ///broadcast the value
+    /**
+     * @param buffer buffer to store prepared coroutines. You need to clear the
+     * buffer to resume all these coroutines
+     * @param args arguments need to construct value
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<value_type, Args...>)
+    void broadcast(prepared &buffer, Args && ... args) {
+        for_each_shard([&](std::vector<awaiting_info> &lst){
+            for (auto &r: lst) buffer.push_back(r.r(args...));
+        });
+    }
+
+    ///broadcast the value
+    /**
+     * @param lst list which receives prepared coroutines. Coroutines are resumed
+     * by lst.resume_all()
+     * @param args arguments need to construct value
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<value_type, Args...>)
+    void broadcast(resume_list &lst, Args && ... args) {
+        for_each_shard([&](std::vector<awaiting_info> &l){
+            for (auto &r: l) lst.push(r.r(args...));
+        });
+    }
+
+    ///broadcast the value and resume awaiting coroutines in current thread
+    /**
+     * @param args arguments need to construct value
+     */
+    template<typename ... Args>
+    requires(std::is_constructible_v<value_type, Args...>)
+    void broadcast(Args && ... args) {
+        for_each_shard([&](std::vector<awaiting_info> &lst){
+            for (auto &r: lst) r.r(args...);
+        });
+    }
+
+    ///broadcast the value and post resumption of coroutines in chunks to an executor
+    /**
+     * @param executor executor which accepts a buffer of prepared coroutines
+     * in function post (for example coro_thread_pool)
+     * @param chunk_size count of coroutines posted at once
+     * @param args arguments need to construct value
+     */
+    template<typename Executor, typename ... Args>
+    requires(std::is_constructible_v<value_type, Args...> && requires(Executor &e, prepared &buffer){
+        e.post(buffer);
+    })
+    void broadcast_to(Executor &executor, std::size_t chunk_size, Args && ... args) {
+        prepared buffer;
+        buffer.reserve(chunk_size);
+        for_each_shard([&](std::vector<awaiting_info> &lst){
+            for (auto &r: lst) {
+                buffer.push_back(r.r(args...));
+                if (buffer.size() >= chunk_size) {
+                    executor.post(buffer);
+                    buffer.clear();
+                }
+            }
+        });
+        if (!buffer.empty()) executor.post(buffer);
+    }
+
+    ///kicks out awaiting coroutine
+    /**
+     * @param id identification of coroutine
+     * @param resolver function receives result object.
+     * @return prepared_coro of kicked out coroutine or empty
+     *
+     * @see distributor::kick_out
+     */
+    template<std::invocable<result_object> Resolver>
+    prepared_coro kick_out(ident id, Resolver &&resolver) {
+        if (!id) return {};
+        shard &s = select(id);
+        result_object r;
+        {
+            lock_guard _(s._mx);
+            r = s.remove(id);
+        }
+        if (!r) return {};
+        if constexpr(std::is_void_v<std::invoke_result_t<Resolver, result_object> >) {
+            resolver(std::move(r));
+            return {};
+        } else {
+            return resolver(std::move(r));
+        }
+    }
+
+    ///kicks out awaiting coroutine sending out an exception
+    prepared_coro kick_out(ident id, std::exception_ptr e) {
+        return kick_out(id, [e = std::move(e)](result_object obj) mutable {
+            return obj.set_exception(std::move(e));
+        });
+    }
+
+    ///kicks out awaiting coroutine setting result to "no-value"
+    prepared_coro kick_out(ident id) {
+        return kick_out(id, [](result_object obj) mutable {
+            return obj = std::nullopt;
+        });
+    }
+
+    ///send alert to prevent a coroutine to receive broadcast
+    /**
+     * @see distributor::alert
+     */
+    prepared_coro alert(alert_flag_type &alert_flag) {
+        shard &s = select(&alert_flag);
+        result_object r;
+        {
+            lock_guard _(s._mx);
+            alert_flag.set();
+            r = s.remove(&alert_flag);
+        }
+        return r = std::nullopt;
+    }
+
+    bool empty() const {
+        for (const shard &s: _shards) {
+            lock_guard _(s._mx);
+            if (!s._results.empty()) return false;
+        }
+        return true;
+    }
+
+protected:
+
+    struct shard {
+        mutable Lock _mx;
+        std::vector<awaiting_info> _results;
+        //ident -> position in _results
+        std::unordered_multimap<ident, std::size_t> _index;
+        //empty buffer kept for swap during broadcast
+        std::vector<awaiting_info> _spare;
+
+        void add(result_object r, ident id) {
+            if (id) _index.emplace(id, _results.size());
+            _results.push_back({std::move(r), id});
+        }
+
+        result_object remove(ident id) {
+            auto iter = _index.find(id);
+            if (iter == _index.end()) return {};
+            auto pos = iter->second;
+            _index.erase(iter);
+            result_object out = std::move(_results[pos].r);
+            auto last = _results.size() - 1;
+            if (pos != last) {
+                _results[pos] = std::move(_results[last]);
+                reindex(_results[pos].i, last, pos);
+            }
+            _results.pop_back();
+            return out;
+        }
+
+        void reindex(ident id, std::size_t from, std::size_t to) {
+            if (!id) return;
+            auto rng = _index.equal_range(id);
+            for (auto iter = rng.first; iter != rng.second; ++iter) {
+                if (iter->second == from) {
+                    iter->second = to;
+                    return;
+                }
+            }
+        }
+    };
+
+    shard _shards[shards];
+    //selects shard for listeners without identification
+    std::atomic<unsigned int> _next = {0};
+
+    shard &select(ident id) {
+        if (!id) return _shards[_next.fetch_add(1, std::memory_order_relaxed) % shards];
+        //pointers are aligned, mix the bits before selecting the shard
+        auto h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(id));
+        h = (h ^ (h >> 29)) * 0x9E3779B97F4A7C15ULL;
+        return _shards[(h >> 32) % shards];
+    }
+
+    //take list of each shard and process it outside of the lock
+    template<typename Fn>
+    void for_each_shard(Fn &&fn) {
+        for (shard &s: _shards) {
+            std::vector<awaiting_info> lst;
+            {
+                lock_guard _(s._mx);
+                if (s._results.empty()) continue;
+                std::swap(lst, s._spare);
+                std::swap(lst, s._results);
+                s._index.clear();
+            }
+            fn(lst);
+            lst.clear();
+            lock_guard _(s._mx);
+            if (s._spare.capacity() < lst.capacity()) std::swap(lst, s._spare);
+        }
+    }
+};
+
 }
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "coroutine.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace MINICORO_NAMESPACE {
+
+///executor which can resume coroutines
+/**
+ * post() schedules resumption of the coroutine, is_current() returns true when
+ * the calling thread is running under the executor (for example coro_thread_pool)
+ */
+template<typename T>
+concept is_executor = requires(T &e, std::coroutine_handle<> h) {
+    e.post(h);
+    {e.is_current()} -> std::convertible_to<bool>;
+};
+
+///reference to any executor
+/**
+ * Executors register themselves as current executor of the thread which executes
+ * coroutines (see executor_scope). The reference can be retrieved by current()
+ */
+class executor_ref {
+public:
+
+    ///construct empty reference
+    executor_ref() = default;
+
+    ///construct reference to an executor
+    template<is_executor E>
+    requires(!std::is_same_v<E, executor_ref>)
+    executor_ref(E &e)
+        :_ptr(&e)
+        ,_post([](void *p, std::coroutine_handle<> h){static_cast<E *>(p)->post(h);})
+        ,_is_current([](const void *p) -> bool {return static_cast<const E *>(p)->is_current();}) {}
+
+    ///schedule the coroutine to the executor
+    void post(std::coroutine_handle<> h) const {_post(_ptr, h);}
+    ///determine whether current thread runs under the executor
+    bool is_current() const {return _ptr && _is_current(_ptr);}
+
+    explicit operator bool() const {return _ptr != nullptr;}
+
+    bool operator==(const executor_ref &other) const {return _ptr == other._ptr;}
+
+    ///retrieve executor of current thread
+    /**
+     * @return reference to executor, or empty if the thread doesn't run under an executor
+     */
+    static executor_ref current() {return current_ref();}
+
+protected:
+    void *_ptr = nullptr;
+    void (*_post)(void *, std::coroutine_handle<>) = nullptr;
+    bool (*_is_current)(const void *) = nullptr;
+
+    static executor_ref &current_ref() {
+        static thread_local executor_ref cur;
+        return cur;
+    }
+
+    friend class executor_scope;
+};
+
+///sets current executor of the thread for the lifetime of the object
+/**
+ * Executors use this object in their worker threads
+ */
+class executor_scope {
+public:
+    explicit executor_scope(executor_ref e):_prev(std::exchange(executor_ref::current_ref(), e)) {}
+    ~executor_scope() {executor_ref::current_ref() = _prev;}
+    executor_scope(const executor_scope &) = delete;
+    executor_scope &operator=(const executor_scope &) = delete;
+protected:
+    executor_ref _prev;
+};
+
+///awaiter which moves the coroutine to the executor
+template<is_executor E>
+struct resume_on_awaiter {
+    E *_exec;
+    bool await_ready() const {return _exec->is_current();}
+    void await_suspend(std::coroutine_handle<> h) {_exec->post(h);}
+    static constexpr void await_resume() noexcept {}
+};
+
+///continue the coroutine on given executor
+/**
+ * @param exec executor
+ * @return awaiter. If the coroutine is already running under the executor,
+ * it continues without suspension
+ *
+ * @code
+ * co_await resume_on(pool);
+ * @endcode
+ */
+template<is_executor E>
+resume_on_awaiter<E> resume_on(E &exec) {
+    return {&exec};
+}
+
+///awaitable which resumes the waiting coroutine on the executor it was suspended on
+/**
+ * The awaiting coroutine is not resumed by the thread which resolves the awaitable
+ * (for example, the thread which pushes to the queue or unlocks the mutex), its
+ * resumption is posted to the executor instead. If that thread already runs under
+ * the executor, the coroutine is resumed inline.
+ *
+ * @code
+ * auto msg = co_await sticky(queue.pop());
+ * @endcode
+ *
+ * The object is created by the function sticky()
+ *
+ * @tparam T type of result
+ */
+template<typename T>
+class sticky_awaitable {
+public:
+
+    sticky_awaitable(awaitable<T> &&awt, executor_ref exec)
+        :_awt(std::move(awt)) {
+        _frame._exec = exec;
+    }
+
+    bool await_ready() const noexcept {
+        return _awt.await_ready();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+        if (!_frame._exec) _frame._exec = executor_ref::current();
+        //outside of executor, nothing to stick to
+        if (!_frame._exec) return _awt.await_suspend(h);
+        _frame._h = h;
+        return _awt.await_suspend(_frame.get_handle());
+    }
+
+    std::add_rvalue_reference_t<T> await_resume() {
+        return _awt.await_resume();
+    }
+
+protected:
+
+    struct frame: coro_frame<frame> { // @suppress("Miss copy constructor or assignment operator")
+        executor_ref _exec;
+        std::coroutine_handle<> _h;
+
+        void do_resume() {
+            if (_exec.is_current()) _h.resume(); else _exec.post(_h);
+        }
+    };
+
+    awaitable<T> _awt;
+    frame _frame;
+};
+
+///make the awaitable sticky to the executor of the awaiting coroutine
+/**
+ * @param awt awaitable
+ * @return awaitable which resumes the coroutine on the executor, which was current
+ * at the time of suspension
+ *
+ * @see sticky_awaitable
+ */
+template<typename T>
+sticky_awaitable<T> sticky(awaitable<T> &&awt) {
+    return sticky_awaitable<T>(std::move(awt), {});
+}
+
+///make the awaitable sticky to given executor
+/**
+ * @param awt awaitable
+ * @param exec executor where the coroutine continues
+ * @return awaitable
+ */
+template<typename T, is_executor E>
+sticky_awaitable<T> sticky(awaitable<T> &&awt, E &exec) {
+    return sticky_awaitable<T>(std::move(awt), executor_ref(exec));
+}
+
+///executor which runs coroutines in a thread which calls run() or await()
+/**
+ * Use it as an event loop of a thread which is not a thread pool worker (for example
+ * the main thread)
+ *
+ * @code
+ * loop_executor loop;
+ * loop.await(main_task(loop));
+ * @endcode
+ */
+class loop_executor {
+public:
+
+    loop_executor() = default;
+    loop_executor(const loop_executor &) = delete;
+    loop_executor &operator=(const loop_executor &) = delete;
+
+    ///schedule coroutine
+    void post(std::coroutine_handle<> h) {
+        std::lock_guard _(_mx);
+        _queue.push_back(h);
+        _cv.notify_one();
+    }
+
+    ///schedule prepared coroutine
+    void post(prepared_coro &&c) {
+        if (c) post(c.symmetric_transfer());
+    }
+
+    ///determine whether current thread runs the loop
+    bool is_current() const {
+        return _current_loop == this;
+    }
+
+    ///run the loop until the token is signaled
+    /**
+     * Coroutines which are already posted when the token is signaled are still resumed,
+     * the function returns once the queue is empty. So a coroutine which keeps posting
+     * itself prevents the function from returning.
+     */
+    void run(std::stop_token tkn) {
+        executor_scope _(*this);
+        auto prev = std::exchange(_current_loop, this);
+        std::stop_callback cb(tkn, [this]{
+            std::lock_guard _(_mx);
+            _cv.notify_all();
+        });
+        std::vector<std::coroutine_handle<> > batch;
+        while (true) {
+            {
+                std::unique_lock lk(_mx);
+                _cv.wait(lk, [&]{return !_queue.empty() || tkn.stop_requested();});
+                std::swap(batch, _queue);
+            }
+            //stop requested and nothing left to resume
+            if (batch.empty()) break;
+            for (auto h: batch) h.resume();
+            batch.clear();
+        }
+        _current_loop = prev;
+    }
+
+    ///run the loop while awaiting for given awaiter
+    /**
+     * @param awt awaiter
+     * @return value returned by await_resume()
+     */
+    template<is_awaiter Awt>
+    auto await(Awt &&awt) {
+        if (!awt.await_ready()) {
+            stop_frame frm;
+            call_await_suspend(awt, frm.get_handle());
+            run(frm.get_token());
+        }
+        return awt.await_resume();
+    }
+
+protected:
+
+    struct stop_frame: coro_frame<stop_frame>, std::stop_source { // @suppress("Miss copy constructor or assignment operator")
+        friend class coro_frame<stop_frame>;
+        void do_resume() {this->request_stop();}
+    };
+
+    std::mutex _mx;
+    std::condition_variable _cv;
+    std::vector<std::coroutine_handle<> > _queue;
+
+    static inline thread_local const loop_executor *_current_loop = nullptr;
+};
+
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "coroutine.h"
+#include "coro_scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MINICORO_NAMESPACE {
+
+///scheduler which runs timers in multiple threads
+/**
+ * Each worker thread has own timer structure and own lock-free inbox. A sleep request
+ * is pushed to the inbox of the selected worker without locking. The worker is
+ * notified (and its lock is taken) only if the new timer fires before the time the worker
+ * is currently sleeping to. There is no global lock, and no thundering herd, each
+ * worker waits on own condition variable.
+ *
+ * The worker is selected by the identity of the sleep. Sleeps without identity are
+ * assigned to current worker (if called from a worker thread) or distributed
+ * round-robin
+ *
+ * @code
+ * mt_scheduler sch(4);
+ * co_await sch.sleep_for(std::chrono::milliseconds(100), this);
+ * //other thread
+ * sch.cancel(this);
+ * @endcode
+ *
+ * Coroutines are resumed in the worker thread which holds the timer.
+ *
+ * @tparam Impl implementation of timer structure (see basic_scheduler). The instance
+ * is used by single worker, it doesn't need to be thread safe
+ *
+ * @note when the scheduler is stopped, remaining sleeps are resolved with no value
+ */
+template<typename Impl = generic_scheduler<awaitable<void>::result, std::chrono::system_clock::time_point, const void *> >
+class basic_mt_scheduler {
+public:
+
+    using _Ident = const void *;
+    using result_object = typename awaitable<void>::result;
+    using time_point = std::chrono::system_clock::time_point;
+
+    ///start the scheduler
+    /**
+     * @param threads count of worker threads
+     */
+    explicit basic_mt_scheduler(unsigned int threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) threads = 1;
+        _shards.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i) _shards.push_back(std::make_unique<shard>());
+        _threads.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i) _threads.emplace_back([this, i]{worker_loop(i);});
+    }
+
+    basic_mt_scheduler(const basic_mt_scheduler &) = delete;
+    basic_mt_scheduler &operator=(const basic_mt_scheduler &) = delete;
+
+    ///destructor stops the scheduler
+    ~basic_mt_scheduler() {
+        stop();
+    }
+
+    ///sleep until given time
+    /**
+     * @param tp time point
+     * @param ident optional identity, required for cancel()
+     * @return awaitable, coroutine must co_await to perform sleep
+     */
+    awaitable<void> sleep_until(time_point tp, _Ident ident = {}) {
+        return [this, tp, ident](result_object r) mutable -> prepared_coro {
+            if (!r) return {};
+            //copy captures, temp state overwrites the closure
+            auto me = this;
+            auto t = tp;
+            auto id = ident;
+            if (!me->_running.load(std::memory_order_acquire)) return r = std::nullopt;
+            auto s = awaitable<void>::get_temp_state<request>(r);
+            if (!s) return {};
+            s->_tp = t;
+            s->_ident = id;
+            s->_resume = r.release();
+            me->select(id).push(s);
+            return {};
+        };
+    }
+
+    ///sleep for given time
+    /**
+     * @param dur duration
+     * @param ident optional identity, required for cancel()
+     * @return awaitable
+     */
+    template<typename A, typename B>
+    awaitable<void> sleep_for(std::chrono::duration<A,B> dur, _Ident ident = {}) {
+        return sleep_until(std::chrono::system_clock::now()+dur, std::move(ident));
+    }
+
+    ///sleep until given time, cancelable
+    /**
+     * @param tp time point
+     * @param tkn stop token. When signaled, the sleep is canceled and the awaitable is
+     * resolved with no value
+     * @return awaitable
+     */
+    awaitable<void> sleep_until(time_point tp, std::stop_token tkn) {
+        return with_cancel<void>(std::move(tkn), [this, tp](_Ident id) {
+            return sleep_until(tp, id);
+        }, [this](_Ident id, awaitable<void> &) {
+            return cancel(id);
+        });
+    }
+
+    ///sleep for given time, cancelable
+    template<typename A, typename B>
+    awaitable<void> sleep_for(std::chrono::duration<A,B> dur, std::stop_token tkn) {
+        return sleep_until(std::chrono::system_clock::now()+dur, std::move(tkn));
+    }
+
+    ///remove sleeping coroutine by identity
+    /**
+     * @param ident identity
+     * @return result object of this coroutine, or empty, if not found
+     */
+    result_object remove_by_ident(_Ident ident) {
+        shard &sh = select(ident);
+        std::lock_guard _(sh._mx);
+        sh.drain();
+        return sh._timers.remove_by_ident(ident);
+    }
+
+    ///cancel sleep
+    /** cancels sleep and resolves awaitable with given value
+     *
+     * @param ident identity
+     * @param arg value
+     * @return prepared coroutine. If empty, then nothing has been canceled
+     */
+    template<std::convertible_to<void> Arg>
+    prepared_coro cancel(_Ident ident, Arg &&arg) {
+        result_object r = remove_by_ident(ident);
+        return r(std::forward<Arg>(arg));
+    }
+    ///cancel sleep with exception
+    /**
+     * @param ident identity
+     * @param e exception
+     * @return prepared coroutine. If empty, then nothing has been canceled
+     */
+    prepared_coro cancel(_Ident ident, std::exception_ptr e) {
+        result_object r = remove_by_ident(ident);
+        return r = e;
+    }
+    ///cancel sleep, resolve it with no value
+    /**
+     * @param ident identity
+     * @return prepared coroutine. If empty, then nothing has been canceled
+     */
+    prepared_coro cancel(_Ident ident) {
+        result_object r = remove_by_ident(ident);
+        return r = std::nullopt;
+    }
+
+    ///determines whether current thread is worker of this scheduler
+    bool is_current() const {
+        return _current_sched == this;
+    }
+
+    ///retrieve count of workers
+    unsigned int size() const {
+        return static_cast<unsigned int>(_shards.size());
+    }
+
+    ///stop the scheduler
+    /**
+     * Function waits for the workers. Remaining sleeps are resolved with no value
+     * in the calling thread
+     *
+     * @note must not be called from a worker thread
+     */
+    void stop() {
+        if (!_running.exchange(false, std::memory_order_acq_rel)) return;
+        for (auto &sh: _shards) {
+            std::lock_guard _(sh->_mx);
+            sh->_cv.notify_all();
+        }
+        for (auto &t: _threads) t.join();
+        _threads.clear();
+        for (auto &sh: _shards) {
+            while (true) {
+                result_object r;
+                {
+                    std::lock_guard _(sh->_mx);
+                    sh->drain();
+                    if (!sh->_timers.get_first_scheduled_time()) break;
+                    r = sh->_timers.remove_first();
+                }
+                r = std::nullopt;
+            }
+        }
+    }
+
+protected:
+
+    //sleep request, located in temporary state of the awaitable
+    struct request {
+        request *_next;
+        awaitable<void> *_resume;
+        time_point _tp;
+        _Ident _ident;
+    };
+
+    using rep = time_point::rep;
+    //worker is awake, it will process the inbox before it sleeps
+    static constexpr rep awake = std::numeric_limits<rep>::min();
+    //worker sleeps without timeout
+    static constexpr rep forever = std::numeric_limits<rep>::max();
+
+    struct shard {
+        //protects timers, held by worker except while it resumes a coroutine
+        std::mutex _mx;
+        std::condition_variable _cv;
+        Impl _timers;
+        //lock-free stack of new requests
+        std::atomic<request *> _inbox = {nullptr};
+        //time the worker sleeps to
+        std::atomic<rep> _wake_at = {awake};
+
+        void push(request *s) {
+            //s can be resolved by other thread once it is pushed
+            auto t = s->_tp.time_since_epoch().count();
+            s->_next = _inbox.load(std::memory_order_relaxed);
+            while (!_inbox.compare_exchange_weak(s->_next, s, std::memory_order_seq_cst));
+            //wake the worker only if it sleeps beyond the new timer
+            if (t < _wake_at.load(std::memory_order_seq_cst)) {
+                std::lock_guard _(_mx);
+                _cv.notify_one();
+            }
+        }
+
+        //move requests from the inbox to the timers, must be called under lock
+        void drain() {
+            request *s = _inbox.exchange(nullptr, std::memory_order_acquire);
+            request *lst = nullptr;
+            while (s) {
+                auto n = s->_next;
+                s->_next = lst;
+                lst = s;
+                s = n;
+            }
+            while (lst) {
+                auto n = lst->_next;
+                //request is destroyed with result object
+                auto tp = lst->_tp;
+                auto id = lst->_ident;
+                _timers.schedule_at(result_object(lst->_resume), tp, id);
+                lst = n;
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<shard> > _shards;
+    std::vector<std::thread> _threads;
+    std::atomic<bool> _running = {true};
+    std::atomic<unsigned int> _next = {0};
+
+    static inline thread_local const basic_mt_scheduler *_current_sched = nullptr;
+    static inline thread_local shard *_current_shard = nullptr;
+
+    shard &select(_Ident id) {
+        if (!id) {
+            if (_current_sched == this) return *_current_shard;
+            return *_shards[_next.fetch_add(1, std::memory_order_relaxed) % _shards.size()];
+        }
+        //pointers are aligned, mix the bits before selecting the shard
+        auto h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(id));
+        h = (h ^ (h >> 29)) * 0x9E3779B97F4A7C15ULL;
+        return *_shards[(h >> 32) % _shards.size()];
+    }
+
+    void worker_loop(unsigned int idx) {
+        shard &sh = *_shards[idx];
+        _current_sched = this;
+        _current_shard = &sh;
+        std::unique_lock lk(sh._mx);
+        while (_running.load(std::memory_order_acquire)) {
+            sh.drain();
+            auto tm = sh._timers.get_first_scheduled_time();
+            if (tm) {
+                auto now = std::chrono::system_clock::now();
+                if (now >= *tm) {
+                    MINICORO_TRACE::on_timer_fire(this, std::chrono::duration_cast<std::chrono::nanoseconds>(now - *tm));
+                    result_object r = sh._timers.remove_first();
+                    lk.unlock();
+                    r();
+                    lk.lock();
+                    continue;
+                }
+            }
+            sh._wake_at.store(tm ? tm->time_since_epoch().count() : forever, std::memory_order_seq_cst);
+            //recheck, producer could miss the new wake time
+            if (!sh._inbox.load(std::memory_order_seq_cst) && _running.load(std::memory_order_acquire)) {
+                if (tm) sh._cv.wait_until(lk, *tm); else sh._cv.wait(lk);
+            }
+            sh._wake_at.store(awake, std::memory_order_relaxed);
+        }
+        _current_sched = nullptr;
+        _current_shard = nullptr;
+    }
+};
+
+///multithreaded scheduler which uses binary heap in each worker
+using mt_scheduler = basic_mt_scheduler<>;
+
+///multithreaded scheduler which uses hierarchical timer wheel in each worker
+using mt_timer_wheel_scheduler = basic_mt_scheduler<timer_wheel<awaitable<void>::result, std::chrono::system_clock::time_point> >;
+
+}
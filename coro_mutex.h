@@ -1,6 +1,8 @@
 #pragma once
 #include "coroutine.h"
+#include "coro_cancel.h"
 #include <array>
+#include <mutex>
 
 namespace MINICORO_NAMESPACE {
 
@@ -118,6 +120,19 @@ public:
         };
     }
 
+    ///lock, cancelable
+    /**
+     * @param tkn stop token. When signaled, waiting coroutine is resumed immediately
+     * without ownership (no value). The request stays in the queue, ownership is released
+     * once it is granted
+     * @return awaitable
+     */
+    awaitable<ownership> lock(std::stop_token tkn) {
+        auto test = try_lock();
+        if (test) return test;
+        return with_cancel<ownership>(std::move(tkn), [this](const void *) {return lock();});
+    }
+
 
 protected:
     //item of linked list of the requests and queue
@@ -141,6 +156,8 @@ protected:
 
     //add slot to request stack
     prepared_coro add_request(slot *s) {
+        //slot can be resolved by other thread once it is added
+        MINICORO_TRACE::on_mutex_wait(this, s->_resume);
         //atomically add slot to _requests stack - linked list
         while (!_requests.compare_exchange_strong(s->_next, s));
         //this checks whether this slot was added as first
@@ -157,6 +174,7 @@ protected:
 
     //resume slot
     prepared_coro resume_slot(slot *s) {
+        MINICORO_TRACE::on_mutex_acquire(this, s->_resume);
         //convert pointer back to result
         awaitable<ownership>::result r(s->_resume);
         //set ownership to resume
@@ -200,24 +218,531 @@ protected:
 };
 
 
-///implements multiple coro_mutex locking
+///mutex which prefers throughput over fairness
 /**
- * @tpatam n count of mutexes. This value is subject of CTAG.
- * You can set this value higher than actuall mutex count, but you must ensure, that extra space is filled by nullptrs.
+ * The interface is the same as coro_mutex. The coro_mutex transfers ownership directly
+ * to the first waiting coroutine, so the mutex stays locked until the
+ * woken coroutine actually runs. This mutex is released by unlock() and the woken
+ * coroutine must try to lock it again. If other thread is faster, it takes the mutex
+ * (barging) and the woken coroutine is returned to the front of the queue.
+ * The lock() also spins for a while before the coroutine is queued.
+ *
+ * Use this mutex when the mutex is held for a short time and the contention is high. The
+ * order of waiting coroutines is not guaranteed, a coroutine can wait longer
+ * than with coro_mutex
+ *
+ * @code
+ * coro_barging_mutex mx;
+ * auto own = co_await mx.lock();
+ * @endcode
+ */
+class coro_barging_mutex {
+public:
+
+    ///default count of spin cycles before the coroutine is queued
+    static constexpr unsigned int default_spin_count = 100;
+
+    ///construct the mutex
+    /**
+     * @param spin_count count of attempts to lock the mutex in lock() before the coroutine
+     * is queued. Set zero to disable spinning
+     */
+    explicit coro_barging_mutex(unsigned int spin_count = default_spin_count):_spin_count(spin_count) {}
+    coro_barging_mutex(const coro_barging_mutex &) = delete;
+    coro_barging_mutex &operator=(const coro_barging_mutex &) = delete;
+
+    ///ownership object - carries ownership of the locked mutex
+    /**
+     * @see coro_mutex::ownership
+     */
+    class ownership {
+    public:
+        ///default construct not owned
+        ownership() = default;
+        ///you can move
+        ownership(ownership &&other):_owning(std::exchange(other._owning, nullptr)) {}
+        ///you can move by assignment
+        ownership &operator=(ownership &&other) {
+            if (this != &other) {
+                release();
+                _owning = std::exchange(other._owning, nullptr);
+            }
+            return *this;
+        }
+        ///release ownership prematurely
+        /**
+         * @return prepared coroutine which tries to lock the mutex (if any)
+         */
+        prepared_coro release() {
+            auto p = std::exchange(_owning, nullptr);
+            if (p) return p->unlock();
+            return {};
+        }
+        ///destructor releases ownership
+        ~ownership() {
+            release();
+        }
+        ///determine state
+        bool owns_lock() const {return _owning != nullptr;}
+        ///determine state
+        explicit operator bool() const {return _owning != nullptr;}
+    protected:
+        ownership(coro_barging_mutex *own):_owning(own) {}
+        coro_barging_mutex *_owning = nullptr;
+
+        friend class coro_barging_mutex;
+    };
+
+    ///try to lock without waiting
+    /**
+     * @return ownership object either owning lock, or not owning lock
+     */
+    ownership try_lock() {
+        if (!_locked.load(std::memory_order_relaxed)
+                && !_locked.exchange(true, std::memory_order_acquire)) return this;
+        return {};
+    }
+
+    ///lock the mutex
+    /**
+     * Spins for a while (see constructor), then returns pending awaitable. The
+     * coroutine is queued after co_await
+     *
+     * @return awaitable
+     */
+    awaitable<ownership> lock() {
+        for (unsigned int i = _spin_count; ; --i) {
+            auto test = try_lock();
+            if (test) return test;
+            if (!i) break;
+            cpu_relax();
+        }
+        return [this](awaitable<ownership>::result r) mutable {
+            auto s = awaitable<ownership>::get_temp_state<slot>(r);
+            if (!s) return prepared_coro{};
+            auto me = this;
+            std::construct_at(s);
+            s->_resume = r.release();
+            MINICORO_TRACE::on_mutex_wait(me, s->_resume);
+            return me->park(s, false);
+        };
+    }
+
+    ///lock, cancelable
+    /**
+     * @param tkn stop token
+     * @return awaitable
+     * @see coro_mutex::lock(std::stop_token)
+     */
+    awaitable<ownership> lock(std::stop_token tkn) {
+        auto test = try_lock();
+        if (test) return test;
+        return with_cancel<ownership>(std::move(tkn), [this](const void *) {return lock();});
+    }
+
+protected:
+
+    //waiting coroutine. When it is woken, it is resumed as frame and it tries to lock again
+    struct slot: coro_frame<slot> { // @suppress("Miss copy constructor or assignment operator")
+        union {
+            //next item in the queue (while queued)
+            slot *_next;
+            //mutex to lock (while woken)
+            coro_barging_mutex *_owner;
+        };
+        //pointer to awaitable to be resolved when ownership is retrieved
+        awaitable<ownership> *_resume;
+
+        prepared_coro do_resume() {
+            return _owner->retry(this);
+        }
+    };
+
+    //locked flag
+    std::atomic<bool> _locked = {false};
+    //count of queued coroutines
+    std::atomic<unsigned int> _waiting = {0};
+    //count of spin cycles
+    unsigned int _spin_count;
+    //protects the queue
+    std::mutex _mx;
+    //queue of waiting coroutines
+    slot *_first = nullptr;
+    slot *_last = nullptr;
+
+    //resolve the slot with ownership
+    prepared_coro grant(slot *s) {
+        MINICORO_TRACE::on_mutex_acquire(this, s->_resume);
+        awaitable<ownership>::result r(s->_resume);
+        return r(ownership(this));
+    }
+
+    //queue the slot, unless the mutex can be locked
+    prepared_coro park(slot *s, bool front) {
+        std::unique_lock lk(_mx);
+        //count must be visible before the flag is tested (see unlock())
+        _waiting.fetch_add(1, std::memory_order_seq_cst);
+        if (!_locked.exchange(true, std::memory_order_seq_cst)) {
+            _waiting.fetch_sub(1, std::memory_order_relaxed);
+            lk.unlock();
+            return grant(s);
+        }
+        if (front) {
+            s->_next = _first;
+            _first = s;
+            if (!_last) _last = s;
+        } else {
+            s->_next = nullptr;
+            if (_last) _last->_next = s; else _first = s;
+            _last = s;
+        }
+        return {};
+    }
+
+    //woken coroutine tries to lock the mutex, returns to the front of the queue on failure
+    prepared_coro retry(slot *s) {
+        if (!_locked.exchange(true, std::memory_order_acquire)) return grant(s);
+        return park(s, true);
+    }
+
+    //release the lock and wake one waiting coroutine
+    prepared_coro unlock() {
+        _locked.store(false, std::memory_order_seq_cst);
+        if (!_waiting.load(std::memory_order_seq_cst)) return {};
+        slot *s;
+        {
+            std::lock_guard _(_mx);
+            s = _first;
+            if (!s) return {};
+            _first = s->_next;
+            if (!_first) _last = nullptr;
+            _waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+        s->_owner = this;
+        return s->get_handle();
+    }
+};
+
+
+///implements reader-writer concurrency mutex
+/**
+ * The mutex can be locked exclusively (lock()) or shared (lock_shared()). Multiple
+ * readers can hold the mutex at the same time, writer holds the mutex alone.
+ *
+ * The mutex uses the same lock-free request stack as coro_mutex. The mutex prefers
+ * writers. Once a writer is waiting, new readers don't join the current group of
+ * readers, they are queued after the writer. When ownership is transfered to
+ * a reader, all readers queued in front of next writer are resumed together
+ * as one prepared_coro, which resumes them one by one.
+ *
+ * @code
+ * auto own = co_await mx.lock_shared();
+ * //read protected data
+ * own.release();
+ * @endcode
+ */
+class coro_shared_mutex {
+public:
+
+    coro_shared_mutex() = default;
+    coro_shared_mutex(const coro_shared_mutex &) = delete;
+    coro_shared_mutex &operator=(const coro_shared_mutex &) = delete;
+
+    ///ownership object - carries ownership of the locked mutex
+    /**
+     * @tparam shared true for shared ownership, false for exclusive ownership
+     */
+    template<bool shared>
+    class basic_ownership {
+    public:
+        ///default construct not owned
+        basic_ownership() = default;
+        ///you can move
+        basic_ownership(basic_ownership &&other):_owning(std::exchange(other._owning, nullptr)) {}
+        ///you can move by assignment
+        basic_ownership &operator=(basic_ownership &&other) {
+            if (this != &other) {
+                release();
+                _owning = std::exchange(other._owning, nullptr);
+            }
+            return *this;
+        }
+        ///release ownership prematurely
+        /**
+         * @return prepared coroutine which received ownership (if any). You can schedule its resumption
+         */
+        prepared_coro release() {
+            auto p = std::exchange(_owning, nullptr);
+            if (!p) return {};
+            if constexpr(shared) return p->unlock_shared();
+            else return p->unlock();
+        }
+        ///destructor releases ownership
+        ~basic_ownership() {
+            release();
+        }
+        ///determine state
+        bool owns_lock() const {return _owning != nullptr;}
+        ///determine state
+        explicit operator bool() const {return _owning != nullptr;}
+    protected:
+        basic_ownership(coro_shared_mutex *own):_owning(own) {}
+        coro_shared_mutex *_owning = nullptr;
+
+        friend class coro_shared_mutex;
+    };
+
+    ///exclusive ownership
+    using ownership = basic_ownership<false>;
+    ///shared ownership
+    using shared_ownership = basic_ownership<true>;
+
+    ///try to lock exclusively without waiting
+    /**
+     * @return ownership object either owning lock, or not owning lock.
+     */
+    ownership try_lock() {
+        slot *need = nullptr;
+        if (_requests.compare_exchange_strong(need, get_doorman())) return this;
+        else return {};
+    }
+
+    ///try to lock shared without waiting
+    /**
+     * Succeeds when the mutex is unlocked or it is held by readers and no writer is waiting
+     * @return shared ownership object either owning lock, or not owning lock.
+     */
+    shared_ownership try_lock_shared() {
+        //join current group of readers
+        auto n = _readers.load(std::memory_order_relaxed);
+        while (n > 0 && _writers.load(std::memory_order_relaxed) == 0) {
+            if (_readers.compare_exchange_weak(n, n+1, std::memory_order_acquire)) return this;
+        }
+        //try lock unlocked mutex
+        slot *need = nullptr;
+        if (_requests.compare_exchange_strong(need, get_doorman())) {
+            _readers.store(1, std::memory_order_relaxed);
+            return this;
+        }
+        return {};
+    }
+
+    ///lock exclusively
+    /**
+     * @return awaitable, co_await to obtain ownership
+     */
+    awaitable<ownership> lock() {
+        auto test = try_lock();
+        if (test) return test;
+        return [this](awaitable<ownership>::result r) mutable {
+            auto s = awaitable<ownership>::get_temp_state<slot>(r);
+            if (!s) return prepared_coro{};
+            auto me = this;
+            s->_next = nullptr;
+            s->_resume = r.release();
+            s->_shared = false;
+            //mark writer waiting - stops readers joining
+            me->_writers.fetch_add(1, std::memory_order_relaxed);
+            return me->add_request(s);
+        };
+    }
+
+    ///lock exclusively, cancelable
+    /**
+     * @param tkn stop token
+     * @return awaitable
+     * @see coro_mutex::lock(std::stop_token)
+     */
+    awaitable<ownership> lock(std::stop_token tkn) {
+        auto test = try_lock();
+        if (test) return test;
+        return with_cancel<ownership>(std::move(tkn), [this](const void *) {return lock();});
+    }
+
+    ///lock shared
+    /**
+     * @return awaitable, co_await to obtain shared ownership
+     */
+    awaitable<shared_ownership> lock_shared() {
+        auto test = try_lock_shared();
+        if (test) return test;
+        return [this](awaitable<shared_ownership>::result r) mutable {
+            //state could change before co_await, try again
+            auto test = try_lock_shared();
+            if (test) return r(std::move(test));
+            auto s = awaitable<shared_ownership>::get_temp_state<slot>(r);
+            if (!s) return prepared_coro{};
+            auto me = this;
+            s->_next = nullptr;
+            s->_resume = r.release();
+            s->_shared = true;
+            return me->add_request(s);
+        };
+    }
+
+    ///lock shared, cancelable
+    /**
+     * @param tkn stop token
+     * @return awaitable
+     * @see coro_mutex::lock(std::stop_token)
+     */
+    awaitable<shared_ownership> lock_shared(std::stop_token tkn) {
+        auto test = try_lock_shared();
+        if (test) return test;
+        return with_cancel<shared_ownership>(std::move(tkn), [this](const void *) {return lock_shared();});
+    }
+
+protected:
+
+    //item of linked list of the requests and queue
+    struct slot {
+        //next item in linked list
+        slot *_next;
+        //pointer to awaitable<ownership> or awaitable<shared_ownership>
+        void *_resume;
+        //true, if shared ownership is requested
+        bool _shared;
+    };
+
+    //frame which resumes a list of readers
+    class reader_chain: public coro_frame<reader_chain> {
+    public:
+        reader_chain(coro_shared_mutex *owner):_owner(owner) {}
+        slot *_list = nullptr;
+    protected:
+        coro_shared_mutex *_owner;
+        friend class coro_frame<reader_chain>;
+        void do_resume() {
+            slot *s = std::exchange(_list, nullptr);
+            while (s) {
+                //slot is destroyed by resumption, read next first
+                auto n = s->_next;
+                _owner->resume_slot(s).resume();
+                s = n;
+            }
+        }
+    };
+
+    constexpr static slot doorman = {};
+
+    //stack of requests - added between unlocks
+    std::atomic<slot *> _requests = {};
+    //count of readers holding the lock
+    std::atomic<unsigned int> _readers = {0};
+    //count of waiting writers
+    std::atomic<unsigned int> _writers = {0};
+    //queue of requests - processed during unlocks
+    slot *_queue = {};
+    //frame used to resume group of readers
+    reader_chain _chain = {this};
+
+    //retrieve pointer to doorman
+    slot *get_doorman() {return const_cast<slot *>(&doorman);}
+
+    //add slot to request stack
+    prepared_coro add_request(slot *s) {
+        MINICORO_TRACE::on_mutex_wait(this, s->_resume);
+        while (!_requests.compare_exchange_strong(s->_next, s));
+        if (s->_next == nullptr) {
+            //lock acquired
+            make_queue(_requests.exchange(get_doorman()), s);
+            return grant(s);
+        }
+        return {};
+    }
+
+    //resume slot
+    prepared_coro resume_slot(slot *s) {
+        MINICORO_TRACE::on_mutex_acquire(this, s->_resume);
+        if (s->_shared) {
+            awaitable<shared_ownership>::result r(reinterpret_cast<awaitable<shared_ownership> *>(s->_resume));
+            return r(shared_ownership(this));
+        } else {
+            awaitable<ownership>::result r(reinterpret_cast<awaitable<ownership> *>(s->_resume));
+            return r(ownership(this));
+        }
+    }
+
+    //converts stack oriented linked list to queue
+    void make_queue(slot *from, slot *to) {
+        while (from != to) {
+            auto n = from->_next;
+            from->_next = _queue;
+            _queue = from;
+            from = n;
+        }
+    }
+
+    //transfer ownership to the slot removed from the queue
+    prepared_coro grant(slot *f) {
+        if (!f->_shared) {
+            _writers.fetch_sub(1, std::memory_order_relaxed);
+            return resume_slot(f);
+        }
+        //collect all readers in front of next writer
+        unsigned int cnt = 1;
+        slot *last = f;
+        while (_queue && _queue->_shared) {
+            last->_next = _queue;
+            last = _queue;
+            _queue = _queue->_next;
+            ++cnt;
+        }
+        last->_next = nullptr;
+        //count must be set before any reader is resumed
+        _readers.store(cnt, std::memory_order_release);
+        if (cnt == 1) return resume_slot(f);
+        _chain._list = f;
+        return _chain.get_handle();
+    }
+
+    //unlock and transfer ownership
+    prepared_coro unlock() {
+        if (!_queue) {
+            slot *d = get_doorman();
+            slot *need = d;
+            if (_requests.compare_exchange_strong(need, nullptr)) {
+                return {};
+            }
+            make_queue(_requests.exchange(d), d);
+        }
+        auto f = _queue;
+        _queue = f->_next;
+        return grant(f);
+    }
+
+    //release shared ownership, the last reader unlocks the mutex
+    prepared_coro unlock_shared() {
+        //readers can join only while count is above zero
+        if (_readers.fetch_sub(1, std::memory_order_acq_rel) > 1) return {};
+        return unlock();
+    }
+
+};
+
+///implements multiple mutex locking
+/**
+ * @tparam n count of mutexes
+ * @tparam Mutex type of mutex
+ * @tparam Ownership type of ownership
+ * @tparam try_lock_fn pointer to member function which tries to lock the mutex
+ * @tparam lock_fn pointer to member function which locks the mutex
+ *
+ * You can set count higher than actuall mutex count, but you must ensure, that extra space is filled by nullptrs.
  * (with exception, the first pointer must not be nullptr)
  */
-template<int n>
-class multi_lock {
+template<int n, typename Mutex, typename Ownership, Ownership (Mutex::*try_lock_fn)(), awaitable<Ownership> (Mutex::*lock_fn)()>
+class basic_multi_lock {
 public:
 
     ///ownership of multiple mutexes
-    using ownership = std::array<coro_mutex::ownership, n>;
+    using ownership = std::array<Ownership, n>;
 
     ///initialize class with list of mutexes
     /**
      * @param list array of pointers to existing mutexes. Expect the first pointer, others can be set to nullptr
      */
-    multi_lock(coro_mutex *(&list)[n]) {
+    basic_multi_lock(Mutex *(&list)[n]) {
         int p = 0;
         for (auto &x:locking) x = list[p++];
     }
@@ -234,10 +759,12 @@ public:
      *
      */
     awaitable<void> lock() {
+        first = 0;
         //try lock first
-        auto o = locking[0]->try_lock();
+        auto o = (locking[0]->*try_lock_fn)();
         //if success
         if (o) {
+            owns[0] = std::move(o);
             //try lock others
             int x = lock_others();
             //if success (all locked);
@@ -270,7 +797,7 @@ public:
 
 protected:
 
-    prepared_coro lock_complete(awaitable<coro_mutex::ownership> &awt) {
+    prepared_coro lock_complete(awaitable<Ownership> &awt) {
         //when lock is complete, remeber ownership
         owns[first] = awt.await_resume();
         //attempt to lock others
@@ -286,11 +813,9 @@ protected:
         return r();
     }
 
-
-
     prepared_coro lock_first() {
         //initiate lock - call the callback when done - use cb_buffer to store callback's internals
-        return _cb_completion.await(locking[first]->lock(),this);
+        return _cb_completion.await((locking[first]->*lock_fn)(),this);
     }
 
     int lock_others() {
@@ -301,13 +826,14 @@ protected:
             //if not null
             if (locking[idx]) {
                 //try to lock
-                auto o = locking[idx]->try_lock();
+                auto o = (locking[idx]->*try_lock_fn)();
                 if (!o) {
                     //if failed, release all ownerships
                     for (auto &x: owns) x.release();
                     //return failed index
-                    return i;
+                    return idx;
                 }
+                owns[idx] = std::move(o);
             }
         }
         //return max as no failure
@@ -316,19 +842,44 @@ protected:
     }
 
     //list of mutexes
-    coro_mutex *locking[n] = {};
+    Mutex *locking[n] = {};
     //list of ownership
-    coro_mutex::ownership owns[n] = {};
+    Ownership owns[n] = {};
     //result
     awaitable<void>::result r = {};
     ///callback internals
-    await_member_callback<coro_mutex::ownership, multi_lock *,  &multi_lock::lock_complete> _cb_completion;
+    await_member_callback<Ownership, basic_multi_lock *,  &basic_multi_lock::lock_complete> _cb_completion;
     //first mutex to lock asynchronously
     int first = 0;
 };
 
+///implements multiple coro_mutex locking
+/**
+ * @tpatam n count of mutexes. This value is subject of CTAG.
+ */
+template<int n>
+class multi_lock: public basic_multi_lock<n, coro_mutex, coro_mutex::ownership, &coro_mutex::try_lock, &coro_mutex::lock> {
+public:
+    using basic_multi_lock<n, coro_mutex, coro_mutex::ownership, &coro_mutex::try_lock, &coro_mutex::lock>::basic_multi_lock;
+};
+
+///implements multiple coro_shared_mutex locking in shared mode
+/**
+ * @tpatam n count of mutexes. This value is subject of CTAG.
+ */
+template<int n>
+class multi_lock_shared: public basic_multi_lock<n, coro_shared_mutex, coro_shared_mutex::shared_ownership,
+                                    &coro_shared_mutex::try_lock_shared, &coro_shared_mutex::lock_shared> {
+public:
+    using basic_multi_lock<n, coro_shared_mutex, coro_shared_mutex::shared_ownership,
+            &coro_shared_mutex::try_lock_shared, &coro_shared_mutex::lock_shared>::basic_multi_lock;
+};
+
 
 template<int n>
 multi_lock(coro_mutex *(&list)[n]) -> multi_lock<n>;
 
+template<int n>
+multi_lock_shared(coro_shared_mutex *(&list)[n]) -> multi_lock_shared<n>;
+
 }
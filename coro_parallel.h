@@ -0,0 +1,181 @@
+#pragma once
+
+#include "coroutine.h"
+#include "coro_executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <ranges>
+#include <thread>
+#include <vector>
+
+namespace MINICORO_NAMESPACE {
+
+namespace _details {
+
+//distributes chunks of the range to the workers (guided self-scheduling)
+class parallel_state {
+public:
+    parallel_state(std::size_t count, std::size_t chunk_size, std::size_t workers)
+        :_count(count), _chunk(std::max<std::size_t>(chunk_size, 1)), _workers(workers) {}
+
+    //retrieve next chunk, returns empty range when there is no more work
+    std::pair<std::size_t, std::size_t> grab() {
+        auto pos = _next.load(std::memory_order_relaxed);
+        while (pos < _count && !_aborted.load(std::memory_order_relaxed)) {
+            auto remain = _count - pos;
+            //large chunks at the beginning, small chunks at the end to balance the load
+            auto cnt = std::min(remain, std::max(_chunk, remain / (2 * _workers)));
+            if (_next.compare_exchange_weak(pos, pos + cnt, std::memory_order_relaxed)) {
+                return {pos, pos + cnt};
+            }
+        }
+        return {_count, _count};
+    }
+
+    //stop distribution of the chunks (after exception)
+    void abort() {
+        _aborted.store(true, std::memory_order_relaxed);
+    }
+
+protected:
+    std::size_t _count;
+    std::size_t _chunk;
+    std::size_t _workers;
+    std::atomic<std::size_t> _next = {0};
+    std::atomic<bool> _aborted = {false};
+};
+
+//moves the coroutine to the executor, always suspends
+template<is_executor E>
+struct post_awaiter {
+    E *_exec;
+    static constexpr bool await_ready() noexcept {return false;}
+    void await_suspend(std::coroutine_handle<> h) {_exec->post(h);}
+    static constexpr void await_resume() noexcept {}
+};
+
+template<is_executor E>
+std::size_t parallel_workers(E &exec, std::size_t count, std::size_t chunk_size) {
+    std::size_t threads;
+    if constexpr(requires {exec.size();}) {
+        threads = exec.size();
+    } else {
+        threads = std::thread::hardware_concurrency();
+    }
+    auto chunks = (count + chunk_size - 1) / chunk_size;
+    return std::max<std::size_t>(1, std::min<std::size_t>(threads, chunks));
+}
+
+template<is_executor E, typename Iter, typename Fn>
+awaitable<void> parallel_for_worker(E &exec, parallel_state &st, Iter beg, Fn &fn) {
+    co_await post_awaiter<E>{&exec};
+    try {
+        for (auto [b, e] = st.grab(); b < e; std::tie(b, e) = st.grab()) {
+            for (auto i = b; i < e; ++i) fn(beg[i]);
+        }
+    } catch (...) {
+        st.abort();
+        throw;
+    }
+}
+
+template<typename T, is_executor E, typename Iter, typename Reduce, typename Transform>
+awaitable<std::optional<T> > parallel_reduce_worker(E &exec, parallel_state &st, Iter beg, Reduce &reduce, Transform &transform) {
+    co_await post_awaiter<E>{&exec};
+    std::optional<T> acc;
+    try {
+        for (auto [b, e] = st.grab(); b < e; std::tie(b, e) = st.grab()) {
+            auto i = b;
+            if (!acc) acc.emplace(transform(beg[i++]));
+            for (; i < e; ++i) *acc = reduce(std::move(*acc), transform(beg[i]));
+        }
+    } catch (...) {
+        st.abort();
+        throw;
+    }
+    co_return acc;
+}
+
+}
+
+///process all items of the range in parallel
+/**
+ * The function starts one coroutine per worker of the executor (but no more than
+ * count of chunks). Workers take chunks of the range from a shared counter, large
+ * chunks at the beginning and smaller near the end, so faster workers take more
+ * work. The awaiting coroutine is resumed when all workers are finished.
+ *
+ * @param exec executor (for example coro_thread_pool). If it has function size(), it
+ * is used as count of workers, otherwise hardware concurrency is used
+ * @param range random access range, must stay valid until the operation is complete
+ * @param chunk_size minimal count of items processed at once
+ * @param fn function called for each item (receives reference to the item). The function
+ * is called concurrently
+ * @return awaitable, which is resolved when all items are processed. If the
+ * function throws an exception, remaining chunks are skipped and the exception is
+ * rethrown
+ *
+ * @code
+ * co_await parallel_for(pool, data, 4096, [](Item &x){x.score = score(x);});
+ * @endcode
+ */
+template<is_executor E, std::ranges::random_access_range R, typename Fn>
+requires(std::ranges::sized_range<R> && std::invocable<Fn &, std::ranges::range_reference_t<R> >)
+awaitable<void> parallel_for(E &exec, R &&range, std::size_t chunk_size, Fn fn) {
+    std::size_t count = std::ranges::size(range);
+    if (!count) co_return;
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    auto workers = _details::parallel_workers(exec, count, chunk_size);
+    _details::parallel_state st(count, chunk_size, workers);
+    auto beg = std::ranges::begin(range);
+    std::vector<awaitable<void> > tasks(workers);
+    co_await when_all(std::span(tasks), [&](std::size_t) {
+        return _details::parallel_for_worker(exec, st, beg, fn);
+    });
+    for (auto &t: tasks) t.await_resume();
+}
+
+///transform items of the range and reduce the results in parallel
+/**
+ * Workers are organized as in parallel_for(). Each worker reduces own chunks, partial
+ * results are reduced with the initial value in the awaiting coroutine in order of the
+ * workers.
+ *
+ * @param exec executor
+ * @param range random access range, must stay valid until the operation is complete
+ * @param chunk_size minimal count of items processed at once
+ * @param init initial value
+ * @param reduce associative function, which combines two values
+ * @param transform function which transforms an item to a value
+ * @return awaitable with the result
+ *
+ * @code
+ * double total = co_await parallel_transform_reduce(pool, data, 4096, 0.0,
+ *          std::plus<>(), [](const Item &x){return score(x);});
+ * @endcode
+ */
+template<is_executor E, std::ranges::random_access_range R, typename T, typename Reduce, typename Transform>
+requires(std::ranges::sized_range<R>
+        && std::invocable<Transform &, std::ranges::range_reference_t<R> >
+        && std::is_convertible_v<std::invoke_result_t<Reduce &, T, std::invoke_result_t<Transform &, std::ranges::range_reference_t<R> > >, T>)
+awaitable<T> parallel_transform_reduce(E &exec, R &&range, std::size_t chunk_size, T init, Reduce reduce, Transform transform) {
+    std::size_t count = std::ranges::size(range);
+    if (!count) co_return init;
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    auto workers = _details::parallel_workers(exec, count, chunk_size);
+    _details::parallel_state st(count, chunk_size, workers);
+    auto beg = std::ranges::begin(range);
+    std::vector<awaitable<std::optional<T> > > tasks(workers);
+    co_await when_all(std::span(tasks), [&](std::size_t) {
+        return _details::parallel_reduce_worker<T>(exec, st, beg, reduce, transform);
+    });
+    for (auto &t: tasks) {
+        std::optional<T> part = t.await_resume();
+        if (part) init = reduce(std::move(init), std::move(*part));
+    }
+    co_return init;
+}
+
+}
@@ -1,10 +1,18 @@
 #pragma once
 
 #include "coroutine.h"
+#include "coro_cancel.h"
+#include <atomic>
+#include <array>
 #include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
 
 namespace MINICORO_NAMESPACE {
 
+template<typename Queue, std::size_t N> class queue_select;
+
 ///limited queue - helper class for coro_basic_queue
 /**
  * @tparam T type of item in queue
@@ -17,6 +25,13 @@ public:
 
     using value_type = T;
 
+    limited_queue() = default;
+    limited_queue(const limited_queue &) = delete;
+    limited_queue &operator=(const limited_queue &) = delete;
+    ~limited_queue() {
+        while (!is_empty()) pop();
+    }
+
     ///determine whether queue is full
     constexpr bool is_full() const {
         return _front - _back >= count;
@@ -27,6 +42,11 @@ public:
         return _front - _back == 0;
     }
 
+    ///retrieve count of items in queue
+    constexpr unsigned int size() const {
+        return _front - _back;
+    }
+
     ///push item
     /**
      * @param args arguments to construct item
@@ -36,7 +56,7 @@ public:
      */
     template<typename ... Args>
     constexpr void push(Args && ... args) {
-        item &x = _items[_front % count];
+        item &x = _items[index(_front)];
         std::construct_at(&x.val, std::forward<Args>(args)...);
         ++_front;
     }
@@ -48,7 +68,7 @@ public:
      * @note it doesn't check for emptyness, use is_empty() before calling of this function
      */
     constexpr T pop() {
-        item &x = _items[_back % count];
+        item &x = _items[index(_back)];
         T r = std::move(x.val);
         std::destroy_at(&x.val);
         ++_back;
@@ -59,7 +79,9 @@ public:
 protected:
 
     struct item {
-        T val;
+        union {
+            T val;
+        };
         item() {}
         ~item() {}
     };
@@ -67,14 +89,260 @@ protected:
     item _items[count];
     unsigned int _front = 0;
     unsigned int _back = 0;
+
+    static constexpr unsigned int index(unsigned int pos) {
+        if constexpr((count & (count - 1)) == 0) {
+            return pos & (count - 1);
+        } else {
+            return pos % count;
+        }
+    }
+};
+
+///unbounded queue - helper class for coro_basic_queue
+/**
+ * Items are stored in segments linked to a list. The queue grows by
+ * adding segments, items are never moved or reallocated. Emptied segments are kept
+ * for reuse, so once the queue reaches its working depth, it doesn't allocate. The
+ * memory is released when the queue is destroyed
+ *
+ * @tparam T type of item in queue
+ * @tparam segment_size count of items in one segment, must be power of two
+ */
+template<typename T, unsigned int segment_size = 64>
+class segmented_queue {
+public:
+
+    static_assert(segment_size > 0 && (segment_size & (segment_size - 1)) == 0, "segment_size must be power of two");
+
+    using value_type = T;
+
+    segmented_queue() = default;
+    segmented_queue(const segmented_queue &) = delete;
+    segmented_queue &operator=(const segmented_queue &) = delete;
+    ~segmented_queue() {
+        while (!is_empty()) pop();
+        delete _head;
+        while (_spare) delete std::exchange(_spare, _spare->next);
+    }
+
+    ///queue is never full
+    constexpr bool is_full() const {
+        return false;
+    }
+
+    ///determine whether queue is empty
+    constexpr bool is_empty() const {
+        return _size == 0;
+    }
+
+    ///retrieve count of items in queue
+    constexpr std::size_t size() const {
+        return _size;
+    }
+
+    ///push item
+    /**
+     * @param args arguments to construct item
+     */
+    template<typename ... Args>
+    void push(Args && ... args) {
+        if (!_tail) {
+            _head = _tail = alloc_segment();
+        } else if (_front == segment_size) {
+            auto sg = alloc_segment();
+            _tail->next = sg;
+            _tail = sg;
+            _front = 0;
+        }
+        std::construct_at(&_tail->items[_front].val, std::forward<Args>(args)...);
+        ++_front;
+        ++_size;
+    }
+
+    ///pop item
+    /**
+     * @return item removed from queue
+     *
+     * @note it doesn't check for emptyness, use is_empty() before calling of this function
+     */
+    T pop() {
+        if (_back == segment_size) {
+            auto sg = _head;
+            _head = sg->next;
+            _back = 0;
+            free_segment(sg);
+        }
+        item &x = _head->items[_back];
+        T r = std::move(x.val);
+        std::destroy_at(&x.val);
+        ++_back;
+        if (--_size == 0) {
+            //queue is empty, start again at the beginning of the segment
+            _front = _back = 0;
+        }
+        return r;
+    }
+
+protected:
+
+    struct item {
+        union {
+            T val;
+        };
+        item() {}
+        ~item() {}
+    };
+
+    struct segment {
+        segment *next = nullptr;
+        item items[segment_size];
+    };
+
+    //segment being read
+    segment *_head = nullptr;
+    //segment being written
+    segment *_tail = nullptr;
+    //list of free segments
+    segment *_spare = nullptr;
+    //write position in tail segment
+    unsigned int _front = 0;
+    //read position in head segment
+    unsigned int _back = 0;
+    std::size_t _size = 0;
+
+    segment *alloc_segment() {
+        if (_spare) {
+            auto sg = std::exchange(_spare, _spare->next);
+            sg->next = nullptr;
+            return sg;
+        }
+        return new segment;
+    }
+
+    void free_segment(segment *sg) {
+        sg->next = _spare;
+        _spare = sg;
+    }
+};
+
+///bounded lock-free multi-producer multi-consumer queue - helper class for coro_basic_queue
+/**
+ * Ring buffer with per-slot sequence numbers. When this implementation is
+ * used, the coro_basic_queue pushes and pops items without locking, the lock is
+ * used only to park suspended producers and consumers.
+ *
+ * @tparam T type of item in queue, must be nothrow move constructible
+ * @tparam count max count of items in queue, must be power of two
+ */
+template<typename T, unsigned int count>
+class mpmc_queue {
+public:
+
+    static_assert(count > 0 && (count & (count - 1)) == 0, "count must be power of two");
+    static_assert(std::is_nothrow_move_constructible_v<T>, "T must be nothrow move constructible");
+
+    using value_type = T;
+
+    mpmc_queue() {
+        for (unsigned int i = 0; i < count; ++i) _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+    ~mpmc_queue() {
+        while (try_pop());
+    }
+
+    ///try to push item
+    /**
+     * @param val item to push. The item is moved only if the push is successful
+     * @retval true pushed
+     * @retval false queue is full
+     */
+    bool try_push(T &&val) {
+        cell *c;
+        auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            c = &_cells[pos & mask];
+            auto seq = c->seq.load(std::memory_order_acquire);
+            auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (dif == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        std::construct_at(&c->val, std::move(val));
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///try to pop item
+    /**
+     * @return popped item, or empty if the queue is empty
+     */
+    std::optional<T> try_pop() {
+        cell *c;
+        auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            c = &_cells[pos & mask];
+            auto seq = c->seq.load(std::memory_order_acquire);
+            auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (dif == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return {};
+            } else {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        std::optional<T> out(std::move(c->val));
+        std::destroy_at(&c->val);
+        c->seq.store(pos + count, std::memory_order_release);
+        return out;
+    }
+
+    ///retrieve count of items (approximate when the queue is accessed concurrently)
+    std::size_t size() const {
+        auto b = _dequeue_pos.load(std::memory_order_relaxed);
+        auto f = _enqueue_pos.load(std::memory_order_relaxed);
+        return f > b ? f - b : 0;
+    }
+
+protected:
+
+    struct cell {
+        std::atomic<std::size_t> seq;
+        union {
+            T val;
+        };
+        cell() {}
+        ~cell() {}
+    };
+
+    static constexpr std::size_t mask = count - 1;
+
+    cell _cells[count];
+    alignas(64) std::atomic<std::size_t> _enqueue_pos = {0};
+    alignas(64) std::atomic<std::size_t> _dequeue_pos = {0};
 };
 
+///queue implementation which can be accessed without locking
+template<typename T>
+concept lockfree_queue_impl = requires(T q, typename T::value_type &&v) {
+    {q.try_push(std::move(v))} -> std::same_as<bool>;
+    {q.try_pop()} -> std::same_as<std::optional<typename T::value_type> >;
+};
 
 
 ///basic coroutine queue
 /**
  *
- * @tparam Queue_Impl implementation of the queue = example limited_queue
+ * @tparam Queue_Impl implementation of the queue = example limited_queue. If
+ * the implementation is lockfree_queue_impl (for example mpmc_queue), push and
+ * pop are processed without locking unless they need to suspend
  * @tparam Lock object to lock internals
  */
 template<typename Queue_Impl, basic_lockable Lock = empty_lockable>
@@ -83,6 +351,10 @@ public:
 
     using value_type = typename Queue_Impl::value_type;
 
+    coro_basic_queue() = default;
+    coro_basic_queue(const coro_basic_queue &) = delete;
+    coro_basic_queue &operator=(const coro_basic_queue &) = delete;
+
     ///Push to queue
     /**
      * @param args arguments to construct item
@@ -96,29 +368,29 @@ public:
      * is_ready()
      *
      */
-    template<std::convertible_to<value_type> ... Args >
+    template<typename ... Args >
+    requires(std::is_constructible_v<value_type, Args...>)
     awaitable<void> push(Args && ... args) {
-        prepared_coro resm;
-        std::lock_guard _(_mx);
-        if (_queue.is_full()) {
-            return [this](awaitable<void>::result r) mutable {
-                auto _this = this;
-                using Slot = slot<typename awaitable<val_and_result>::result>;
-                auto s = awaitable<void>::template get_temp_state<Slot>(r);
-                std::construct_at(&s);
-                if (!r) return;
-                s.payload.res =std::move(r);
-                _this->_push_queue.push(&s);;
-            };
-        } else if (_queue.is_empty()) {
-            auto slot = _pop_queue.pop();
-            if (slot) {
-                resm = slot->payload(std::forward<Args>(args)...);
-            } else {
-                _queue.push(std::forward<Args>(args)...);
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            value_type v(std::forward<Args>(args)...);
+            if (_queue.try_push(std::move(v))) {
+                after_push();
+                return {};
             }
+            return park_push(std::move(v));
         } else {
-            _queue.push(std::forward<Args>(args)...);
+            prepared_coro resm;
+            lock_guard _(_mx);
+            auto s = _pop_queue.pop();
+            if (s) {
+                resm = deliver(s, std::forward<Args>(args)...);
+                return {};
+            }
+            if (!_queue.is_full()) {
+                _queue.push(std::forward<Args>(args)...);
+                return {};
+            }
+            return park_push(value_type(std::forward<Args>(args)...));
         }
     }
 
@@ -128,27 +400,144 @@ public:
      * need co_await on result.
      */
     awaitable<value_type> pop() {
-        prepared_coro resm;
-        std::lock_guard _(_mx);
-        if (_queue.is_empty()) {
-            return [this](typename awaitable<value_type>::result r) mutable {
-                auto _this = this;
-                using Slot = slot<typename awaitable<value_type>::result>;
-                auto s = awaitable<value_type>::template get_temp_state<Slot>(r);
-                std::construct_at(&s);
-             if (!r) return;
-             if (_this->_closed) {
-                 r =  _this->_closed;
-                 return;
-             }
-             s.payload = std::move(r);
-             _this->_pop_queue.push(&s);
-            };
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            auto v = _queue.try_pop();
+            if (v) {
+                after_pop();
+                return awaitable<value_type>(std::in_place, std::move(*v));
+            }
+        } else {
+            prepared_coro resm;
+            lock_guard _(_mx);
+            if (!_queue.is_empty()) {
+                awaitable<value_type> out(std::in_place, _queue.pop());
+                resm = refill();
+                return out;
+            }
+        }
+        return [this](typename awaitable<value_type>::result r) mutable -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            return me->pop_slow(std::move(r));
+        };
+    }
+
+    ///pop from queue, cancelable
+    /**
+     * @param tkn stop token. When signaled, the waiting consumer is removed from
+     * the queue and the awaitable is resolved with no value. No item is lost.
+     * @return awaitable
+     */
+    awaitable<value_type> pop(std::stop_token tkn) {
+        auto awt = pop();
+        if (awt.is_ready()) return awt;
+        return with_cancel<value_type>(std::move(tkn), [this](const void *) {
+            return pop();
+        }, [this](const void *, awaitable<value_type> &inner) {
+            return cancel_pop(inner);
+        });
+    }
+
+
+    ///push multiple items to the queue
+    /**
+     * Pushes as many items as possible without blocking. All items are
+     * pushed under single lock and all resumed consumers are resumed
+     * after the lock is released
+     *
+     * @param beg iterator to first item
+     * @param end iterator after last item
+     * @return iterator to first item which has not been pushed (equal to end
+     * if all items has been pushed)
+     */
+    template<std::input_iterator Iter>
+    requires(std::is_constructible_v<value_type, std::iter_reference_t<Iter> >)
+    Iter push_range(Iter beg, Iter end) {
+        resume_list resm;
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            bool any = false;
+            while (beg != end) {
+                value_type v(*beg);
+                if (!_queue.try_push(std::move(v))) break;
+                any = true;
+                ++beg;
+            }
+            if (any) wake_batch(resm);
+        } else {
+            lock_guard _(_mx);
+            while (beg != end) {
+                auto s = _pop_queue.pop();
+                if (s) {
+                    resm.push(deliver(s, *beg));
+                } else if (!_queue.is_full()) {
+                    _queue.push(*beg);
+                } else {
+                    break;
+                }
+                ++beg;
+            }
+        }
+        return beg;
+    }
+
+    ///pop multiple items from the queue
+    /**
+     * Pops as many items as available without blocking. All items are
+     * removed under single lock, stuck producers are resumed after the lock
+     * is released
+     *
+     * @param out output buffer. Its size is maximum count of items to pop
+     * @return count of items stored to the buffer
+     */
+    std::size_t pop_many(std::span<value_type> out) {
+        resume_list resm;
+        std::size_t n = 0;
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            while (n < out.size()) {
+                auto v = _queue.try_pop();
+                if (!v) break;
+                out[n++] = std::move(*v);
+            }
+            if (n) wake_batch(resm);
         } else {
-            return pop2(resm);
+            lock_guard _(_mx);
+            while (n < out.size() && !_queue.is_empty()) {
+                out[n++] = _queue.pop();
+                resm.push(refill());
+            }
         }
+        return n;
     }
 
+    ///pop multiple items, wait for at least one item
+    /**
+     * @param out output buffer. Its size is maximum count of items to pop
+     * @return awaitable containing count of items stored to the buffer. If
+     * the queue is empty, the operation waits for the first item and then
+     * retrieves all items available at that time
+     *
+     * @note buffer must remain valid until the operation is complete
+     */
+    awaitable<std::size_t> pop_batch(std::span<value_type> out) {
+        if (out.empty()) return std::size_t(0);
+        auto n = pop_many(out);
+        if (n) return n;
+        return pop_batch_slow(out);
+    }
+
+    ///retrieve count of items in the queue
+    /**
+     * @return count of items. For lockfree implementation, the value is approximate
+     * when the queue is accessed concurrently
+     */
+    std::size_t size() const {
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            return _queue.size();
+        } else {
+            lock_guard _(_mx);
+            return _queue.size();
+        }
+    }
 
     ///clear whole queue. The function also resumes all stuck producers
     void clear() {
@@ -166,19 +555,37 @@ public:
      * same exception
      */
     void set_closed(std::exception_ptr e) {
-        slot<typename awaitable<value_type>::result> *slots;
+        resume_list lst;
+        set_closed(std::move(e), lst);
+    }
+
+    ///close queue / set exception
+    /**
+     * @param e exception, or empty to open the queue
+     * @param lst list which receives pending consumers resolved with the exception,
+     * they are resumed by lst.resume_all()
+     */
+    void set_closed(std::exception_ptr e, resume_list &lst) {
+        pop_slot *slots;
         {
-            std::lock_guard _(_mx);
-            _closed = std::move(e);
+            lock_guard _(_mx);
+            _closed = e;
             if (!e) return;
-
             slots = _pop_queue.first;
-            _pop_queue.first = _pop_queue.last;
-        }
-        while (slots) {
-            auto s = slots;
-            slots = s->next;
-            s->payload = _closed;
+            if constexpr(lockfree_queue_impl<Queue_Impl>) {
+                unsigned int cnt = 0;
+                for (auto s = slots; s; s = s->next) ++cnt;
+                _pop_waiting.fetch_sub(cnt, std::memory_order_relaxed);
+            }
+            _pop_queue.first = _pop_queue.last = nullptr;
+            //consumers are resolved under the lock (see cancel_pop()), resumed later
+            while (slots) {
+                auto s = slots;
+                slots = s->next;
+                auto r = std::move(s->r);
+                std::destroy_at(s);
+                lst.push(r = e);
+            }
         }
     }
 
@@ -186,40 +593,35 @@ public:
 
 protected:
 
-    template<typename _Payload>
-    struct slot {
-        _Payload payload = {};
-        slot *next = nullptr;
+    template<typename, std::size_t> friend class queue_select;
 
-        slot(_Payload p):payload(p) {}
+    //parked consumer, located in temporary state of its awaitable
+    struct pop_slot {
+        pop_slot *next = nullptr;
+        pop_slot *prev = nullptr;
+        typename awaitable<value_type>::result r = {};
     };
 
-    
-
-    struct val_and_result {
+    //parked producer, located in temporary state if it fits, otherwise allocated
+    struct push_slot {
+        push_slot *next = nullptr;
+        awaitable<void>::result r = {};
         value_type val;
-        awaitable<void>::result res = {};
+        bool allocated = false;
 
-        template<std::convertible_to<value_type> ... Args >
-        val_and_result(Args && ... args):val(std::forward<Args>(args)...) {}
+        push_slot(value_type &&v):val(std::move(v)) {}
     };
 
-    awaitable<value_type> pop2(prepared_coro &resm) {
-        awaitable<value_type> r ( _queue.pop());
-        slot<val_and_result> *s = _push_queue.pop();
-        if (s) {
-            _queue.push(std::move(s->payload.val));
-            resm = s->payload.res();
-        }
-        return r;
-    }
-
+    //list of parked slots, it is doubly linked when X has the prev link
     template<typename X>
     struct link_list_queue {
-        slot<X> *first = {};
-        slot<X> *last = {};
+        X *first = {};
+        X *last = {};
+
+        static constexpr bool linked_back = requires(X x) {x.prev;};
 
-        void push(slot<X> *s) {
+        void push(X *s) {
+            if constexpr(linked_back) s->prev = last;
             if (last) {
                 last->next = s;
                 last = s;
@@ -228,29 +630,535 @@ protected:
             }
         }
 
-        slot<X> *pop() {
+        X *pop() {
             auto r = first;
             if (r == last) {
                 last = first = nullptr;
             } else {
                 first = first->next;
+                if constexpr(linked_back) first->prev = nullptr;
             }
             return r;
         }
 
+        //remove the item from any position
+        void erase(X *s) requires(linked_back) {
+            if (s->prev) s->prev->next = s->next; else first = s->next;
+            if (s->next) s->next->prev = s->prev; else last = s->prev;
+        }
+
     };
 
-    Lock _mx;
+    mutable Lock _mx;
     Queue_Impl _queue;
-    link_list_queue<typename awaitable<value_type>::result> _pop_queue;
-    link_list_queue<val_and_result> _push_queue;
+    link_list_queue<pop_slot> _pop_queue;
+    link_list_queue<push_slot> _push_queue;
     std::exception_ptr _closed = {};
+    //count of parked or parking consumers (lockfree implementation only)
+    std::atomic<unsigned int> _pop_waiting = {0};
+    //count of parked or parking producers (lockfree implementation only)
+    std::atomic<unsigned int> _push_waiting = {0};
+
+    //resolve parked consumer
+    template<typename ... Args>
+    static prepared_coro deliver(pop_slot *s, Args && ... args) {
+        MINICORO_TRACE::on_queue_unpark(s, false);
+        auto r = std::move(s->r);
+        std::destroy_at(s);
+        return r(std::forward<Args>(args)...);
+    }
+
+    //release parked producer (its value must be already moved out)
+    static prepared_coro release_push(push_slot *s) {
+        MINICORO_TRACE::on_queue_unpark(s, true);
+        auto r = std::move(s->r);
+        if (s->allocated) delete s; else std::destroy_at(s);
+        return r();
+    }
+
+    //move one parked producer to the queue
+    prepared_coro refill() {
+        auto s = _push_queue.pop();
+        if (!s) return {};
+        _queue.push(std::move(s->val));
+        return release_push(s);
+    }
+
+    awaitable<void> park_push(value_type &&v) {
+        return [this, v = std::move(v)](awaitable<void>::result r) mutable -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            //closure is destroyed when temporary state is allocated
+            value_type val(std::move(v));
+            return me->push_slow(std::move(val), std::move(r));
+        };
+    }
+
+    prepared_coro push_slow(value_type &&val, awaitable<void>::result &&r) {
+        std::unique_lock lk(_mx);
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            _push_waiting.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_queue.try_push(std::move(val))) {
+                _push_waiting.fetch_sub(1, std::memory_order_relaxed);
+                lk.unlock();
+                after_push();
+                return r();
+            }
+        } else {
+            auto s = _pop_queue.pop();
+            if (s) {
+                prepared_coro resm = deliver(s, std::move(val));
+                lk.unlock();
+                resm.resume();
+                return r();
+            }
+            if (!_queue.is_full()) {
+                _queue.push(std::move(val));
+                lk.unlock();
+                return r();
+            }
+        }
+        push_slot *s;
+        if constexpr(sizeof(push_slot) <= awaitable<void>::temp_state_size) {
+            s = awaitable<void>::template get_temp_state<push_slot>(r);
+            std::construct_at(s, std::move(val));
+        } else {
+            s = new push_slot(std::move(val));
+            s->allocated = true;
+        }
+        s->r = std::move(r);
+        MINICORO_TRACE::on_queue_park(this, s, true);
+        _push_queue.push(s);
+        return {};
+    }
+
+    prepared_coro pop_slow(typename awaitable<value_type>::result &&r) {
+        std::unique_lock lk(_mx);
+        if constexpr(lockfree_queue_impl<Queue_Impl>) {
+            _pop_waiting.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto v = _queue.try_pop();
+            if (v) {
+                _pop_waiting.fetch_sub(1, std::memory_order_relaxed);
+                lk.unlock();
+                after_pop();
+                return r(std::move(*v));
+            }
+            if (_closed) {
+                _pop_waiting.fetch_sub(1, std::memory_order_relaxed);
+                return r = _closed;
+            }
+        } else {
+            if (!_queue.is_empty()) {
+                prepared_coro out = r(_queue.pop());
+                prepared_coro resm = refill();
+                lk.unlock();
+                resm.resume();
+                return out;
+            }
+            if (_closed) return r = _closed;
+        }
+        auto s = awaitable<value_type>::template get_temp_state<pop_slot>(r);
+        std::construct_at(s);
+        s->r = std::move(r);
+        MINICORO_TRACE::on_queue_park(this, s, false);
+        _pop_queue.push(s);
+        return {};
+    }
+
+    //remove parked consumer waiting on given awaitable, resolve it with no value
+    //The awaitable must be parked by pop_slow() of this queue or already resolved
+    prepared_coro cancel_pop(const awaitable<value_type> &awt) {
+        typename awaitable<value_type>::result r;
+        {
+            lock_guard _(_mx);
+            //parked consumers are always resolved under the lock, when the awaitable
+            //has a result, the slot was already removed
+            if (!awaitable<value_type>::can_have_temp_state(awt)) return {};
+            auto s = reinterpret_cast<pop_slot *>(const_cast<void *>(
+                    awaitable<value_type>::get_temp_state_address(awt)));
+            _pop_queue.erase(s);
+            if constexpr(lockfree_queue_impl<Queue_Impl>) {
+                _pop_waiting.fetch_sub(1, std::memory_order_relaxed);
+            }
+            MINICORO_TRACE::on_queue_unpark(s, false);
+            r = std::move(s->r);
+            std::destroy_at(s);
+        }
+        return r = std::nullopt;
+    }
+
+    awaitable<std::size_t> pop_batch_slow(std::span<value_type> out) {
+        out[0] = co_await pop();
+        co_return 1 + pop_many(out.subspan(1));
+    }
 
+    //lockfree only: resolve all parked producers and consumers which can be resolved
+    //under single lock. Coroutines are stored to the list to be resumed later
+    void wake_batch(resume_list &resm) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_pop_waiting.load(std::memory_order_seq_cst)
+            && !_push_waiting.load(std::memory_order_seq_cst)) return;
+        lock_guard _(_mx);
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            while (_pop_queue.first) {
+                auto v = _queue.try_pop();
+                if (!v) break;
+                _pop_waiting.fetch_sub(1, std::memory_order_relaxed);
+                resm.push(deliver(_pop_queue.pop(), std::move(*v)));
+                progress = true;
+            }
+            while (_push_queue.first) {
+                if (!_queue.try_push(std::move(_push_queue.first->val))) break;
+                _push_waiting.fetch_sub(1, std::memory_order_relaxed);
+                resm.push(release_push(_push_queue.pop()));
+                progress = true;
+            }
+        }
+    }
+
+    //lockfree only: called after item has been pushed
+    void after_push() {
+        while (wake_consumer() && wake_producer());
+    }
+
+    //lockfree only: called after item has been popped
+    void after_pop() {
+        while (wake_producer() && wake_consumer());
+    }
+
+    //lockfree only: pass an item to a parked consumer, returns true if an item has been removed
+    bool wake_consumer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_pop_waiting.load(std::memory_order_seq_cst)) return false;
+        prepared_coro resm;
+        lock_guard _(_mx);
+        if (!_pop_queue.first) return false;
+        auto v = _queue.try_pop();
+        if (!v) return false;
+        auto s = _pop_queue.pop();
+        _pop_waiting.fetch_sub(1, std::memory_order_relaxed);
+        resm = deliver(s, std::move(*v));
+        return true;
+    }
 
+    //lockfree only: move a parked producer to the queue, returns true if an item has been added
+    bool wake_producer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_push_waiting.load(std::memory_order_seq_cst)) return false;
+        prepared_coro resm;
+        lock_guard _(_mx);
+        auto s = _push_queue.first;
+        if (!s) return false;
+        if (!_queue.try_push(std::move(s->val))) return false;
+        _push_queue.pop();
+        _push_waiting.fetch_sub(1, std::memory_order_relaxed);
+        resm = release_push(s);
+        return true;
+    }
 };
 
 
 template<typename T, unsigned int count, typename Lock = std::mutex>
 class coro_queue : public coro_basic_queue<limited_queue<T, count>, Lock > {};
 
+///unbounded coroutine queue, producers never suspend
+/**
+ * @tparam T type of item
+ * @tparam segment_size count of items in one segment of storage, must be power of two
+ */
+template<typename T, unsigned int segment_size = 64, typename Lock = std::mutex>
+class coro_segmented_queue : public coro_basic_queue<segmented_queue<T, segment_size>, Lock > {};
+
+///coroutine queue which doesn't lock on push and pop unless it needs to suspend
+/**
+ * @tparam T type of item
+ * @tparam count max count of items, must be power of two
+ */
+template<typename T, unsigned int count>
+class coro_mpmc_queue : public coro_basic_queue<mpmc_queue<T, count>, std::mutex> {};
+
+
+///queue type usable with queue_select
+template<typename T>
+concept is_coro_queue = requires(T &q, std::stop_token tkn) {
+    typename T::value_type;
+    {q.pop(tkn)} -> std::same_as<awaitable<typename T::value_type> >;
+};
+
+///wait for the first item from multiple queues
+/**
+ * The selector registers a single consumer in each queue and takes exactly one item
+ * from the queue which delivers first. The consumer is then removed from the other
+ * queues. Waiting doesn't allocate, the state is stored in the selector, so it is
+ * better to keep the selector and reuse it for repeated waits.
+ *
+ * @code
+ * queue_select sel(q1, q2, q3);
+ * while (true) {
+ *      auto [index, value] = co_await sel;
+ *      ...
+ * }
+ * @endcode
+ *
+ * Queues are tested in round-robin order, starting after the queue which
+ * delivered the last item.
+ *
+ * @tparam Queue type of queue (coro_queue, coro_mpmc_queue)
+ * @tparam N count of queues, or std::dynamic_extent if the count is specified
+ * at runtime
+ *
+ * @note If more queues deliver an item at the same time (from different threads),
+ * the other item is kept in the selector and returned by the next wait. Destroying
+ * the selector pushes such item back to the end of its queue, so a temporary
+ * selector (see select()) doesn't lose items, but the item can be reordered with
+ * items pushed after it. Only one wait can be pending at time.
+ */
+template<typename Queue, std::size_t N = std::dynamic_extent>
+class queue_select {
+public:
+
+    using value_type = typename Queue::value_type;
+
+    ///result of the wait
+    struct item {
+        ///index of queue
+        std::size_t index;
+        ///value removed from the queue
+        value_type value;
+    };
+
+    ///construct from queues
+    template<std::same_as<Queue> ... Qs>
+    requires(N != std::dynamic_extent && sizeof...(Qs) == N)
+    queue_select(Qs &... queues) {
+        std::size_t idx = 0;
+        (init(_slots[idx], queues, idx), ...);
+    }
+
+    ///construct from a range of queues
+    /**
+     * @param queues range of references or pointers to queues
+     */
+    template<range_for_iterable R>
+    requires(N == std::dynamic_extent)
+    explicit queue_select(R &&queues) {
+        std::size_t cnt = 0;
+        for (auto &&q: queues) {(void)q; ++cnt;}
+        _slots = slot_storage(cnt);
+        std::size_t idx = 0;
+        for (auto &&q: queues) {
+            init(_slots[idx], *to_ptr(q), idx);
+        }
+    }
+
+    queue_select(const queue_select &) = delete;
+    queue_select &operator=(const queue_select &) = delete;
+
+    ///return items kept from the last wait to their queues
+    /**
+     * If the queue is full, the push is finished once there is a space. If the queue
+     * is closed, the item is dropped.
+     */
+    ~queue_select() {
+        for (auto &s: _slots) {
+            if (!s._ready) continue;
+            try {
+                value_type v(s._awt.await_resume());
+                s._queue->push(std::move(v)) >> [](awaitable<void> &) {};
+            } catch (...) {
+                //closed queue, the item is an exception
+            }
+        }
+    }
+
+    ///wait for an item
+    /**
+     * @return awaitable which receives the item and the index of the queue. If the
+     * winning queue is closed, the awaitable receives its exception.
+     */
+    awaitable<item> operator()() {
+        return [this](typename awaitable<item>::result r) mutable -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            return me->start(std::move(r));
+        };
+    }
+
+    ///co_await on the selector directly
+    awaitable<item> operator co_await() {
+        return (*this)();
+    }
+
+    ///retrieve count of queues
+    std::size_t size() const {
+        return _slots.size();
+    }
+
+protected:
+
+    //consumer registered in one queue
+    struct slot: coro_frame<slot> { // @suppress("Miss copy constructor or assignment operator")
+        queue_select *_parent = nullptr;
+        Queue *_queue = nullptr;
+        std::size_t _index = 0;
+        awaitable<value_type> _awt = {nullptr};
+        //slot is parked in the queue during current wait
+        bool _registered = false;
+        //slot holds an item (or exception)
+        bool _ready = false;
+
+        prepared_coro do_resume() {
+            return _parent->resolved(*this);
+        }
+    };
+
+    using slot_storage = std::conditional_t<N == std::dynamic_extent, std::vector<slot>, std::array<slot, N> >;
+
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+    static constexpr unsigned int registered_all = 1;
+    static constexpr unsigned int have_winner = 2;
+
+    slot_storage _slots;
+    typename awaitable<item>::result _r = {};
+    std::atomic<std::size_t> _winner = {none};
+    std::atomic<unsigned int> _flags = {0};
+    //registration + parked slots
+    std::atomic<unsigned int> _refs = {0};
+    //first queue tested by next wait
+    std::size_t _start = 0;
+
+    static Queue *to_ptr(Queue &q) {return &q;}
+    static Queue *to_ptr(Queue *q) {return q;}
+
+    void init(slot &s, Queue &q, std::size_t &idx) {
+        s._parent = this;
+        s._queue = &q;
+        s._index = idx++;
+    }
+
+    prepared_coro start(typename awaitable<item>::result &&r) {
+        auto cnt = _slots.size();
+        if (!cnt) return r = std::nullopt;
+        _r = std::move(r);
+        //item kept from previous wait
+        for (std::size_t j = 0; j < cnt; ++j) {
+            auto &s = _slots[(_start + j) % cnt];
+            if (s._ready) {
+                _winner.store(s._index, std::memory_order_relaxed);
+                return finish();
+            }
+        }
+        _winner.store(none, std::memory_order_relaxed);
+        _flags.store(0, std::memory_order_relaxed);
+        _refs.store(1, std::memory_order_relaxed);
+        for (std::size_t j = 0; j < cnt; ++j) {
+            if (_winner.load(std::memory_order_acquire) != none) break;
+            auto &s = _slots[(_start + j) % cnt];
+            s._awt = s._queue->pop();
+            if (s._awt.is_ready()) {
+                s._ready = true;
+                claim(s._index);
+                break;
+            }
+            s._registered = true;
+            _refs.fetch_add(1, std::memory_order_relaxed);
+            //can be resolved immediately, the registration still holds the reference
+            call_await_suspend(s._awt, s.get_handle());
+        }
+        if (_flags.fetch_or(registered_all, std::memory_order_acq_rel) & have_winner) {
+            cancel_others();
+        }
+        return release();
+    }
+
+    prepared_coro resolved(slot &s) {
+        if (s._awt.has_value()) {
+            s._ready = true;
+            claim(s._index);
+        }
+        return release();
+    }
+
+    void claim(std::size_t idx) {
+        std::size_t need = none;
+        if (_winner.compare_exchange_strong(need, idx, std::memory_order_acq_rel)) {
+            if (_flags.fetch_or(have_winner, std::memory_order_acq_rel) & registered_all) {
+                cancel_others();
+            }
+        }
+    }
+
+    //remove the consumer from other queues. If it is not found, the item
+    //is being delivered and the slot will be resolved with the item
+    void cancel_others() {
+        auto w = _winner.load(std::memory_order_acquire);
+        for (auto &s: _slots) {
+            if (s._index != w && s._registered) {
+                s._queue->cancel_pop(s._awt);
+            }
+        }
+    }
+
+    prepared_coro release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) return finish();
+        return {};
+    }
+
+    //all slots are settled, deliver the result
+    prepared_coro finish() {
+        for (auto &s: _slots) s._registered = false;
+        auto &s = _slots[_winner.load(std::memory_order_acquire)];
+        s._ready = false;
+        _start = (s._index + 1) % _slots.size();
+        auto r = std::move(_r);
+        try {
+            item itm{s._index, s._awt.await_resume()};
+            s._awt = nullptr;
+            return r(std::move(itm));
+        } catch (...) {
+            s._awt = nullptr;
+            return r = std::current_exception();
+        }
+    }
+};
+
+template<is_coro_queue Q, std::same_as<Q> ... Qs>
+queue_select(Q &, Qs &...) -> queue_select<Q, 1 + sizeof...(Qs)>;
+
+template<range_for_iterable R>
+requires(!is_coro_queue<std::remove_cvref_t<R> >)
+queue_select(R &&) -> queue_select<std::remove_pointer_t<std::remove_cvref_t<decltype(*std::begin(std::declval<R &>()))> > >;
+
+///select first item from multiple queues
+/**
+ * @param q first queue
+ * @param qs other queues
+ * @return selector, you can co_await on it directly
+ *
+ * @code
+ * auto [index, value] = co_await select(q1, q2);
+ * @endcode
+ *
+ * @see queue_select
+ */
+template<is_coro_queue Q, std::same_as<Q> ... Qs>
+queue_select<Q, 1 + sizeof...(Qs)> select(Q &q, Qs &... qs) {
+    return queue_select<Q, 1 + sizeof...(Qs)>(q, qs...);
+}
+
+///select first item from a range of queues
+/**
+ * @param queues range of references or pointers to queues
+ * @return selector
+ */
+template<range_for_iterable R>
+requires(!is_coro_queue<std::remove_cvref_t<R> >)
+auto select(R &&queues) {
+    return queue_select(std::forward<R>(queues));
+}
+
 }
@@ -0,0 +1,417 @@
+#pragma once
+
+#include "coroutine.h"
+#include "coro_scheduler.h"
+
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <stop_token>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace MINICORO_NAMESPACE {
+
+///I/O reactor with integrated timer scheduler (Linux, epoll)
+/**
+ * The reactor waits for readiness of file descriptors and for timers in single
+ * epoll_wait() call. I/O operations and timers are completed in the thread which
+ * runs the reactor (run_thread(), create_thread() or await()), there is no thread
+ * hop between an I/O event and resumption of the coroutine.
+ *
+ * @code
+ * io_reactor r;
+ * auto thr = r.create_thread();
+ * std::size_t n = co_await r.async_read(fd, buffer, sizeof(buffer));
+ * co_await r.sleep_for(std::chrono::milliseconds(100));
+ * @endcode
+ *
+ * File descriptors must be in non-blocking mode. The operation is tried
+ * immediately when it is awaited, the descriptor is registered to epoll only
+ * when the operation would block. Only one read (or accept) and one write per
+ * descriptor can be pending.
+ *
+ * Errors are reported as std::system_error.
+ *
+ * @tparam Impl implementation of timer scheduler (see basic_scheduler)
+ *
+ * @note Call forget() before the descriptor is closed. Pending operations
+ * of the descriptor are resolved with no value.
+ */
+template<typename Impl = generic_scheduler<awaitable<void>::result, std::chrono::system_clock::time_point, const void *> >
+class basic_io_reactor {
+public:
+
+    using _Ident = const void *;
+    using result_object = typename awaitable<void>::result;
+
+    ///construct reactor
+    /**
+     * @exception std::system_error failed to create epoll or eventfd
+     */
+    basic_io_reactor() {
+        _epfd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (_epfd < 0) throw_error();
+        _evfd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (_evfd < 0) {
+            int e = errno;
+            ::close(_epfd);
+            throw std::system_error(e, std::system_category());
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = _evfd;
+        ::epoll_ctl(_epfd, EPOLL_CTL_ADD, _evfd, &ev);
+    }
+
+    basic_io_reactor(const basic_io_reactor &) = delete;
+    basic_io_reactor &operator=(const basic_io_reactor &) = delete;
+
+    ~basic_io_reactor() {
+        ::close(_evfd);
+        ::close(_epfd);
+    }
+
+    ///read from descriptor
+    /**
+     * @param fd descriptor
+     * @param buf target buffer
+     * @param len size of buffer
+     * @return awaitable resolved with count of bytes read, 0 means end of stream
+     */
+    awaitable<std::size_t> async_read(int fd, void *buf, std::size_t len) {
+        return [this, fd, buf, len](awaitable<std::size_t>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            std::size_t n;
+            int e = do_read(fd, buf, len, n);
+            if (e == 0) return r(n);
+            if (e != EAGAIN) return r = make_error(e);
+            std::lock_guard _(me->_mx);
+            fd_state &st = me->_fds[fd];
+            if (st.read_r || st.accept_r) return r = make_error(EBUSY);
+            st.read_buf = buf;
+            st.read_len = len;
+            st.read_r = std::move(r);
+            me->arm(fd, st);
+            return {};
+        };
+    }
+
+    ///write to descriptor
+    /**
+     * @param fd descriptor
+     * @param buf data to write
+     * @param len size of data
+     * @return awaitable resolved with count of bytes written, it can be less than len
+     */
+    awaitable<std::size_t> async_write(int fd, const void *buf, std::size_t len) {
+        return [this, fd, buf, len](awaitable<std::size_t>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            std::size_t n;
+            int e = do_write(fd, buf, len, n);
+            if (e == 0) return r(n);
+            if (e != EAGAIN) return r = make_error(e);
+            std::lock_guard _(me->_mx);
+            fd_state &st = me->_fds[fd];
+            if (st.write_r) return r = make_error(EBUSY);
+            st.write_buf = buf;
+            st.write_len = len;
+            st.write_r = std::move(r);
+            me->arm(fd, st);
+            return {};
+        };
+    }
+
+    ///accept connection on listening socket
+    /**
+     * @param fd listening socket
+     * @return awaitable resolved with descriptor of accepted connection. The
+     * descriptor is in non-blocking mode
+     */
+    awaitable<int> accept(int fd) {
+        return [this, fd](awaitable<int>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            int c;
+            int e = do_accept(fd, c);
+            if (e == 0) return r(c);
+            if (e != EAGAIN) return r = make_error(e);
+            std::lock_guard _(me->_mx);
+            fd_state &st = me->_fds[fd];
+            if (st.read_r || st.accept_r) return r = make_error(EBUSY);
+            st.accept_r = std::move(r);
+            me->arm(fd, st);
+            return {};
+        };
+    }
+
+    ///remove descriptor from the reactor
+    /**
+     * Call this function before the descriptor is closed. Pending operations are
+     * resolved with no value.
+     * @param fd descriptor
+     */
+    void forget(int fd) {
+        fd_state st;
+        {
+            std::lock_guard _(_mx);
+            auto iter = _fds.find(fd);
+            if (iter == _fds.end()) return;
+            if (iter->second.added) ::epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+            st = std::move(iter->second);
+            _fds.erase(iter);
+        }
+        st.read_r = std::nullopt;
+        st.accept_r = std::nullopt;
+        st.write_r = std::nullopt;
+    }
+
+    ///sleep until given time
+    /**
+     * @param tp time point
+     * @param ident optional identity
+     * @return awaitable, coroutine must co_await to perform sleep
+     */
+    awaitable<void> sleep_until(std::chrono::system_clock::time_point tp, _Ident ident = {}) {
+        return [this, tp, ident = std::move(ident)](result_object r) mutable {
+            std::lock_guard _(_mx);
+            auto n = _sch.get_first_scheduled_time();
+            if (!n || tp < *n) wake();
+            _sch.schedule_at(std::move(r),std::move(tp),std::move(ident));
+        };
+    }
+
+    ///sleep for given time
+    template<typename A, typename B>
+    awaitable<void> sleep_for(std::chrono::duration<A,B> dur, _Ident ident = {}) {
+        return sleep_until(std::chrono::system_clock::now()+dur, std::move(ident));
+    }
+
+    ///remove sleeping coroutine by identity
+    /**
+     * @param ident identity
+     * @return result object of this coroutine, or empty, if not found
+     */
+    result_object remove_by_ident(_Ident ident) {
+        std::lock_guard _(_mx);
+        return _sch.remove_by_ident(ident);
+    }
+
+    ///cancel sleep, resolve it with no value
+    /**
+     * @param ident identity
+     * @return prepared coroutine. If empty, then nothing has been canceled
+     */
+    prepared_coro cancel(_Ident ident) {
+        result_object r = remove_by_ident(ident);
+        return r = std::nullopt;
+    }
+
+    ///run reactor's thread
+    /**
+     * @param tkn stop token, signal this token to stop operation
+     */
+    void run_thread(std::stop_token tkn) {
+        std::stop_callback __(tkn,[this]{
+            wake();
+        });
+        epoll_event events[max_events];
+        while (!tkn.stop_requested()) {
+            int timeout = -1;
+            {
+                std::unique_lock lk(_mx);
+                auto tm = _sch.get_first_scheduled_time();
+                if (tm) {
+                    auto now = std::chrono::system_clock::now();
+                    if (now >= *tm) {
+                        MINICORO_TRACE::on_timer_fire(this, std::chrono::duration_cast<std::chrono::nanoseconds>(now - *tm));
+                        auto r = _sch.remove_first();
+                        lk.unlock();
+                        r();
+                        continue;
+                    }
+                    //round up, don't wake before the time
+                    timeout = static_cast<int>(std::min<std::chrono::milliseconds::rep>(
+                            std::chrono::ceil<std::chrono::milliseconds>(*tm - now).count(), 0x7FFFFFFF));
+                }
+            }
+            int n = ::epoll_wait(_epfd, events, max_events, timeout);
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.fd == _evfd) {
+                    std::uint64_t v;
+                    while (::read(_evfd, &v, sizeof(v)) > 0);
+                } else {
+                    on_ready(events[i].data.fd, events[i].events);
+                }
+            }
+        }
+    }
+
+    ///run reactor while awaiting for given awaiter
+    /**
+     * @param awt coroutine's compatibile awaiter
+     * @return value returned by await_resume()
+     */
+    template<is_awaiter Awt>
+    auto await(Awt &&awt) {
+        if (!awt.await_ready()) {
+            stop_source_coro_frame stpsrc;
+            call_await_suspend(awt, stpsrc.get_handle());
+            run_thread(stpsrc.get_token());
+        }
+        return awt.await_resume();
+    }
+    template<has_co_await Awt>
+    auto await(Awt &&awt) {
+        return await(awt.operator co_await());
+    }
+    template<has_global_co_await Awt>
+    auto await(Awt &&awt) {
+        return await(operator co_await(awt));
+    }
+
+    ///create thread and run reactor
+    /**
+     * @return running thread. Ensure that you destroy thread before destuction of reactor
+     */
+    std::jthread create_thread() {
+        return std::jthread([this](std::stop_token tkn)mutable{
+            run_thread(std::move(tkn));
+        });
+    }
+
+protected:
+
+    static constexpr int max_events = 64;
+
+    //pending operations of a descriptor
+    struct fd_state {
+        awaitable<std::size_t>::result read_r;
+        void *read_buf = nullptr;
+        std::size_t read_len = 0;
+        awaitable<int>::result accept_r;
+        awaitable<std::size_t>::result write_r;
+        const void *write_buf = nullptr;
+        std::size_t write_len = 0;
+        //events registered in epoll (0 - not registered)
+        std::uint32_t armed = 0;
+        //descriptor was added to epoll
+        bool added = false;
+    };
+
+    mutable std::mutex _mx;
+    Impl _sch;
+    std::unordered_map<int, fd_state> _fds;
+    int _epfd = -1;
+    int _evfd = -1;
+
+    [[noreturn]] static void throw_error() {
+        throw std::system_error(errno, std::system_category());
+    }
+
+    static std::exception_ptr make_error(int e) {
+        return std::make_exception_ptr(std::system_error(e, std::system_category()));
+    }
+
+    //returns 0 - success, EAGAIN - would block, other - error
+    static int do_read(int fd, void *buf, std::size_t len, std::size_t &n) {
+        while (true) {
+            auto r = ::read(fd, buf, len);
+            if (r >= 0) {n = static_cast<std::size_t>(r); return 0;}
+            if (errno == EWOULDBLOCK) return EAGAIN;
+            if (errno != EINTR) return errno;
+        }
+    }
+
+    static int do_write(int fd, const void *buf, std::size_t len, std::size_t &n) {
+        while (true) {
+            auto r = ::write(fd, buf, len);
+            if (r >= 0) {n = static_cast<std::size_t>(r); return 0;}
+            if (errno == EWOULDBLOCK) return EAGAIN;
+            if (errno != EINTR) return errno;
+        }
+    }
+
+    static int do_accept(int fd, int &c) {
+        while (true) {
+            c = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (c >= 0) return 0;
+            if (errno == EWOULDBLOCK || errno == ECONNABORTED) return EAGAIN;
+            if (errno != EINTR) return errno;
+        }
+    }
+
+    //update registration in epoll, must be called under lock
+    void arm(int fd, fd_state &st) {
+        std::uint32_t need = 0;
+        if (st.read_r || st.accept_r) need |= EPOLLIN;
+        if (st.write_r) need |= EPOLLOUT;
+        if (!need) {
+            st.armed = 0;
+            return;
+        }
+        epoll_event ev = {};
+        ev.events = need | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (!st.added) {
+            st.added = true;
+            ::epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev);
+        } else {
+            ::epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev);
+        }
+        st.armed = need;
+    }
+
+    //wake up epoll_wait
+    void wake() {
+        std::uint64_t v = 1;
+        [[maybe_unused]] auto r = ::write(_evfd, &v, sizeof(v));
+    }
+
+    //process readiness of a descriptor
+    void on_ready(int fd, std::uint32_t events) {
+        //resumed after the lock is released
+        prepared_coro rd, wr;
+        std::lock_guard _(_mx);
+        auto iter = _fds.find(fd);
+        if (iter == _fds.end()) return;
+        fd_state &st = iter->second;
+        bool err = (events & (EPOLLERR | EPOLLHUP)) != 0;
+        if (err || (events & EPOLLIN)) {
+            if (st.read_r) {
+                std::size_t n;
+                int e = do_read(fd, st.read_buf, st.read_len, n);
+                if (e == 0) rd = st.read_r(n);
+                else if (e != EAGAIN) rd = (st.read_r = make_error(e));
+            } else if (st.accept_r) {
+                int c;
+                int e = do_accept(fd, c);
+                if (e == 0) rd = st.accept_r(c);
+                else if (e != EAGAIN) rd = (st.accept_r = make_error(e));
+            }
+        }
+        if (err || (events & EPOLLOUT)) {
+            if (st.write_r) {
+                std::size_t n;
+                int e = do_write(fd, st.write_buf, st.write_len, n);
+                if (e == 0) wr = st.write_r(n);
+                else if (e != EAGAIN) wr = (st.write_r = make_error(e));
+            }
+        }
+        //one shot - rearm for operations which are still pending
+        arm(fd, st);
+    }
+};
+
+///I/O reactor with timers in binary heap
+using io_reactor = basic_io_reactor<>;
+
+}
@@ -1,14 +1,18 @@
 #pragma once
 
 #include "coroutine.h"
+#include "coro_cancel.h"
 #include "alert_flag.h"
 
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <mutex>
 #include <optional>
 #include <condition_variable>
 #include <vector>
 #include <thread>
+#include <unordered_map>
 namespace MINICORO_NAMESPACE {
 
 class stop_source_coro_frame: public coro_frame<stop_source_coro_frame>,
@@ -23,13 +27,24 @@ protected:
 };
 
 
+///scheduler implementation: binary heap ordered by time
+/**
+ * Identities are indexed, so remove_by_ident() and set_time() don't need
+ * to scan the heap. Empty identity is not indexed
+ *
+ * @tparam T type of scheduled object
+ * @tparam _TP type of time point
+ * @tparam _Ident type of identity
+ */
 template<typename T, typename _TP, typename _Ident = const void *>
 class generic_scheduler {
 public:
 
     void schedule_at(T x, _TP timestamp, _Ident ident) {
+        std::size_t pos = _heap.size();
         _heap.push_back({timestamp, std::move(x), ident});
-        std::push_heap(_heap.begin(), _heap.end(), compare);
+        if (ident != _Ident{}) _index.emplace(ident, pos);
+        sift_up(pos);
     }
 
     std::optional<_TP> get_first_scheduled_time() const {
@@ -38,42 +53,25 @@ public:
     }
 
     T remove_first() {
-        T out;
-        if (!_heap.empty()) {
-            std::pop_heap(_heap.begin(), _heap.end(), compare);
-            out = std::move(_heap.back().res);
-            _heap.pop_back();
-        }
-        return out;
+        if (_heap.empty()) return T{};
+        return remove_at(0);
     }
     T remove_by_ident(_Ident ident) {
-        T r;
-        for (std::size_t i = 0, cnt = _heap.size();i<cnt; ++i) {
-            if (_heap[i].ident == ident) {
-                r = std::move(_heap[i].res);
-                if (i == 0) {
-                    remove_first();
-                } else if (i == cnt-1) {
-                    _heap.pop_back();
-                } else {
-                    update_heap_element(i, std::move(_heap.back()));
-                    _heap.pop_back();
-                }
-                break;
-            }
-        }
-        return r;
+        auto iter = _index.find(ident);
+        if (iter == _index.end()) return T{};
+        return remove_at(iter->second);
     }
 
     ///set task time, update its position in the heap
     bool set_time(_Ident ident, _TP new_tp) {
+        auto rng = _index.equal_range(ident);
         bool ok = false;
-        for (std::size_t i = 0, cnt = _heap.size();i<cnt; ++i) {
-            if (_heap[i].ident == ident) {
-                auto r=std::move(_heap[i].res);
-                update_heap_element(i, {new_tp, std::move(r), ident});
-                ok = true;
-            }
+        //positions are updated in the index while the heap is reordered
+        for (auto iter = rng.first; iter != rng.second; ++iter) {
+            std::size_t pos = iter->second;
+            _heap[pos].timestamp = new_tp;
+            sift_down(sift_up(pos));
+            ok = true;
         }
         return ok;
     }
@@ -95,60 +93,387 @@ protected:
     }
 
     std::vector<HeapItem> _heap;
+    std::unordered_multimap<_Ident, std::size_t> _index;
+
+    void reindex(const _Ident &ident, std::size_t from, std::size_t to) {
+        if (ident == _Ident{}) return;
+        auto rng = _index.equal_range(ident);
+        for (auto iter = rng.first; iter != rng.second; ++iter) {
+            if (iter->second == from) {
+                iter->second = to;
+                return;
+            }
+        }
+    }
 
+    void unindex(const _Ident &ident, std::size_t pos) {
+        if (ident == _Ident{}) return;
+        auto rng = _index.equal_range(ident);
+        for (auto iter = rng.first; iter != rng.second; ++iter) {
+            if (iter->second == pos) {
+                _index.erase(iter);
+                return;
+            }
+        }
+    }
 
-    void update_heap_element(std::size_t pos, HeapItem &&new_value) {
-        bool shift_up = compare(_heap[pos], new_value);
-        _heap[pos] = std::move(new_value);
+    void swap_items(std::size_t a, std::size_t b) {
+        std::swap(_heap[a], _heap[b]);
+        reindex(_heap[a].ident, b, a);
+        reindex(_heap[b].ident, a, b);
+    }
 
-        if (shift_up) {
-            while (pos > 0) {
-                size_t parent = (pos - 1) / 2;
-                if (compare(_heap[parent], _heap[pos])) {
-                    std::swap(_heap[parent], _heap[pos]);
-                    pos = parent;
-                } else {
-                    break;
-                }
+    T remove_at(std::size_t pos) {
+        T out = std::move(_heap[pos].res);
+        unindex(_heap[pos].ident, pos);
+        std::size_t last = _heap.size() - 1;
+        if (pos != last) {
+            _heap[pos] = std::move(_heap[last]);
+            reindex(_heap[pos].ident, last, pos);
+            _heap.pop_back();
+            sift_down(sift_up(pos));
+        } else {
+            _heap.pop_back();
+        }
+        return out;
+    }
+
+    std::size_t sift_up(std::size_t pos) {
+        while (pos > 0) {
+            std::size_t parent = (pos - 1) / 2;
+            if (compare(_heap[parent], _heap[pos])) {
+                swap_items(parent, pos);
+                pos = parent;
+            } else {
+                break;
             }
         }
-        else {
-            size_t n = _heap.size();
-            while (true) {
-                size_t left = 2 * pos + 1;
-                size_t right = 2 * pos + 2;
-                size_t largest = pos;
-
-                if (left < n && compare(_heap[largest], _heap[left])) {
-                    largest = left;
-                }
-                if (right < n && compare(_heap[largest], _heap[right])) {
-                    largest = right;
-                }
-                if (largest != pos) {
-                    std::swap(_heap[pos], _heap[largest]);
-                    pos = largest;
-                } else {
+        return pos;
+    }
+
+    std::size_t sift_down(std::size_t pos) {
+        std::size_t n = _heap.size();
+        while (true) {
+            std::size_t left = 2 * pos + 1;
+            std::size_t right = 2 * pos + 2;
+            std::size_t largest = pos;
+
+            if (left < n && compare(_heap[largest], _heap[left])) {
+                largest = left;
+            }
+            if (right < n && compare(_heap[largest], _heap[right])) {
+                largest = right;
+            }
+            if (largest != pos) {
+                swap_items(pos, largest);
+                pos = largest;
+            } else {
+                break;
+            }
+        }
+        return pos;
+    }
+};
+
+///scheduler implementation: hierarchical timer wheel
+/**
+ * Insert, remove by identity and reschedule are O(1). Time is divided
+ * into ticks, items scheduled to the same tick are kept
+ * in one slot. Each level of the wheel covers 2^slot_bits times more ticks than
+ * previous level, items are moved to the lower level once the wheel reaches
+ * their range. Items beyond the last level are stored in an overflow list.
+ *
+ * The wheel starts at the first item scheduled to the empty wheel, moves back when an
+ * earlier item is scheduled and advances when the first item is removed. So the
+ * wheel works with ticks of an absolute clock. The earliest item is
+ * still found with full precision of the time point, the wheel scans the
+ * earliest nonempty slot for it.
+ *
+ * @tparam T type of scheduled object
+ * @tparam _TP type of time point (std::chrono::time_point)
+ * @tparam _Ident type of identity
+ * @tparam levels count of levels
+ * @tparam slot_bits count of bits per level (slots per level = 2^slot_bits)
+ *
+ * @code
+ * using wheel = timer_wheel<scheduler::result_object, std::chrono::system_clock::time_point>;
+ * basic_scheduler<wheel> sch(wheel(std::chrono::milliseconds(10)));
+ * @endcode
+ */
+template<typename T, typename _TP, typename _Ident = const void *, unsigned int levels = 4, unsigned int slot_bits = 8>
+class timer_wheel {
+public:
+
+    static_assert(levels > 0 && slot_bits > 0 && levels * slot_bits < 64, "Unsupported wheel size");
+
+    using duration = typename _TP::duration;
+
+    ///construct the wheel
+    /**
+     * @param tick resolution of the wheel
+     */
+    explicit timer_wheel(duration tick = std::chrono::duration_cast<duration>(std::chrono::milliseconds(1)))
+        :_tick(tick > duration::zero()?tick:duration(1)) {
+        std::fill(std::begin(_heads), std::end(_heads), npos);
+    }
+
+    void schedule_at(T x, _TP timestamp, _Ident ident) {
+        //empty wheel starts at the first item, otherwise ticks of an absolute
+        //clock (far from zero) would put every item to the overflow list
+        if (_count == 0) _cursor = to_tick(timestamp);
+        else rebase(timestamp);
+        std::uint32_t idx = alloc_node();
+        node &n = _nodes[idx];
+        n.res = std::move(x);
+        n.timestamp = timestamp;
+        n.ident = ident;
+        place(idx);
+        if (ident != _Ident{}) _index.emplace(ident, idx);
+        ++_count;
+        if (_first != npos && timestamp < _nodes[_first].timestamp) _first = idx;
+    }
+
+    std::optional<_TP> get_first_scheduled_time() const {
+        auto idx = first_node();
+        if (idx == npos) return {};
+        return _nodes[idx].timestamp;
+    }
+
+    T remove_first() {
+        auto idx = first_node();
+        if (idx == npos) return T{};
+        std::uint64_t t = std::max(to_tick(_nodes[idx].timestamp), _cursor);
+        T out = remove_node(idx);
+        advance(t);
+        return out;
+    }
+
+    T remove_by_ident(_Ident ident) {
+        auto iter = _index.find(ident);
+        if (iter == _index.end()) return T{};
+        return remove_node(iter->second);
+    }
+
+    ///set task time, move the task to the new slot
+    bool set_time(_Ident ident, _TP new_tp) {
+        auto rng = _index.equal_range(ident);
+        if (rng.first == rng.second) return false;
+        rebase(new_tp);
+        for (auto iter = rng.first; iter != rng.second; ++iter) {
+            auto idx = iter->second;
+            unlink(idx);
+            _nodes[idx].timestamp = new_tp;
+            place(idx);
+        }
+        _first = npos;
+        return true;
+    }
+
+    bool empty() const {
+        return _count == 0;
+    }
+
+protected:
+
+    static constexpr std::uint32_t npos = ~std::uint32_t(0);
+    static constexpr std::uint32_t slots = 1U << slot_bits;
+    static constexpr std::uint64_t mask = slots - 1;
+    static constexpr std::uint32_t overflow = levels * slots;
+    static constexpr std::uint32_t bitmap_words = (slots + 63) / 64;
+
+    struct node {
+        T res = {};
+        _TP timestamp = {};
+        _Ident ident = {};
+        std::uint32_t prev = npos;
+        std::uint32_t next = npos;
+        std::uint32_t where = npos;
+    };
+
+    duration _tick;
+    std::size_t _count = 0;
+    std::uint32_t _free = npos;
+    //tick of last removed item or of the earliest item scheduled since. Items at
+    //level L differ from the cursor in L-th digit
+    std::uint64_t _cursor = 0;
+    std::vector<node> _nodes;
+    std::uint32_t _heads[levels * slots + 1];
+    std::uint64_t _bitmap[levels][bitmap_words] = {};
+    std::unordered_multimap<_Ident, std::uint32_t> _index;
+    //cached earliest item
+    mutable std::uint32_t _first = npos;
+
+    std::uint64_t to_tick(const _TP &tp) const {
+        if (tp <= _TP{}) return 0;
+        return static_cast<std::uint64_t>((tp - _TP{}) / _tick);
+    }
+
+    std::uint32_t alloc_node() {
+        if (_free != npos) {
+            auto idx = _free;
+            _free = _nodes[idx].next;
+            return idx;
+        }
+        _nodes.emplace_back();
+        return static_cast<std::uint32_t>(_nodes.size() - 1);
+    }
+
+    T remove_node(std::uint32_t idx) {
+        node &n = _nodes[idx];
+        T out = std::move(n.res);
+        unlink(idx);
+        if (n.ident != _Ident{}) {
+            auto rng = _index.equal_range(n.ident);
+            for (auto iter = rng.first; iter != rng.second; ++iter) {
+                if (iter->second == idx) {
+                    _index.erase(iter);
                     break;
                 }
             }
         }
+        n.res = T{};
+        n.next = _free;
+        _free = idx;
+        --_count;
+        if (_first == idx) _first = npos;
+        return out;
+    }
+
+    void set_bit(std::uint32_t where) {
+        if (where != overflow) _bitmap[where / slots][(where % slots) / 64] |= std::uint64_t(1) << (where % 64);
+    }
+
+    void clear_bit(std::uint32_t where) {
+        if (where != overflow) _bitmap[where / slots][(where % slots) / 64] &= ~(std::uint64_t(1) << (where % 64));
+    }
+
+    //put node to the slot relative to current cursor
+    void place(std::uint32_t idx) {
+        node &n = _nodes[idx];
+        std::uint64_t t = std::max(to_tick(n.timestamp), _cursor);
+        std::uint64_t diff = t ^ _cursor;
+        std::uint32_t where;
+        if (diff == 0) {
+            where = static_cast<std::uint32_t>(t & mask);
+        } else {
+            unsigned int level = (std::bit_width(diff) - 1) / slot_bits;
+            if (level >= levels) {
+                where = overflow;
+            } else {
+                where = level * slots + static_cast<std::uint32_t>((t >> (level * slot_bits)) & mask);
+            }
+        }
+        n.where = where;
+        n.prev = npos;
+        n.next = _heads[where];
+        if (n.next != npos) _nodes[n.next].prev = idx;
+        _heads[where] = idx;
+        set_bit(where);
+    }
+
+    void unlink(std::uint32_t idx) {
+        node &n = _nodes[idx];
+        if (n.prev != npos) _nodes[n.prev].next = n.next;
+        else _heads[n.where] = n.next;
+        if (n.next != npos) _nodes[n.next].prev = n.prev;
+        if (_heads[n.where] == npos) clear_bit(n.where);
+        n.prev = n.next = n.where = npos;
+    }
+
+    //find first nonempty slot on given level starting by given slot
+    std::uint32_t find_slot(unsigned int level, std::uint32_t from) const {
+        for (std::uint32_t w = from / 64; w < bitmap_words; ++w) {
+            std::uint64_t bits = _bitmap[level][w];
+            if (w == from / 64) bits &= ~std::uint64_t(0) << (from % 64);
+            if (bits) return w * 64 + static_cast<std::uint32_t>(std::countr_zero(bits));
+        }
+        return npos;
+    }
+
+    //detach list and place all its nodes again
+    void cascade(std::uint32_t where) {
+        std::uint32_t idx = _heads[where];
+        _heads[where] = npos;
+        clear_bit(where);
+        while (idx != npos) {
+            std::uint32_t next = _nodes[idx].next;
+            place(idx);
+            idx = next;
+        }
     }
-};
 
+    //move cursor back to an item scheduled before it. All nodes are placed again,
+    //this happens only when the new item is the earliest and the cursor is ahead of
+    //it - after the empty wheel started at a later item
+    void rebase(const _TP &tp) {
+        std::uint64_t t = to_tick(tp);
+        if (t >= _cursor) return;
+        _cursor = t;
+        std::fill(std::begin(_heads), std::end(_heads), npos);
+        for (auto &level: _bitmap) std::fill(std::begin(level), std::end(level), 0);
+        for (std::uint32_t idx = 0; idx < _nodes.size(); ++idx) {
+            if (_nodes[idx].where != npos) place(idx);
+        }
+    }
 
-template<typename _TP = std::chrono::system_clock::time_point>
+    //move cursor forward. There must be no item before new cursor
+    void advance(std::uint64_t t) {
+        if (t <= _cursor) return;
+        std::uint64_t diff = t ^ _cursor;
+        _cursor = t;
+        unsigned int level = (std::bit_width(diff) - 1) / slot_bits;
+        //levels below are empty, only the slot which contains the cursor
+        //needs to be distributed to lower levels
+        if (level == 0) return;
+        if (level >= levels) cascade(overflow);
+        else cascade(level * slots + static_cast<std::uint32_t>((t >> (level * slot_bits)) & mask));
+    }
+
+    //find slot which contains the earliest item
+    std::uint32_t find_first_slot() const {
+        for (unsigned int level = 0; level < levels; ++level) {
+            auto s = find_slot(level, static_cast<std::uint32_t>((_cursor >> (level * slot_bits)) & mask));
+            if (s != npos) return level * slots + s;
+        }
+        return _heads[overflow] == npos?npos:overflow;
+    }
+
+    std::uint32_t first_node() const {
+        if (_first != npos) return _first;
+        auto s = find_first_slot();
+        if (s == npos) return npos;
+        std::uint32_t best = _heads[s];
+        for (std::uint32_t idx = _nodes[best].next; idx != npos; idx = _nodes[idx].next) {
+            if (_nodes[idx].timestamp < _nodes[best].timestamp) best = idx;
+        }
+        _first = best;
+        return best;
+    }
+
+};
+
+///scheduler with simulated time
+/**
+ * @tparam _TP type of time point
+ * @tparam Impl scheduler implementation (generic_scheduler or timer_wheel)
+ */
+template<typename _TP = std::chrono::system_clock::time_point,
+         typename Impl = generic_scheduler<awaitable<void>::result, _TP, const void *> >
 class manual_scheduler {
 public:
     using _Ident = const void *;
     using result_object = awaitable<void>::result;
 
+    manual_scheduler() = default;
+    ///construct with configured implementation
+    explicit manual_scheduler(Impl impl):_sch(std::move(impl)) {}
+
     awaitable<void> sleep_until(_TP tp, _Ident ident = {}) {
         return [this,tp=std::move(tp),ident](result_object r) mutable {
             _sch.schedule_at(std::move(r), std::move(tp), ident);
         };
     }
-    awaitable<void> sleep_until_alertable(alert_flag_type alert_flag, _TP tp) {
+    awaitable<void> sleep_until_alertable(alert_flag_type &alert_flag, _TP tp) {
         return [this,tp=std::move(tp),&alert_flag](result_object r) mutable -> prepared_coro {
             if (alert_flag) return r();
             _sch.schedule_at(std::move(r), std::move(tp), &alert_flag);
@@ -167,7 +492,7 @@ public:
         return sleep_until_alertable(alert_flag,  get_current_time()+dur);
     }
     ///retrive first scheduled time
-    std::optional<std::chrono::system_clock::time_point> get_first_scheduled_time() const {
+    std::optional<_TP> get_first_scheduled_time() const {
         return _sch.get_first_scheduled_time();
     }
     ///remove first scheduled coroutine
@@ -232,7 +557,7 @@ public:
       */
      void alert(alert_flag_type &alert_flag) {
          alert_flag.set();
-         _sch.set_time(&alert_flag, std::chrono::system_clock::now());
+         _sch.set_time(&alert_flag, _current_time);
      }
 
      ///retrieves current time
@@ -247,24 +572,40 @@ public:
       * If there is no coroutine before given target_time, returns empty object
       */
      prepared_coro advance_time_until(_TP target_time) {
-        _TP n = _sch.get_first_scheduled_time();
-        if (!n || *n>target_time) return {};
-        _current_time = std::max(target_time,n);
+        auto n = _sch.get_first_scheduled_time();
+        if (!n || *n>target_time) {
+            _current_time = std::max(_current_time, target_time);
+            return {};
+        }
+        _current_time = std::max(_current_time, *n);
         result_object r = _sch.remove_first();
         return r();
      }
 
 protected:
     _TP _current_time = {};
-    generic_scheduler<result_object, std::chrono::system_clock::time_point,_Ident> _sch;
+    Impl _sch;
 };
 
-class scheduler {
+///scheduler which runs in a thread
+/**
+ * @tparam Impl scheduler implementation. Default is generic_scheduler (binary heap),
+ * use timer_wheel if there is a lot of sleeps which are canceled or rescheduled
+ */
+template<typename Impl = generic_scheduler<awaitable<void>::result, std::chrono::system_clock::time_point, const void *> >
+class basic_scheduler {
 public:
 
     using _Ident = const void *;
     using result_object = typename awaitable<void>::result;
 
+    basic_scheduler() = default;
+    ///construct with configured implementation
+    /**
+     * @param impl instance of implementation, for example timer_wheel with custom tick
+     */
+    explicit basic_scheduler(Impl impl):_sch(std::move(impl)) {}
+
     ///sleep until given time
     /**
      * @param tp time point
@@ -296,7 +637,8 @@ public:
             if (alert_flag) {
                 return r();
             }
-            if (tp < _sch.get_first_scheduled_time()) _cv.notify_all();
+            auto n = _sch.get_first_scheduled_time();
+            if (!n || tp < *n) _cv.notify_all();
             _sch.schedule_at(std::move(r),std::move(tp),&alert_flag);
             return prepared_coro{};
         };
@@ -313,6 +655,27 @@ public:
         return sleep_until(std::chrono::system_clock::now()+dur, std::move(ident));
     }
 
+    ///sleep until given time, cancelable
+    /**
+     * @param tp time point
+     * @param tkn stop token. When signaled, the sleep is canceled and the awaitable is
+     * resolved with no value
+     * @return awaitable
+     */
+    awaitable<void> sleep_until(std::chrono::system_clock::time_point tp, std::stop_token tkn) {
+        return with_cancel<void>(std::move(tkn), [this, tp](_Ident id) {
+            return sleep_until(tp, id);
+        }, [this](_Ident id, awaitable<void> &) {
+            return cancel(id);
+        });
+    }
+
+    ///sleep for given time, cancelable
+    template<typename A, typename B>
+    awaitable<void> sleep_for(std::chrono::duration<A,B> dur, std::stop_token tkn) {
+        return sleep_until(std::chrono::system_clock::now()+dur, std::move(tkn));
+    }
+
     ///sleep coroutine but enable alert() feature
     /**
      * @param alert_flag a reference to flag which must be set to true for alert. If this flag is
@@ -368,6 +731,7 @@ public:
             if (tm) {
                 auto now =std::chrono::system_clock::now();
                 if (now > *tm) {
+                    MINICORO_TRACE::on_timer_fire(this, std::chrono::duration_cast<std::chrono::nanoseconds>(now - *tm));
                     auto r = _sch.remove_first();
                     lk.unlock();
                     executor(r);
@@ -492,8 +856,14 @@ public:
 protected:
     mutable std::mutex _mx;
     std::condition_variable _cv;
-    generic_scheduler<result_object, std::chrono::system_clock::time_point,_Ident> _sch;
+    Impl _sch;
 };
 
+///scheduler which uses binary heap
+using scheduler = basic_scheduler<>;
+
+///scheduler which uses hierarchical timer wheel
+using timer_wheel_scheduler = basic_scheduler<timer_wheel<awaitable<void>::result, std::chrono::system_clock::time_point> >;
+
 
 }
@@ -0,0 +1,332 @@
+#pragma once
+#include "coroutine.h"
+#include "coro_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+
+namespace MINICORO_NAMESPACE {
+
+///counting semaphore for coroutines
+/**
+ * The semaphore holds count of permits. The acquire() takes permits or waits until
+ * enough permits are released. The waiting coroutines are served in order of
+ * arrival. Waiting doesn't allocate memory, the request is stored in the temporary
+ * state of the awaitable (similar to coro_mutex)
+ *
+ * @code
+ * co_await sem.acquire();
+ * co_await backend_request();
+ * sem.release();
+ * @endcode
+ *
+ * Internally, the count of permits can be negative. The negative value is count of
+ * permits requested by waiting coroutines.
+ */
+class coro_semaphore {
+public:
+
+    ///construct semaphore
+    /**
+     * @param initial initial count of permits
+     */
+    explicit coro_semaphore(std::ptrdiff_t initial = 0):_count(initial) {}
+    coro_semaphore(const coro_semaphore &) = delete;
+    coro_semaphore &operator=(const coro_semaphore &) = delete;
+
+    ///try to acquire permits without waiting
+    /**
+     * @param n count of permits
+     * @retval true acquired
+     * @retval false not enough permits
+     */
+    bool try_acquire(std::ptrdiff_t n = 1) {
+        auto c = _count.load(std::memory_order_relaxed);
+        while (c >= n) {
+            if (_count.compare_exchange_weak(c, c - n, std::memory_order_acquire)) return true;
+        }
+        return false;
+    }
+
+    ///acquire permits
+    /**
+     * @param n count of permits
+     * @return awaitable, co_await to wait for permits
+     *
+     * @note The request is registered when co_await is initiated. You can discard
+     * return value to cancel the request before it is registered.
+     */
+    awaitable<void> acquire(std::ptrdiff_t n = 1) {
+        if (try_acquire(n)) return {};
+        return [this, n](awaitable<void>::result r) mutable -> prepared_coro {
+            if (!r) return {};
+            //copy captures, temp state overwrites the closure
+            auto me = this;
+            auto cnt = n;
+            auto s = awaitable<void>::get_temp_state<slot>(r);
+            if (!s) return {};
+            auto c = me->_count.fetch_sub(cnt, std::memory_order_acq_rel);
+            if (c >= cnt) return r();
+            //we took what was available, wait for the rest
+            s->_need = cnt - std::max<std::ptrdiff_t>(c, 0);
+            s->_resume = r.release();
+            s->_next = me->_requests.load(std::memory_order_relaxed);
+            while (!me->_requests.compare_exchange_weak(s->_next, s));
+            return me->resume_ready(me->process(), s);
+        };
+    }
+
+    ///release permits
+    /**
+     * @param n count of permits
+     *
+     * @note waiting coroutines are resumed in the current thread
+     */
+    void release(std::ptrdiff_t n = 1) {
+        auto c = _count.fetch_add(n, std::memory_order_acq_rel);
+        if (c >= 0) return;
+        //part of released permits belongs to waiting coroutines
+        _credit.fetch_add(std::min(n, -c));
+        resume_ready(process(), nullptr);
+    }
+
+    ///retrieve count of available permits
+    /**
+     * @return count of permits. Negative value is count of permits requested
+     * by waiting coroutines
+     */
+    std::ptrdiff_t available() const {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+protected:
+
+    //item of linked list of the requests and queue
+    struct slot {
+        //next item in linked list
+        slot *_next;
+        //pointer to awaitable to be resolved
+        awaitable<void> *_resume;
+        //count of permits still needed
+        std::ptrdiff_t _need;
+    };
+
+    //count of permits
+    std::atomic<std::ptrdiff_t> _count;
+    //stack of requests - added between processing
+    std::atomic<slot *> _requests = {};
+    //permits released for waiting coroutines, not yet assigned
+    std::atomic<std::ptrdiff_t> _credit = {0};
+    //true while a thread processes the queue
+    std::atomic<bool> _busy = {false};
+    //queue of requests - accessed only with _busy
+    slot *_queue = nullptr;
+    slot *_queue_last = nullptr;
+    //permits assigned to the first request in the queue
+    std::ptrdiff_t _front_credit = 0;
+
+    //assign credit to waiting requests, returns list of satisfied requests
+    slot *process() {
+        slot *ready = nullptr;
+        slot **ready_end = &ready;
+        do {
+            if (_busy.exchange(true)) break;
+            //append requests to the queue in order of arrival
+            slot *s = _requests.exchange(nullptr);
+            slot *chunk = nullptr;
+            slot *chunk_last = s;
+            while (s) {
+                auto n = s->_next;
+                s->_next = chunk;
+                chunk = s;
+                s = n;
+            }
+            if (chunk) {
+                if (_queue) _queue_last->_next = chunk; else _queue = chunk;
+                _queue_last = chunk_last;
+            }
+            _front_credit += _credit.exchange(0);
+            while (_queue && _front_credit >= _queue->_need) {
+                slot *f = _queue;
+                _front_credit -= f->_need;
+                _queue = f->_next;
+                f->_next = nullptr;
+                *ready_end = f;
+                ready_end = &f->_next;
+            }
+            _busy.store(false);
+            //recheck, other thread could fail to enter while we were busy
+        } while (_requests.load() || _credit.load());
+        return ready;
+    }
+
+    //resume satisfied requests, returns resumption of self
+    prepared_coro resume_ready(slot *ready, slot *self) {
+        prepared_coro out;
+        while (ready) {
+            //slot is destroyed by resolution, read next first
+            auto n = ready->_next;
+            bool is_self = ready == self;
+            awaitable<void>::result r(ready->_resume);
+            if (is_self) out = r();
+            else r().resume();
+            ready = n;
+        }
+        return out;
+    }
+};
+
+///token bucket rate limiter
+/**
+ * Tokens are refilled at constant rate up to burst size. The acquire() takes tokens
+ * or waits until enough tokens are refilled. While the bucket is not full, a single
+ * timer registered in the scheduler refills it.
+ *
+ * @tparam Scheduler scheduler which provides sleep_until(time_point, ident) and cancel(ident)
+ *
+ * @code
+ * scheduler sch;
+ * coro_rate_limiter lim(sch, 100, std::chrono::seconds(1), 10);
+ * co_await lim.acquire();
+ * @endcode
+ *
+ * @note scheduler must be running (in a thread) to refill waiting coroutines
+ */
+template<typename Scheduler = scheduler>
+class coro_rate_limiter {
+public:
+
+    using clock = std::chrono::system_clock;
+    using time_point = clock::time_point;
+
+    ///construct rate limiter
+    /**
+     * @param sch scheduler used for refill timer
+     * @param tokens count of tokens refilled per interval, must not be zero
+     * @param interval interval
+     * @param burst capacity of the bucket. The bucket is full at the beginning
+     * @exception std::invalid_argument tokens is zero
+     */
+    template<typename A, typename B>
+    coro_rate_limiter(Scheduler &sch, std::size_t tokens, std::chrono::duration<A,B> interval, std::size_t burst)
+        :_sch(sch)
+        ,_period(refill_period(tokens, std::chrono::duration_cast<clock::duration>(interval)))
+        ,_burst(static_cast<std::ptrdiff_t>(burst))
+        ,_sem(static_cast<std::ptrdiff_t>(burst))
+        ,_last(clock::now()) {}
+
+    coro_rate_limiter(const coro_rate_limiter &) = delete;
+    coro_rate_limiter &operator=(const coro_rate_limiter &) = delete;
+
+    ///destructor cancels the refill timer
+    /**
+     * @note there must be no waiting coroutines
+     */
+    ~coro_rate_limiter() {
+        _sch.cancel(this);
+    }
+
+    ///try to take tokens without waiting
+    /**
+     * @param n count of tokens
+     * @retval true taken
+     * @retval false not enough tokens
+     */
+    bool try_acquire(std::size_t n = 1) {
+        refill(clock::now());
+        bool ok = _sem.try_acquire(static_cast<std::ptrdiff_t>(n));
+        start_timer();
+        return ok;
+    }
+
+    ///take tokens
+    /**
+     * @param n count of tokens, must not be above burst
+     * @return awaitable, co_await to wait for tokens
+     */
+    awaitable<void> acquire(std::size_t n = 1) {
+        refill(clock::now());
+        auto awt = _sem.acquire(static_cast<std::ptrdiff_t>(n));
+        start_timer();
+        return awt;
+    }
+
+    ///retrieve count of available tokens (negative if there are waiting coroutines)
+    std::ptrdiff_t available() const {
+        return _sem.available();
+    }
+
+protected:
+
+    Scheduler &_sch;
+    clock::duration _period;
+    std::ptrdiff_t _burst;
+    coro_semaphore _sem;
+    std::mutex _mx;
+    time_point _last;
+    bool _timer_active = false;
+
+    //time to earn one token, at least one tick of the clock
+    static clock::duration refill_period(std::size_t tokens, clock::duration interval) {
+        if (!tokens) throw std::invalid_argument("coro_rate_limiter: count of tokens per interval must not be zero");
+        return std::max<clock::duration>(interval / tokens, clock::duration(1));
+    }
+
+    //refill timer, reschedules until the bucket is full
+    prepared_coro on_timer(awaitable<void> &awt) {
+        bool ok = awt.has_value();
+        if (!ok) return {};     //canceled
+        refill(clock::now());
+        time_point tp;
+        {
+            std::lock_guard _(_mx);
+            //stop when full, nobody can wait on full bucket
+            if (_sem.available() >= _burst) {
+                _timer_active = false;
+                return {};
+            }
+            tp = _last + _period;
+        }
+        return _timer_cb.await_cont(_sch.sleep_until(tp, this));
+    }
+
+    await_member_callback<void, coro_rate_limiter *, &coro_rate_limiter::on_timer> _timer_cb;
+
+    //add tokens earned since last refill
+    void refill(time_point now) {
+        std::ptrdiff_t earned;
+        {
+            std::lock_guard _(_mx);
+            if (now <= _last) return;
+            earned = static_cast<std::ptrdiff_t>((now - _last) / _period);
+            if (!earned) return;
+            _last += earned * _period;
+            auto avail = _sem.available();
+            if (avail + earned >= _burst) {
+                //bucket is full, don't accumulate
+                earned = std::max<std::ptrdiff_t>(_burst - avail, 0);
+                _last = now;
+            }
+        }
+        if (earned) _sem.release(earned);
+    }
+
+    //start timer if bucket is not full
+    void start_timer() {
+        time_point tp;
+        {
+            std::lock_guard _(_mx);
+            if (_timer_active || _sem.available() >= _burst) return;
+            _timer_active = true;
+            tp = _last + _period;
+        }
+        _timer_cb.await(_sch.sleep_until(tp, this), this);
+    }
+
+};
+
+}
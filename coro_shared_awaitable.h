@@ -0,0 +1,319 @@
+#pragma once
+
+#include "coroutine.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace MINICORO_NAMESPACE {
+
+///awaitable which can be awaited by multiple coroutines
+/**
+ * The object wraps an awaitable<T>. The operation is started when the object is
+ * constructed. Any count of coroutines can co_await the object concurrently,
+ * all of them are resumed once the operation is complete. The waiting coroutines
+ * receive the result by a const reference, the result is not copied.
+ *
+ * The object is a shared handle, you can copy it. The result is kept until the last
+ * copy is destroyed.
+ *
+ * Waiting doesn't allocate memory, the waiting coroutine is registered in a lock-free
+ * stack (similar to coro_mutex) and the node is stored in the awaiter. Waiting
+ * coroutines are resumed in order of arrival by the thread which completes
+ * the operation.
+ *
+ * @code
+ * shared_awaitable<Config> cfg(load_config());
+ * //in many coroutines
+ * const Config &c = co_await cfg;
+ * @endcode
+ *
+ * @note The reference is valid as long as the shared_awaitable exists.
+ *
+ * @tparam T type of result
+ */
+template<typename T>
+class shared_awaitable {
+public:
+
+    ///type returned by co_await
+    using result_ref = std::conditional_t<std::is_void_v<T>, void, std::add_lvalue_reference_t<const std::remove_reference_t<T> > >;
+
+    class awaiter;
+
+    ///shared state of the operation
+    /**
+     * The state can be extended to get notified about completion (see on_resolved())
+     */
+    class state {
+    public:
+        state() = default;
+        state(const state &) = delete;
+        state &operator=(const state &) = delete;
+        virtual ~state() = default;
+
+        ///start the operation
+        /**
+         * @param self shared pointer to this state, it is held until the operation is complete
+         * @param awt awaitable of the operation
+         */
+        void start(std::shared_ptr<state> self, awaitable<T> &&awt) {
+            _awt = std::move(awt);
+            _self = std::move(self);
+            _frame._owner = this;
+            if (_awt.await_ready()) {
+                resolved();
+            } else {
+                call_await_suspend(_awt, _frame.get_handle());
+            }
+        }
+
+        ///determine whether the operation is complete
+        bool is_ready() const {
+            return _waiters.load(std::memory_order_acquire) == get_resolved_mark();
+        }
+
+        ///retrieve result, operation must be complete
+        /**
+         * @return reference to the result
+         * @exception any exception thrown by the operation, await_canceled_exception when
+         * the awaitable has no value
+         */
+        result_ref get() {
+            if constexpr(std::is_void_v<T>) {
+                _awt.await_resume();
+            } else {
+                result_ref r = _awt.await_resume();
+                return r;
+            }
+        }
+
+    protected:
+
+        //item of linked list of waiting coroutines
+        struct node {
+            node *_next;
+            std::coroutine_handle<> _h;
+        };
+
+        //frame resumed when the operation is complete
+        struct frame: coro_frame<frame> { // @suppress("Miss copy constructor or assignment operator")
+            state *_owner = nullptr;
+            void do_resume() {_owner->resolved();}
+        };
+
+        constexpr static node resolved_mark = {};
+
+        awaitable<T> _awt = {nullptr};
+        //stack of waiting coroutines, resolved_mark when complete
+        std::atomic<node *> _waiters = {nullptr};
+        //keeps the state while operation is pending
+        std::shared_ptr<state> _self;
+        frame _frame;
+
+        static node *get_resolved_mark() {return const_cast<node *>(&resolved_mark);}
+
+        ///called when the operation is complete, before waiting coroutines are resumed
+        virtual void on_resolved() noexcept {}
+
+        //register waiting coroutine, returns false if the operation is already complete
+        bool add_waiter(node *n) {
+            n->_next = _waiters.load(std::memory_order_relaxed);
+            do {
+                if (n->_next == get_resolved_mark()) return false;
+            } while (!_waiters.compare_exchange_weak(n->_next, n, std::memory_order_release, std::memory_order_relaxed));
+            return true;
+        }
+
+        void resolved() {
+            //release the state after waiting coroutines are resumed
+            auto self = std::move(_self);
+            on_resolved();
+            node *lst = _waiters.exchange(get_resolved_mark(), std::memory_order_acq_rel);
+            //reverse to resume in order of arrival
+            node *queue = nullptr;
+            while (lst) {
+                auto n = lst->_next;
+                lst->_next = queue;
+                queue = lst;
+                lst = n;
+            }
+            while (queue) {
+                //node is destroyed by resumption, read next first
+                auto n = queue->_next;
+                queue->_h.resume();
+                queue = n;
+            }
+        }
+
+        friend class awaiter;
+    };
+
+    ///awaiter, created by co_await
+    class awaiter: protected state::node {
+    public:
+        awaiter(state *st):_st(st) {}
+        awaiter(const awaiter &) = delete;
+        awaiter &operator=(const awaiter &) = delete;
+
+        bool await_ready() const noexcept {return _st->is_ready();}
+        bool await_suspend(std::coroutine_handle<> h) {
+            this->_h = h;
+            return _st->add_waiter(this);
+        }
+        result_ref await_resume() {return _st->get();}
+
+    protected:
+        state *_st;
+    };
+
+    ///construct empty object
+    shared_awaitable() = default;
+
+    ///start the operation
+    /**
+     * @param awt awaitable of the operation
+     */
+    shared_awaitable(awaitable<T> &&awt):_st(std::make_shared<state>()) {
+        _st->start(_st, std::move(awt));
+    }
+
+    ///construct from a state
+    /**
+     * @param st state, it is not started. You need to call state::start()
+     */
+    explicit shared_awaitable(std::shared_ptr<state> st):_st(std::move(st)) {}
+
+    ///determine whether the operation is complete
+    bool is_ready() const {return _st->is_ready();}
+
+    ///determine whether the object is not empty
+    explicit operator bool() const {return _st != nullptr;}
+
+    ///co_await on the object
+    /**
+     * @note the object must exist until the awaiting coroutine is resumed
+     */
+    awaiter operator co_await() const {return awaiter(_st.get());}
+
+    ///wait synchronously
+    /**
+     * @return reference to the result
+     */
+    result_ref wait() const {
+        return sync_await(awaiter(_st.get()));
+    }
+
+protected:
+    std::shared_ptr<state> _st;
+};
+
+
+///coalesces concurrent requests for the same key to one operation
+/**
+ * When a result for the key is requested, and there is the same request in
+ * progress, the caller receives the pending operation. Otherwise new operation
+ * is started. The result is removed once the operation is complete, so a later
+ * request starts a new operation.
+ *
+ * @code
+ * single_flight<std::string, Row> flight;
+ *
+ * awaitable<Row> get_row(std::string key) {
+ *      auto res = flight.get(key, [](const std::string &k) {return db_fetch(k);});
+ *      const Row &row = co_await res;
+ *      co_return row;
+ * }
+ * @endcode
+ *
+ * @note The object can be destroyed while requests are pending. The pending
+ * operations complete normally, they are only no longer available to new requests.
+ *
+ * @tparam Key type of key
+ * @tparam T type of result
+ * @tparam Hash hash function of the key
+ * @tparam Equal comparison of the keys
+ * @tparam Lock lock which protects the map of pending requests
+ */
+template<typename Key, typename T, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>, typename Lock = std::mutex>
+class single_flight {
+public:
+
+    ///type of result
+    using result = shared_awaitable<T>;
+
+    single_flight() = default;
+    single_flight(const single_flight &) = delete;
+    single_flight &operator=(const single_flight &) = delete;
+
+    ///retrieve result for the key
+    /**
+     * @param key key
+     * @param fn function which receives the key and returns awaitable<T>. The function
+     * is called only when there is no pending operation for the key. It is called
+     * without holding the lock
+     * @return shared awaitable of the result
+     */
+    template<std::invocable<const Key &> Fn>
+    requires(std::is_convertible_v<std::invoke_result_t<Fn, const Key &>, awaitable<T> >)
+    result get(const Key &key, Fn &&fn) {
+        std::shared_ptr<entry> st;
+        {
+            std::lock_guard _(_reg->_mx);
+            auto iter = _reg->_pending.find(key);
+            if (iter != _reg->_pending.end()) return result(iter->second);
+            st = std::make_shared<entry>(_reg, key);
+            _reg->_pending.emplace(key, st);
+        }
+        awaitable<T> awt = {nullptr};
+        try {
+            awt = std::forward<Fn>(fn)(st->_key);
+        } catch (...) {
+            awt = awaitable<T>(std::current_exception());
+        }
+        st->start(st, std::move(awt));
+        return result(std::move(st));
+    }
+
+    ///count of pending operations
+    std::size_t in_flight() const {
+        std::lock_guard _(_reg->_mx);
+        return _reg->_pending.size();
+    }
+
+protected:
+
+    //map of pending requests, shared with the entries, so a request can
+    //complete after the single_flight is destroyed
+    struct registry {
+        mutable Lock _mx;
+        std::unordered_map<Key, std::shared_ptr<typename shared_awaitable<T>::state>, Hash, Equal> _pending;
+    };
+
+    class entry: public shared_awaitable<T>::state {
+    public:
+        entry(const std::shared_ptr<registry> &reg, const Key &key):_reg(reg), _key(key) {}
+
+        //weak, the registry holds the entry
+        std::weak_ptr<registry> _reg;
+        Key _key;
+
+    protected:
+        virtual void on_resolved() noexcept override {
+            auto reg = _reg.lock();
+            if (!reg) return;
+            std::lock_guard _(reg->_mx);
+            auto iter = reg->_pending.find(_key);
+            if (iter != reg->_pending.end() && iter->second.get() == this) {
+                reg->_pending.erase(iter);
+            }
+        }
+    };
+
+    std::shared_ptr<registry> _reg = std::make_shared<registry>();
+};
+
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+#include "coroutine.h"
+#include "coro_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace MINICORO_NAMESPACE {
+
+///load simulation in virtual time
+/**
+ * The simulation runs coroutines of simulated clients on manual_scheduler. Sleeps
+ * don't take real time, the scheduler jumps to the next scheduled time, so the
+ * simulation runs much faster than real time and it is deterministic
+ * for given seed.
+ *
+ * @code
+ * simulation<> sim(42);
+ * coro_queue<Request, 64> q;
+ * auto net = sim.lognormal(std::chrono::milliseconds(2), 0.5);
+ * sim.spawn(1000, [&](unsigned int) -> awaitable<void> {
+ *      for (int i = 0; i < 100; ++i) {
+ *          co_await sim.delay(net);
+ *          auto t0 = sim.now();
+ *          co_await q.push(Request{});
+ *          sim.record("enqueue", sim.now() - t0);
+ *      }
+ * });
+ * sim.sample("queue_depth", [&]{return q.size();});
+ * sim.run();
+ * sim.print_report(std::cout);
+ * @endcode
+ *
+ * @tparam TP type of time point
+ *
+ * @note the simulation is single threaded. Primitives under test don't need a lock
+ */
+template<typename TP = std::chrono::system_clock::time_point>
+class simulation {
+public:
+
+    using time_point = TP;
+    using duration = typename TP::duration;
+    using scheduler = manual_scheduler<TP>;
+    using random_engine = std::mt19937_64;
+    ///distribution of latency
+    using distribution = std::function<duration(random_engine &)>;
+
+    ///distribution of latencies (all samples are kept)
+    class histogram {
+    public:
+        ///record a sample
+        void record(duration d) {
+            _samples.push_back(d.count());
+            _sorted = false;
+        }
+        ///count of samples
+        std::size_t count() const {return _samples.size();}
+        ///retrieve percentile
+        /**
+         * @param q quantile (0.0 - 1.0), for example 0.99
+         * @return value of the percentile or zero if there are no samples
+         */
+        duration percentile(double q) const {
+            if (_samples.empty()) return duration::zero();
+            sort();
+            auto idx = static_cast<std::size_t>(std::ceil(q * static_cast<double>(_samples.size()))) ;
+            idx = std::clamp<std::size_t>(idx, 1, _samples.size()) - 1;
+            return duration(_samples[idx]);
+        }
+        ///average value
+        duration mean() const {
+            if (_samples.empty()) return duration::zero();
+            double sum = 0;
+            for (auto x: _samples) sum += static_cast<double>(x);
+            return duration(static_cast<typename duration::rep>(sum / static_cast<double>(_samples.size())));
+        }
+        ///maximum value
+        duration max() const {return percentile(1.0);}
+
+    protected:
+        mutable std::vector<typename duration::rep> _samples;
+        mutable bool _sorted = true;
+
+        void sort() const {
+            if (!_sorted) {
+                std::sort(_samples.begin(), _samples.end());
+                _sorted = true;
+            }
+        }
+    };
+
+    ///value which changes in time (for example depth of a queue)
+    class gauge {
+    public:
+        ///set new value
+        /**
+         * @param v value
+         * @param now current virtual time
+         */
+        void set(std::size_t v, time_point now) {
+            if (_started) {
+                _area += static_cast<double>(_value) * static_cast<double>((now - _last).count());
+            } else {
+                _first = now;
+                _started = true;
+            }
+            _last = now;
+            _value = v;
+            _max = std::max(_max, v);
+        }
+        ///current value
+        std::size_t value() const {return _value;}
+        ///maximal value
+        std::size_t max() const {return _max;}
+        ///average value weighted by time
+        double mean(time_point now) const {
+            auto total = static_cast<double>((now - _first).count());
+            if (!_started || total <= 0) return static_cast<double>(_value);
+            return (_area + static_cast<double>(_value) * static_cast<double>((now - _last).count())) / total;
+        }
+
+    protected:
+        std::size_t _value = 0;
+        std::size_t _max = 0;
+        double _area = 0;
+        time_point _first = {};
+        time_point _last = {};
+        bool _started = false;
+    };
+
+    ///construct the simulation
+    /**
+     * @param seed seed of random generator
+     */
+    explicit simulation(std::uint64_t seed = 1):_rnd(seed) {}
+
+    simulation(const simulation &) = delete;
+    simulation &operator=(const simulation &) = delete;
+
+    ///remaining clients are resumed with no value
+    ~simulation() {
+        while (_sch.get_first_scheduled_time()) _sch.remove_first();
+    }
+
+    ///access the scheduler (to pass it to the code under test)
+    scheduler &get_scheduler() {return _sch;}
+    ///access the random generator
+    random_engine &get_random() {return _rnd;}
+    ///current virtual time
+    time_point now() const {return _sch.get_current_time();}
+
+    ///sleep in virtual time
+    awaitable<void> sleep_for(duration d) {
+        return _sch.sleep_for(d);
+    }
+    ///sleep for random time
+    /**
+     * @param dist distribution of the latency
+     */
+    awaitable<void> delay(const distribution &dist) {
+        return _sch.sleep_for(std::max(duration::zero(), dist(_rnd)));
+    }
+
+    ///constant latency
+    static distribution constant(duration d) {
+        return [d](random_engine &) {return d;};
+    }
+    ///uniformly distributed latency
+    static distribution uniform(duration lo, duration hi) {
+        return [lo, hi](random_engine &rnd) {
+            std::uniform_int_distribution<typename duration::rep> dist(lo.count(), hi.count());
+            return duration(dist(rnd));
+        };
+    }
+    ///exponentially distributed latency (for example arrival of requests)
+    static distribution exponential(duration mean) {
+        return [mean](random_engine &rnd) {
+            std::exponential_distribution<double> dist(1.0 / static_cast<double>(mean.count()));
+            return duration(static_cast<typename duration::rep>(dist(rnd)));
+        };
+    }
+    ///lognormal latency, has long tail (typical network latency)
+    /**
+     * @param median median of latency
+     * @param sigma shape, higher value means longer tail
+     */
+    static distribution lognormal(duration median, double sigma) {
+        return [median, sigma](random_engine &rnd) {
+            std::lognormal_distribution<double> dist(std::log(static_cast<double>(median.count())), sigma);
+            return duration(static_cast<typename duration::rep>(dist(rnd)));
+        };
+    }
+
+    ///start simulated clients
+    /**
+     * @param count count of clients
+     * @param fn function which receives index of client and returns awaitable (coroutine)
+     * of the client. Clients are started immediately, they run until the first suspension.
+     * The function is kept by the simulation, so it can be a lambda coroutine with captures
+     */
+    template<std::invocable<unsigned int> Fn>
+    requires(std::is_convertible_v<std::invoke_result_t<Fn &, unsigned int>, awaitable<void> >)
+    void spawn(unsigned int count, Fn &&fn) {
+        auto &f = _factories.emplace_back(std::forward<Fn>(fn));
+        for (unsigned int i = 0; i < count; ++i) {
+            awaitable<void> awt = f(i);
+            ++_running;
+            awt >> [this](awaitable<void> &r) {
+                --_running;
+                try {
+                    r.await_resume();
+                } catch (...) {
+                    ++_errors;
+                }
+            };
+        }
+    }
+
+    ///record latency
+    /**
+     * @param name name of the histogram
+     * @param d measured latency
+     */
+    void record(const std::string &name, duration d) {
+        _histograms[name].record(d);
+    }
+
+    ///increase counter (for example count of processed requests)
+    void count(const std::string &name, std::size_t n = 1) {
+        _counters[name] += n;
+    }
+
+    ///measure latency of an operation
+    /**
+     * @param name name of histogram
+     * @param awt awaitable
+     * @return awaitable with the result of the operation
+     *
+     * @code
+     * auto own = co_await sim.measure("lock", mx.lock());
+     * @endcode
+     */
+    template<typename T>
+    awaitable<T> measure(std::string name, awaitable<T> awt) {
+        auto t0 = now();
+        if constexpr(std::is_void_v<T>) {
+            co_await awt;
+            record(name, now() - t0);
+        } else {
+            T r = co_await awt;
+            record(name, now() - t0);
+            co_return r;
+        }
+    }
+
+    ///sample a value after each event
+    /**
+     * @param name name of gauge
+     * @param probe function which returns current value (for example size of a queue)
+     */
+    template<std::invocable<> Fn>
+    void sample(const std::string &name, Fn &&probe) {
+        _probes.push_back({&_gauges[name], std::function<std::size_t()>(std::forward<Fn>(probe))});
+    }
+
+    ///retrieve histogram
+    histogram &get_histogram(const std::string &name) {return _histograms[name];}
+    ///retrieve gauge
+    gauge &get_gauge(const std::string &name) {return _gauges[name];}
+    ///retrieve counter
+    std::size_t get_counter(const std::string &name) const {
+        auto iter = _counters.find(name);
+        return iter == _counters.end() ? 0 : iter->second;
+    }
+
+    ///run the simulation
+    /**
+     * Resumes sleeping coroutines in order of the virtual time
+     *
+     * @param limit maximum virtual duration of the simulation
+     * @return count of processed events
+     */
+    std::size_t run(duration limit = duration::max()) {
+        auto start = now();
+        auto until = limit == duration::max() || start > time_point::max() - limit ? time_point::max() : start + limit;
+        std::size_t events = 0;
+        update_probes();
+        while (true) {
+            auto n = _sch.get_first_scheduled_time();
+            if (!n || *n > until) break;
+            _sch.advance_time_until(*n).resume();
+            ++events;
+            update_probes();
+        }
+        //time limit is reached, otherwise the time stays at the last event
+        if (until != time_point::max() && _sch.get_first_scheduled_time()) _sch.advance_time_until(until);
+        _events += events;
+        return events;
+    }
+
+    ///count of clients which haven't finished yet
+    std::size_t running() const {return _running;}
+    ///count of clients finished by an exception
+    std::size_t errors() const {return _errors;}
+
+    ///print report, one JSON object per line
+    /**
+     * Counters are reported with throughput per second of virtual time, histograms
+     * with percentiles, gauges with maximum and average
+     */
+    void print_report(std::ostream &out) const {
+        auto t = now();
+        double secs = std::chrono::duration<double>(t - time_point{}).count();
+        out << "{\"name\":\"simulation\",\"virtual_time_s\":" << secs
+            << ",\"events\":" << _events << ",\"running\":" << _running
+            << ",\"errors\":" << _errors << "}\n";
+        for (const auto &[name, cnt]: _counters) {
+            out << "{\"name\":\"" << name << "\",\"count\":" << cnt
+                << ",\"per_sec\":" << (secs > 0 ? static_cast<double>(cnt) / secs : 0.0) << "}\n";
+        }
+        for (const auto &[name, h]: _histograms) {
+            out << "{\"name\":\"" << name << "\",\"count\":" << h.count()
+                << ",\"mean_us\":" << to_us(h.mean())
+                << ",\"p50_us\":" << to_us(h.percentile(0.5))
+                << ",\"p99_us\":" << to_us(h.percentile(0.99))
+                << ",\"p999_us\":" << to_us(h.percentile(0.999))
+                << ",\"max_us\":" << to_us(h.max()) << "}\n";
+        }
+        for (const auto &[name, g]: _gauges) {
+            out << "{\"name\":\"" << name << "\",\"max\":" << g.max()
+                << ",\"mean\":" << g.mean(t) << "}\n";
+        }
+    }
+
+protected:
+
+    struct probe {
+        gauge *_gauge;
+        std::function<std::size_t()> _fn;
+    };
+
+    //clients refer to captures of their factories
+    std::deque<std::function<awaitable<void>(unsigned int)> > _factories;
+    scheduler _sch;
+    random_engine _rnd;
+    std::map<std::string, histogram> _histograms;
+    std::map<std::string, gauge> _gauges;
+    std::map<std::string, std::size_t> _counters;
+    std::vector<probe> _probes;
+    std::size_t _running = 0;
+    std::size_t _errors = 0;
+    std::size_t _events = 0;
+
+    void update_probes() {
+        auto t = now();
+        for (auto &p: _probes) p._gauge->set(p._fn(), t);
+    }
+
+    static double to_us(duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+};
+
+}
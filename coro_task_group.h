@@ -0,0 +1,188 @@
+#pragma once
+#include "coroutine.h"
+#include "coro_semaphore.h"
+
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <stop_token>
+
+namespace MINICORO_NAMESPACE {
+
+///group of concurrently running tasks with bounded parallelism
+/**
+ * The group starts tasks (awaitables), limits count of tasks running at once and
+ * allows to join all of them.
+ *
+ * @code
+ * task_group grp(8);
+ * for (auto &req: requests) {
+ *      co_await grp.spawn(process(req));   //suspends while 8 tasks are running
+ * }
+ * co_await grp.join();                     //rethrows first exception
+ * @endcode
+ *
+ * When a task throws an exception, the group is canceled. Tasks which are not
+ * started yet are dropped (spawn() doesn't start them), running tasks can
+ * test cancellation through the stop token (get_stop_token()). The first exception
+ * is rethrown by join(). A task resolved without value is not considered
+ * as failure.
+ *
+ * After join() completes, the group can be used again.
+ *
+ * @note destructor waits for running tasks, exception is ignored in this case
+ */
+class task_group {
+public:
+
+    static constexpr std::size_t unlimited = static_cast<std::size_t>(std::numeric_limits<std::ptrdiff_t>::max() / 2);
+
+    ///construct the group
+    /**
+     * @param limit maximum count of running tasks
+     */
+    explicit task_group(std::size_t limit = unlimited)
+        :_sem(static_cast<std::ptrdiff_t>(limit)) {}
+
+    task_group(const task_group &) = delete;
+    task_group &operator=(const task_group &) = delete;
+
+    ~task_group() {
+        if (_count.load(std::memory_order_acquire) > 1) {
+            try {
+                join().wait();
+            } catch (...) {
+                //ignored
+            }
+        }
+    }
+
+    ///start a task
+    /**
+     * @param task task to start. It can be a lazy coroutine, which is started here.
+     * @return awaitable, which is ready when the task was started. If the limit
+     * of running tasks is reached, the awaitable is resolved when the task can be
+     * started. You should co_await on the result to apply backpressure.
+     *
+     * @note if the group is canceled, the task is not started, the awaitable is still
+     * resolved normally. The task is started even if the return value is discarded.
+     */
+    template<typename T>
+    awaitable<void> spawn(awaitable<T> task) {
+        if (_sem.try_acquire()) {
+            start(std::move(task));
+            return {};
+        }
+        return spawn_slow(std::move(task));
+    }
+
+    ///wait for all tasks
+    /**
+     * @return awaitable, resolved when all tasks are finished. If any task has thrown
+     * an exception, the first exception is rethrown
+     */
+    awaitable<void> join() {
+        return [this](awaitable<void>::result r) -> prepared_coro {
+            if (!r) return {};
+            auto me = this;
+            me->_join = std::move(r);
+            return me->finish();
+        };
+    }
+
+    ///retrieve stop token, which is signaled, when the group is canceled
+    std::stop_token get_stop_token() const {
+        std::lock_guard _(_mx);
+        return _stop.get_token();
+    }
+
+    ///cancel the group
+    /**
+     * Not yet started tasks are dropped, stop token is signaled
+     */
+    void cancel() {
+        std::lock_guard _(_mx);
+        _canceled.store(true, std::memory_order_relaxed);
+        _stop.request_stop();
+    }
+
+    ///determine whether group is canceled
+    bool is_canceled() const {
+        return _canceled.load(std::memory_order_relaxed);
+    }
+
+    ///retrieve count of running tasks
+    std::size_t running() const {
+        return _count.load(std::memory_order_relaxed) - 1;
+    }
+
+protected:
+
+    mutable std::mutex _mx;
+    coro_semaphore _sem;
+    //count of running tasks + 1 (released by join)
+    std::atomic<std::size_t> _count = {1};
+    std::atomic<bool> _canceled = {false};
+    std::stop_source _stop;
+    std::exception_ptr _exception;
+    awaitable<void>::result _join;
+
+    template<typename T>
+    awaitable<void> spawn_slow(awaitable<T> task) {
+        co_await _sem.acquire();
+        start(std::move(task));
+    }
+
+    template<typename T>
+    void start(awaitable<T> &&task) {
+        if (is_canceled()) {
+            //prevent start in detached mode
+            task.cancel();
+            _sem.release();
+            return;
+        }
+        _count.fetch_add(1, std::memory_order_relaxed);
+        awaitable<T> t = std::move(task);
+        t >> [this](awaitable<T> &r) {
+            try {
+                r.await_resume();
+            } catch (const await_canceled_exception &) {
+                //task without value is not failure
+            } catch (...) {
+                set_exception(std::current_exception());
+            }
+            _sem.release();
+            finish();
+        };
+    }
+
+    void set_exception(std::exception_ptr e) {
+        std::lock_guard _(_mx);
+        if (!_exception) _exception = std::move(e);
+        _canceled.store(true, std::memory_order_relaxed);
+        _stop.request_stop();
+    }
+
+    prepared_coro finish() {
+        //the last reference is not released, it becomes the reference of the
+        //next join(). So the count never drops to zero and concurrent spawn()
+        //can't be overwritten by a reset
+        std::size_t c = _count.load(std::memory_order_acquire);
+        do {
+            if (c == 1) break;
+        } while (!_count.compare_exchange_weak(c, c - 1, std::memory_order_acq_rel, std::memory_order_acquire));
+        if (c != 1) return {};
+        //all done, prepare for reuse and resume joining coroutine
+        std::exception_ptr e;
+        awaitable<void>::result r = std::move(_join);
+        {
+            std::lock_guard _(_mx);
+            e = std::exchange(_exception, nullptr);
+            if (_canceled.exchange(false, std::memory_order_relaxed)) _stop = std::stop_source();
+        }
+        if (e) return r = e;
+        return r();
+    }
+};
+
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include "coroutine.h"
+#include "coro_executor.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MINICORO_NAMESPACE {
+
+///lock-free work stealing deque (Chase-Lev) of coroutine handles
+/**
+ * The owner thread pushes and pops items at the bottom, other threads can steal
+ * items from the top. The capacity is fixed, push() returns false when the
+ * deque is full, so the caller must handle overflow.
+ *
+ * @tparam capacity capacity of the deque, must be power of two
+ */
+template<unsigned int capacity = 1024>
+class work_stealing_deque {
+public:
+
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be power of two");
+
+    ///push item to the bottom (owner only)
+    /**
+     * @param item address of coroutine (must not be nullptr)
+     * @retval true pushed
+     * @retval false deque is full
+     */
+    bool push(void *item) {
+        auto b = _bottom.load(std::memory_order_relaxed);
+        auto t = _top.load(std::memory_order_acquire);
+        if (b - t >= static_cast<std::int64_t>(capacity)) return false;
+        _items[b & mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    ///pop item from the bottom (owner only)
+    /**
+     * @return address of coroutine, or nullptr if empty
+     */
+    void *pop() {
+        auto b = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = _top.load(std::memory_order_relaxed);
+        if (t > b) {
+            //empty
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        void *item = _items[b & mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            //last item, race with thieves
+            if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    ///steal item from the top (any thread)
+    /**
+     * @return address of coroutine, or nullptr if empty or if the race has been lost
+     */
+    void *steal() {
+        auto t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = _bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        void *item = _items[t & mask].load(std::memory_order_relaxed);
+        if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    ///determine whether deque is empty (approximate when called by non-owner)
+    bool empty() const {
+        return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+    }
+
+protected:
+    static constexpr std::int64_t mask = capacity - 1;
+
+    alignas(64) std::atomic<std::int64_t> _top = {0};
+    alignas(64) std::atomic<std::int64_t> _bottom = {0};
+    std::atomic<void *> _items[capacity] = {};
+};
+
+
+///thread pool which executes coroutines
+/**
+ * Each worker has own lock-free deque. Coroutines scheduled from a worker thread
+ * are pushed to its deque, idle workers steal work from others. Coroutines
+ * scheduled from other threads are distributed round-robin to inboxes of the
+ * workers, each inbox has own lock, so there is no global lock.
+ *
+ * @code
+ * coro_thread_pool pool(8);
+ * co_await pool.schedule();    //continue in the pool
+ * @endcode
+ *
+ * The pool can be used as executor of the scheduler
+ *
+ * @code
+ * auto thr = sch.create_thread([&](auto &&r){pool(r);});
+ * @endcode
+ *
+ * @note Destroy (or stop) the pool before any object used by running coroutines
+ */
+class coro_thread_pool {
+public:
+
+    using result_object = awaitable<void>::result;
+    using prepared = std::vector<prepared_coro>;
+
+    ///awaiter which moves the coroutine into the pool
+    struct schedule_awaiter {
+        coro_thread_pool *_pool;
+        static constexpr bool await_ready() noexcept {return false;}
+        void await_suspend(std::coroutine_handle<> h) {_pool->post(h);}
+        static constexpr void await_resume() noexcept {}
+    };
+
+    ///start the pool
+    /**
+     * @param threads count of worker threads
+     */
+    explicit coro_thread_pool(unsigned int threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) threads = 1;
+        _workers.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i) _workers.push_back(std::make_unique<worker>());
+        _threads.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i) _threads.emplace_back([this, i]{worker_loop(i);});
+    }
+
+    coro_thread_pool(const coro_thread_pool &) = delete;
+    coro_thread_pool &operator=(const coro_thread_pool &) = delete;
+
+    ///destructor stops the pool
+    ~coro_thread_pool() {
+        stop();
+    }
+
+    ///schedule coroutine for execution in the pool
+    /**
+     * @param h handle of suspended coroutine
+     */
+    void post(std::coroutine_handle<> h) {
+        if (!_running.load(std::memory_order_acquire)) {
+            h.resume();
+            return;
+        }
+        worker *w = _current_worker;
+        if (w && _current_pool == this) {
+            if (w->_local.push(h.address())) {
+                notify();
+                return;
+            }
+        } else {
+            w = _workers[_next.fetch_add(1, std::memory_order_relaxed) % _workers.size()].get();
+        }
+        {
+            std::lock_guard _(w->_inbox_mx);
+            w->_inbox.push_back(h.address());
+            w->_has_inbox.store(true, std::memory_order_relaxed);
+        }
+        notify();
+    }
+
+    ///schedule prepared coroutine for execution in the pool
+    /**
+     * @param c prepared coroutine, if empty, nothing is scheduled
+     */
+    void post(prepared_coro &&c) {
+        if (c) post(c.symmetric_transfer());
+    }
+
+    ///schedule all prepared coroutines
+    /**
+     * Coroutines are spread over all workers, each inbox is locked once
+     *
+     * @param buffer buffer of prepared coroutines (for example from distributor::broadcast).
+     * The buffer is cleared
+     */
+    void post(prepared &buffer) {
+        if (!_running.load(std::memory_order_acquire)) {
+            buffer.clear();
+            return;
+        }
+        auto cnt = _workers.size();
+        auto start = _next.fetch_add(1, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < cnt; ++i) {
+            worker &w = *_workers[(start + i) % cnt];
+            bool any = false;
+            {
+                std::lock_guard _(w._inbox_mx);
+                for (std::size_t j = i; j < buffer.size(); j += cnt) {
+                    if (buffer[j]) {
+                        w._inbox.push_back(buffer[j].symmetric_transfer().address());
+                        any = true;
+                    }
+                }
+                if (any) w._has_inbox.store(true, std::memory_order_relaxed);
+            }
+            if (any) notify();
+        }
+        buffer.clear();
+    }
+
+    ///executor interface - resolves result object and schedules the coroutine
+    /**
+     * Allows to use the pool as executor for scheduler::run_thread() or
+     * scheduler::create_thread()
+     *
+     * @param r result object
+     */
+    void operator()(result_object &r) {
+        post(r());
+    }
+
+    ///executor interface - resolves result object and schedules the coroutine
+    void operator()(result_object &&r) {
+        post(r());
+    }
+
+    ///executor interface - schedules prepared coroutine
+    void operator()(prepared_coro &&c) {
+        post(std::move(c));
+    }
+
+    ///switch the coroutine to the pool
+    /**
+     * @code
+     * co_await pool.schedule();
+     * @endcode
+     * @return awaiter
+     */
+    schedule_awaiter schedule() {
+        return {this};
+    }
+
+    ///determines whether current thread is worker of this pool
+    bool is_current() const {
+        return _current_pool == this;
+    }
+
+    ///retrieve count of workers
+    unsigned int size() const {
+        return static_cast<unsigned int>(_workers.size());
+    }
+
+    ///stop the pool
+    /**
+     * Workers finish all scheduled coroutines and exit. Function waits
+     * for the workers. Coroutines scheduled after the pool is stopped
+     * are resumed in the calling thread.
+     *
+     * @note must not be called from a worker thread
+     */
+    void stop() {
+        if (!_running.exchange(false, std::memory_order_acq_rel)) return;
+        _epoch.fetch_add(1, std::memory_order_seq_cst);
+        _epoch.notify_all();
+        for (auto &t: _threads) t.join();
+        _threads.clear();
+        //resume leftovers in this thread
+        for (auto &w: _workers) {
+            while (void *item = w->_local.steal()) {
+                std::coroutine_handle<>::from_address(item).resume();
+            }
+            std::vector<void *> inbox;
+            {
+                std::lock_guard _(w->_inbox_mx);
+                std::swap(inbox, w->_inbox);
+            }
+            for (void *item: inbox) std::coroutine_handle<>::from_address(item).resume();
+        }
+    }
+
+protected:
+
+    struct worker {
+        work_stealing_deque<> _local;
+        std::mutex _inbox_mx;
+        std::vector<void *> _inbox;
+        std::atomic<bool> _has_inbox = {false};
+    };
+
+    std::vector<std::unique_ptr<worker> > _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<bool> _running = {true};
+    std::atomic<std::size_t> _next = {0};
+    std::atomic<unsigned int> _sleeping = {0};
+    std::atomic<std::uint32_t> _epoch = {0};
+
+    static inline thread_local coro_thread_pool *_current_pool = nullptr;
+    static inline thread_local worker *_current_worker = nullptr;
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleeping.load(std::memory_order_seq_cst)) {
+            _epoch.fetch_add(1, std::memory_order_seq_cst);
+            _epoch.notify_one();
+        }
+    }
+
+    //move whole inbox of the worker to own deque, return one item
+    void *take_inbox(worker &from, worker &to, bool block) {
+        if (!from._has_inbox.load(std::memory_order_relaxed)) return nullptr;
+        std::unique_lock lk(from._inbox_mx, std::defer_lock);
+        if (block) lk.lock(); else if (!lk.try_lock()) return nullptr;
+        if (from._inbox.empty()) return nullptr;
+        void *out = from._inbox.back();
+        from._inbox.pop_back();
+        while (!from._inbox.empty() && to._local.push(from._inbox.back())) {
+            from._inbox.pop_back();
+        }
+        from._has_inbox.store(!from._inbox.empty(), std::memory_order_relaxed);
+        return out;
+    }
+
+    void *find_work(worker &w, unsigned int idx, std::uint32_t &rnd) {
+        void *item = w._local.pop();
+        if (item) return item;
+        item = take_inbox(w, w, true);
+        if (item) return item;
+        auto cnt = static_cast<unsigned int>(_workers.size());
+        //xorshift to choose first victim
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 17;
+        rnd ^= rnd << 5;
+        for (unsigned int i = 0; i < cnt; ++i) {
+            unsigned int v = (rnd + i) % cnt;
+            if (v == idx) continue;
+            worker &victim = *_workers[v];
+            item = victim._local.steal();
+            if (item) return item;
+            item = take_inbox(victim, w, false);
+            if (item) return item;
+        }
+        return nullptr;
+    }
+
+    void worker_loop(unsigned int idx) {
+        worker &w = *_workers[idx];
+        _current_pool = this;
+        _current_worker = &w;
+        executor_scope scope(*this);
+        std::uint32_t rnd = idx * 2654435761u + 1;
+        while (true) {
+            void *item = find_work(w, idx, rnd);
+            if (!item) {
+                //prepare to sleep, check queues again to avoid lost wakeup
+                _sleeping.fetch_add(1, std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                auto epoch = _epoch.load(std::memory_order_seq_cst);
+                item = find_work(w, idx, rnd);
+                if (!item) {
+                    if (!_running.load(std::memory_order_acquire)) {
+                        _sleeping.fetch_sub(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    _epoch.wait(epoch, std::memory_order_seq_cst);
+                }
+                _sleeping.fetch_sub(1, std::memory_order_relaxed);
+                if (!item) continue;
+            }
+            std::coroutine_handle<>::from_address(item).resume();
+        }
+        _current_worker = nullptr;
+        _current_pool = nullptr;
+    }
+
+};
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <chrono>
+#include <coroutine>
+
+#ifndef MINICORO_NAMESPACE
+#define MINICORO_NAMESPACE minicoro
+#endif
+
+/**
+ * @file coro_trace.h instrumentation hooks
+ *
+ * The library calls static functions of the type defined by the macro MINICORO_TRACE
+ * on selected events. The default type is trace_noop, which does nothing, so
+ * the calls are optimized out.
+ *
+ * To install own hooks, derive a struct from trace_noop, override (hide) the functions
+ * you need and define MINICORO_TRACE before any other header of the library is included
+ *
+ * @code
+ * #include <minicoro/coro_trace.h>
+ * struct my_trace: minicoro::trace_noop {
+ *      static void on_suspend(const void *awt, std::coroutine_handle<> h);
+ *      static void on_resume(const void *awt);
+ * };
+ * #define MINICORO_TRACE my_trace
+ * #include <minicoro/coroutine.h>
+ * @endcode
+ *
+ * @note all hooks must be thread safe, they are called from any thread
+ */
+
+namespace MINICORO_NAMESPACE {
+
+///default hooks, does nothing
+struct trace_noop {
+    ///coroutine frame has been created
+    /**
+     * @param promise address of the promise (unique while coroutine exists)
+     */
+    static void on_coro_create(const void *promise) noexcept {(void)promise;}
+    ///coroutine frame is being destroyed
+    static void on_coro_destroy(const void *promise) noexcept {(void)promise;}
+    ///coroutine is being suspended on an awaitable which is not ready
+    /**
+     * @param awt address of the awaitable
+     * @param h suspended coroutine
+     */
+    static void on_suspend(const void *awt, std::coroutine_handle<> h) noexcept {(void)awt;(void)h;}
+    ///result of the awaitable is being retrieved (after resume, or without suspension)
+    static void on_resume(const void *awt) noexcept {(void)awt;}
+    ///prepared coroutine is being resumed
+    static void on_prepared_resume(std::coroutine_handle<> h) noexcept {(void)h;}
+    ///coroutine failed to lock the mutex immediately and starts waiting
+    /**
+     * @param mx address of the mutex
+     * @param awt address of the awaitable, which is resolved once the lock is acquired
+     */
+    static void on_mutex_wait(const void *mx, const void *awt) noexcept {(void)mx;(void)awt;}
+    ///waiting coroutine acquired ownership (called before it is resumed, it can be in other thread)
+    static void on_mutex_acquire(const void *mx, const void *awt) noexcept {(void)mx;(void)awt;}
+    ///coroutine has been parked in a queue
+    /**
+     * @param queue address of the queue
+     * @param waiter identification of parked coroutine (unique while it is parked)
+     * @param producer true for parked push, false for parked pop
+     */
+    static void on_queue_park(const void *queue, const void *waiter, bool producer) noexcept {(void)queue;(void)waiter;(void)producer;}
+    ///parked coroutine is being released
+    static void on_queue_unpark(const void *waiter, bool producer) noexcept {(void)waiter;(void)producer;}
+    ///scheduler fires a timer
+    /**
+     * @param sch address of the scheduler
+     * @param late delay between scheduled time and actual time of the firing
+     */
+    static void on_timer_fire(const void *sch, std::chrono::nanoseconds late) noexcept {(void)sch;(void)late;}
+};
+
+}
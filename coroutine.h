@@ -99,12 +99,29 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include <deque>
 #include <optional>
 #include <span>
+#include <array>
 #include <atomic>
+#include <vector>
+#include "coro_trace.h"
 
 #ifndef MINICORO_NAMESPACE
 #define MINICORO_NAMESPACE minicoro
 #endif
 
+///type which receives instrumentation events (see coro_trace.h)
+#ifndef MINICORO_TRACE
+#define MINICORO_TRACE MINICORO_NAMESPACE::trace_noop
+#endif
+
+///default count of pointers which fits to inline space of the awaitable
+/**
+ * Callbacks which don't fit to this space are allocated on heap. Define
+ * before including the header to change the default for all awaitables
+ */
+#ifndef MINICORO_CALLBACK_INLINE_PTRS
+#define MINICORO_CALLBACK_INLINE_PTRS 4
+#endif
+
 
 namespace MINICORO_NAMESPACE {
 
@@ -213,6 +230,21 @@ concept is_member_fn_call_for_result = requires(T val, Obj obj, Fn fn) {
     {((*obj).*fn)(std::move(val))};
 };
 
+///defines size of inline space for callbacks and temporary state of awaitable<T>
+/**
+ * Specialize this template to change the size for particular T. The
+ * final size is never less than size of the result
+ *
+ * @code
+ * template<> struct minicoro::awaitable_inline_size<my_result>
+ *      : std::integral_constant<std::size_t, 8 * sizeof(void *)> {};
+ * @endcode
+ *
+ * @note the specialization must be visible before awaitable<T> is instantiated
+ */
+template<typename T>
+struct awaitable_inline_size: std::integral_constant<std::size_t, sizeof(void *) * MINICORO_CALLBACK_INLINE_PTRS> {};
+
 template<typename T> class awaitable;
 template<typename T, std::invocable<awaitable<T> &> _CB, coro_allocator _Allocator = objstdalloc> class awaiting_callback;
 template<typename T, coro_allocator _Allocator = objstdalloc> class coroutine;
@@ -255,11 +287,11 @@ public:
 
     ///resume
     void resume(){
-        if (*this) std::coroutine_handle<>::from_address(_coro.release()).resume();
+        if (*this) resume_handle(_coro.release());
     }
     ///resume
     void operator()() {
-        if (*this) std::coroutine_handle<>::from_address(_coro.release()).resume();
+        if (*this) resume_handle(_coro.release());
     }
     ///destroy coroutine
     void destroy(){
@@ -268,19 +300,135 @@ public:
     ///release handle and return it for symmetric transfer
     std::coroutine_handle<> symmetric_transfer(){
         if (!_coro) return std::noop_coroutine();
-        return std::coroutine_handle<>::from_address(_coro.release());
+        auto h = std::coroutine_handle<>::from_address(_coro.release());
+        MINICORO_TRACE::on_prepared_resume(h);
+        return h;
     }
 
 protected:
+    static void resume_handle(void *ptr) {
+        auto h = std::coroutine_handle<>::from_address(ptr);
+        MINICORO_TRACE::on_prepared_resume(h);
+        h.resume();
+    }
+
     struct deleter{
         void operator()(void *ptr) {
-            std::coroutine_handle<>::from_address(ptr).resume();
+            resume_handle(ptr);
         }
     };
 
     std::unique_ptr<void,deleter> _coro;
 };
 
+///list of prepared coroutines resumed iteratively
+/**
+ * Primitives which wake multiple coroutines append them to the list, the
+ * coroutines are resumed later by resume_all() (or by the destructor), one after other.
+ * If a resumed coroutine appends to the same list (for example it broadcasts again),
+ * the new coroutines are resumed by the same loop instead of a nested call, so the
+ * stack doesn't grow.
+ *
+ * First coroutines are stored inline, the rest is stored in a buffer which is
+ * kept for reuse, so a list which is reused doesn't allocate.
+ *
+ * @code
+ * resume_list lst;
+ * queue.set_closed(e, lst);
+ * dist.broadcast(lst, value);
+ * lst.resume_all();
+ * @endcode
+ *
+ * @note the object is not MT-Safe
+ */
+class resume_list {
+public:
+
+    ///count of coroutines stored inline
+    static constexpr std::size_t inline_count = 16;
+
+    resume_list() = default;
+    resume_list(const resume_list &) = delete;
+    resume_list &operator=(const resume_list &) = delete;
+
+    ///destructor resumes all coroutines
+    ~resume_list() {
+        resume_all();
+    }
+
+    ///append prepared coroutine
+    /**
+     * @param c prepared coroutine, empty object is ignored
+     */
+    void push(prepared_coro &&c) {
+        if (!c) return;
+        if (_count < inline_count) {
+            _inline[_count] = std::move(c);
+        } else {
+            _overflow.push_back(std::move(c));
+        }
+        ++_count;
+    }
+
+    ///append prepared coroutine
+    resume_list &operator<<(prepared_coro &&c) {
+        push(std::move(c));
+        return *this;
+    }
+
+    ///determine whether the list is empty
+    bool empty() const {
+        return _count == _pos;
+    }
+
+    ///count of coroutines waiting for resumption
+    std::size_t size() const {
+        return _count - _pos;
+    }
+
+    ///resume all coroutines
+    /**
+     * Coroutines are resumed in order of appending. If called from a coroutine
+     * resumed by this list, the function returns immediately, the outer loop continues
+     * with remaining coroutines. Resumed entries are reused, so a chain of coroutines
+     * which keeps appending while the list is drained doesn't grow the storage
+     */
+    void resume_all() {
+        if (_draining) return;
+        _draining = true;
+        while (_pos < _count) {
+            if (_pos >= inline_count && _pos >= _count - _pos) compact();
+            prepared_coro c = std::move(at(_pos++));
+            c.resume();
+        }
+        _pos = _count = 0;
+        _overflow.clear();
+        _draining = false;
+    }
+
+protected:
+    prepared_coro _inline[inline_count];
+    std::vector<prepared_coro> _overflow;
+    std::size_t _count = 0;
+    std::size_t _pos = 0;
+    bool _draining = false;
+
+    prepared_coro &at(std::size_t idx) {
+        return idx < inline_count ? _inline[idx] : _overflow[idx - inline_count];
+    }
+
+    //move pending coroutines to the beginning. Called when at least as many
+    //entries are resumed as pending, so the cost is amortized O(1)
+    void compact() {
+        std::size_t rem = _count - _pos;
+        //targets are already resumed (empty), sources are always behind targets
+        for (std::size_t i = 0; i < rem; ++i) at(i) = std::move(at(_pos + i));
+        _overflow.erase(_overflow.begin() + static_cast<std::ptrdiff_t>(rem > inline_count ? rem - inline_count : 0), _overflow.end());
+        _pos = 0;
+        _count = rem;
+    }
+};
+
 
 /// perform call await_suspend and switch to different coroutine manually
 /** 
@@ -414,8 +562,11 @@ public:
 
         };
 
-        promise_type() = default;
+        promise_type() {
+            MINICORO_TRACE::on_coro_create(this);
+        }
         ~promise_type() {
+            MINICORO_TRACE::on_coro_destroy(this);
             this->wakeup();
         }
 
@@ -616,6 +767,11 @@ public:
     using result = awaitable_result<T>;
     ///allows to use awaitable to write coroutines
     using promise_type = coroutine<T>::promise_type;
+    ///size of space reserved for the temporary state in bytes (see get_temp_state())
+    /**
+     * @see awaitable_inline_size, MINICORO_CALLBACK_INLINE_PTRS
+     */
+    static constexpr std::size_t temp_state_size = std::max(awaitable_inline_size<T>::value, sizeof(store_type));
 
     ///virtual interface to execute callback for resolution
     class ICallback {
@@ -678,7 +834,9 @@ public:
 
     ///construct containing result constructed by arguments
     template<typename ... Args>
-    requires (std::is_constructible_v<store_type, Args...> && (!std::is_same_v<std::remove_reference_t<Args>, awaitable> && ...))
+    requires (std::is_constructible_v<store_type, Args...>
+            && (!std::is_same_v<std::remove_reference_t<Args>, awaitable> && ...)
+            && (!std::is_base_of_v<coroutine<T>, std::remove_cvref_t<Args> > && ...))
     awaitable(Args &&... args)
         :_state(value),_value(std::forward<Args>(args)...) {}
 
@@ -781,6 +939,7 @@ public:
 
     ///returns value of resolved awaitable
     std::add_rvalue_reference_t<T> await_resume() {
+        MINICORO_TRACE::on_resume(this);
         if (_state == value) {
             if constexpr(std::is_void_v<T>) {
                 return;
@@ -808,6 +967,9 @@ public:
      */
     std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
         _owner = h;
+        if (_state == coro || _state == callback || _state == callback_ptr) {
+            MINICORO_TRACE::on_suspend(this, h);
+        }
         if (_state == coro) {
             return _coro.start(result(this)).symmetric_transfer();
         } else if (_state == callback) {
@@ -989,7 +1151,7 @@ public:
      *
      * @note space reserved for the state is equal to
      * size of T (result), but never less than
-     * 4x size of pointer. The function checks in compile
+     * awaitable_inline_size<T> (4x size of pointer by default). The function checks in compile
      * time whether the type X fits to the buffer
      */
     template<typename X>
@@ -1004,6 +1166,33 @@ public:
         return reinterpret_cast<X *>(me->_callback_space);
     }
 
+    ///retrieve address of the temporary state of given awaitable
+    /**
+     * Allows a primitive to find own request (allocated by get_temp_state()) by
+     * the awaitable. The address is only calculated, the memory is not accessed, so
+     * it can be compared with addresses of pending requests
+     *
+     * @param awt awaitable
+     * @return address of the temporary state
+     */
+    static const void *get_temp_state_address(const awaitable &awt) {
+        return awt._callback_space;
+    }
+
+    ///determine whether the temporary state of given awaitable can be in use
+    /**
+     * The temporary state exists only while the awaitable is not resolved. When a primitive
+     * resolves its requests under a lock, it can test under the same lock whether
+     * the request is still pending, instead of searching for its address.
+     *
+     * @param awt awaitable
+     * @retval true awaitable is not resolved yet, or it is resolved with no value
+     * @retval false awaitable has a value or an exception, the temporary state no longer exists
+     */
+    static bool can_have_temp_state(const awaitable &awt) {
+        return awt._state == no_value;
+    }
+
 protected:
 
     enum State {
@@ -1022,7 +1211,7 @@ protected:
     };
 
 
-    static constexpr auto callback_max_size = std::max(sizeof(void *) * 4, sizeof(store_type));
+    static constexpr auto callback_max_size = temp_state_size;
 
     ///current state of object
     State _state = no_value;
@@ -1713,6 +1902,47 @@ public:
         for (auto &x: list) add(x);
     }
 
+    ///fan out - create awaitables in caller-provided storage and start them
+    /**
+     * @param storage storage for awaitables, for example std::array or reused vector. Its
+     * size is count of started operations. Results are available in the storage
+     * after the wait is complete (see collect())
+     * @param factory function which receives index and returns awaitable
+     *
+     * @code
+     * std::array<awaitable<int>, 16> storage;
+     * co_await when_all(std::span(storage), [&](std::size_t i){return query(shard[i]);});
+     * @endcode
+     *
+     * @note the function doesn't allocate memory
+     */
+    template<typename T, std::size_t ext, std::invocable<std::size_t> Fn>
+    requires(std::is_convertible_v<std::invoke_result_t<Fn, std::size_t>, awaitable<T> >)
+    when_all(std::span<awaitable<T>, ext> storage, Fn &&factory) {
+        for (std::size_t i = 0; i < storage.size(); ++i) {
+            storage[i] = factory(i);
+            add(storage[i]);
+        }
+    }
+
+    ///move results of completed awaitables to the output iterator
+    /**
+     * @param storage completed awaitables
+     * @param out output iterator
+     * @return output iterator after last written value
+     *
+     * @exception any exception stored in an awaitable is rethrown. Awaitable without
+     * value throws await_canceled_exception
+     */
+    template<typename T, std::size_t ext, std::output_iterator<T> Iter>
+    static Iter collect(std::span<awaitable<T>, ext> storage, Iter out) {
+        for (auto &x: storage) {
+            *out = std::move(x.await_resume());
+            ++out;
+        }
+        return out;
+    }
+
     ~when_all() {
         wait();
     }
@@ -1781,12 +2011,17 @@ protected:
 
 ///Wait and iterate over completed results
 /**
- * @tparam count count of awaited objects, This value is often deduced
+ * @tparam count count of awaited objects, This value is often deduced. Use
+ * std::dynamic_extent (see when_each_dynamic) if the count is specified at runtime,
+ * the slots are then allocated by the constructor in one block sized from the range
  */
-template<unsigned int count>
+template<std::size_t count = std::dynamic_extent>
 class when_each {
 public:
 
+    ///construct empty
+    when_each() requires(count == std::dynamic_extent) = default;
+
     ///constructs from an array of awaitable objects
     /**
      * @param awts array of awaitable object
@@ -1796,8 +2031,9 @@ public:
      * awaitable is not ready yet. This can cause that
      * evaluation can run on background (in different thread)
      */
-    template<is_awaiter Awt>
-    when_each(Awt (&awts)[count]):_cnt(count){
+    template<is_awaiter Awt, std::size_t N>
+    requires(N == count)
+    when_each(Awt (&awts)[N]):_cnt(count){
         for (std::size_t i = 0; i < count; ++i) {
             add(awts[i], i);
         }
@@ -1813,7 +2049,7 @@ public:
      */
     template<is_awaiter ... Awts>
     requires(sizeof...(Awts) <= count)
-    when_each(Awts &... awts):_cnt(sizeof...(Awts)) {
+    when_each(Awts &... awts):_slots(make_storage(sizeof...(Awts))),_cnt(sizeof...(Awts)) {
         std::size_t idx = 0;
         (add(awts, idx++),...);
     }
@@ -1821,17 +2057,18 @@ public:
     ///construct from the list
     /** This constructor cannot use deduction guide. You need to
      * specify count above expected size of the list. The actual
-     * list can be smaller, but not larger than count
+     * list can be smaller, but not larger than count. When count is
+     * std::dynamic_extent, the whole list is awaited
      * @param list object which is iteratable by ranged-for
      */
     template<range_for_iterable X>
-    when_each(X &list) {
+    when_each(X &list):_slots(make_storage(range_size(list))) {
         std::size_t idx = 0;
         for (auto &x: list) {
+            if (idx == _slots.size()) break;
             add(x, idx++);
-            if (idx == count) break;
         }
-        _cnt = idx;
+        _cnt = static_cast<unsigned int>(idx);
     }
 
     ///cannot copy
@@ -1847,12 +2084,12 @@ public:
     }
 
     bool await_ready() const {
-        return _nx >= _cnt || _finished[_nx].load(std::memory_order_relaxed) != 0;
+        return _nx >= _cnt || _slots[_nx]._finished.load(std::memory_order_relaxed) != 0;
     }
 
     unsigned int await_resume() {
         if (_nx >= _cnt) return _nx;
-        unsigned int r = _finished[_nx].load(std::memory_order_acquire);
+        unsigned int r = _slots[_nx]._finished.load(std::memory_order_acquire);
         ++_nx;
         return r - 2;
     }
@@ -1860,7 +2097,7 @@ public:
     bool await_suspend(std::coroutine_handle<> h) {
         _r = h;
         unsigned int need = 0;
-        return _finished[_nx].compare_exchange_strong(need, 1, std::memory_order_relaxed);
+        return _slots[_nx]._finished.compare_exchange_strong(need, 1, std::memory_order_relaxed);
     }
 
     ///Wait synchronously
@@ -1872,6 +2109,9 @@ public:
         return sync_await(*this);
     }
 
+    ///retrieve count of awaitables
+    unsigned int size() const {return _cnt;}
+
     ///determines, whether there are still pending awaitables
     /**
      * @retval true still pending
@@ -1888,23 +2128,25 @@ protected:
 
     ///contains fake-coroutine which is called when real coroutine would be resumed
     struct Slot: coro_frame<Slot> { // @suppress("Miss copy constructor or assignment operator")
-        when_each *_parent;
+        when_each *_parent = nullptr;
+        ///contains index of complete awaitable (in order of completion)
+        /**
+         * The actual value is not index directly, value is increased by 2
+         * - value 0 - not complete yet
+         * - value 1 - not complete yet but awaitin
+         * - other - index of complete + 2
+         */
+        std::atomic<unsigned int> _finished = {0};
 
         prepared_coro do_resume() {
             return _parent->resumed(this);
         }
     };
 
+    using slot_storage = std::conditional_t<count == std::dynamic_extent, std::vector<Slot>, std::array<Slot, count> >;
+
     ///list of prepared fake-coroutines to catch resume attempt
-    Slot _slots[count];
-    ///contains indexes of complete awaitables
-    /**
-     * The actual value is not index directly, value is increased by 2
-     * - value 0 - not complete yet
-     * - value 1 - not complete yet but awaitin
-     * - other - index of complete + 2
-     */
-    std::atomic<unsigned int> _finished[count] ={};
+    slot_storage _slots = {};
     ///contains index of free slot
     std::atomic<unsigned int> _free_slot = {};
     ///contains index of next tested slot
@@ -1913,6 +2155,28 @@ protected:
     unsigned int _cnt = 0;
     prepared_coro _r = {};
 
+    static slot_storage make_storage([[maybe_unused]] std::size_t n) {
+        if constexpr(count == std::dynamic_extent) {
+            return slot_storage(n);
+        } else {
+            return {};
+        }
+    }
+
+    template<typename X>
+    static std::size_t range_size(X &list) {
+        if constexpr(count == std::dynamic_extent) {
+            std::size_t cnt = 0;
+            for (auto &x: list) {
+                (void)x;
+                ++cnt;
+            }
+            return cnt;
+        } else {
+            return count;
+        }
+    }
+
     ///register to slot
     /**
      * @param awt awaitable
@@ -1943,24 +2207,36 @@ protected:
      */
     prepared_coro resumed(Slot *nd) {
         //calculate index
-        unsigned int idx = nd - _slots;
+        unsigned int idx = static_cast<unsigned int>(nd - _slots.data());
         //calculate value
         unsigned int v = idx + 2;
         //retrieve next result slot
         unsigned int wridx = _free_slot.fetch_add(1, std::memory_order_relaxed);
         //exchange value
-        unsigned int st = _finished[wridx].exchange(v, std::memory_order_release);
+        unsigned int st = _slots[wridx]._finished.exchange(v, std::memory_order_release);
         //if there is 1, somebody already awaiting
         return (st == 1)?std::move(_r):prepared_coro();
     }
 };
 
-template<typename Awt, unsigned int N>
+template<typename Awt, std::size_t N>
 when_each(Awt (&)[N]) -> when_each<N>;
 
 template<is_awaiter... Awts>
 when_each(Awts&...) -> when_each<sizeof...(Awts)>;
 
+///Wait and iterate over completed results, count of awaitables is specified at runtime
+/**
+ * Awaiting only the first result works as "when any"
+ *
+ * @code
+ * std::vector<awaitable<int> > lst = scatter();
+ * when_each_dynamic s(lst);
+ * unsigned int first = co_await s;  //index of first complete awaitable
+ * @endcode
+ */
+using when_each_dynamic = when_each<std::dynamic_extent>;
+
 ///this class makes that callback function is called during destruction
 /**
  * This is useful feature for coroutines. The function is called when coroutine
@@ -2076,6 +2352,23 @@ protected:
 };
 
 
+///hint to the CPU, that the thread is spinning in a busy loop
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+///count of spin cycles of sync_await() and awaitable::wait() before the thread is parked
+/**
+ * If the result arrives during spinning, the waiting thread continues without
+ * any syscall. Set to zero to park the thread immediately. The value can be changed
+ * anytime, waiting threads read it with relaxed ordering
+ */
+inline std::atomic<unsigned int> sync_await_spin_count = {2000};
+
 ///a emulation of coroutine which sets atomic flag when it is resumed
 class sync_frame: public coro_frame<sync_frame> {
 public:
@@ -2085,21 +2378,41 @@ public:
     sync_frame& operator =(const sync_frame&) = delete;
 
     ///wait for synchronization
+    /**
+     * Spins for a short time (see sync_await_spin_count), then parks the thread
+     */
     void wait() {
-        _signal.wait(false);
+        for (unsigned int i = sync_await_spin_count.load(std::memory_order_relaxed); i; --i) {
+            if (_state.load(std::memory_order_acquire) == done) return;
+            cpu_relax();
+        }
+        unsigned int st = pending;
+        if (_state.compare_exchange_strong(st, parked, std::memory_order_acquire)) {
+            do {
+                _state.wait(parked, std::memory_order_acquire);
+            } while (_state.load(std::memory_order_acquire) != done);
+        }
     }
 
     ///reset synchronization
     void reset() {
-        _signal = false;
+        _state.store(pending, std::memory_order_relaxed);
     }
 
 protected:
     friend class coro_frame<sync_frame> ;
-    std::atomic<bool> _signal = { };
+
+    static constexpr unsigned int pending = 0;
+    static constexpr unsigned int parked = 1;
+    static constexpr unsigned int done = 2;
+
+    std::atomic<unsigned int> _state = {pending};
+
     void do_resume() {
-        _signal = true;
-        _signal.notify_all();
+        //notify only if the waiting thread is parked
+        if (_state.exchange(done, std::memory_order_release) == parked) {
+            _state.notify_one();
+        }
     }
 
 };
@@ -2120,7 +2433,8 @@ inline awaiter_result<T> sync_await(T &&awt) {
             auto r = awt.await_suspend(h);
             if constexpr(std::is_convertible_v<decltype(r), bool>) {
                 bool b = r;
-                if (!b) sf.set_done();
+                //not suspended, result is ready
+                if (!b) return awt.await_resume();
             } else {
                 r.resume();
             }
@@ -4,15 +4,64 @@
 #include "../coro_queue.h"
 #include "../coro_distributor.h"
 #include "../coro_scheduler.h"
+#include "../coro_thread_pool.h"
+#include "../coro_allocators.h"
+#include "../coro_semaphore.h"
+#include "../coro_task_group.h"
+#include "../coro_mt_scheduler.h"
+#include "../coro_cancel.h"
+#include "../coro_executor.h"
+#include "../coro_parallel.h"
+#include "../coro_simulation.h"
+#include "../coro_shared_awaitable.h"
+#include "../coro_barrier.h"
+#ifdef __linux__
+#include "../coro_reactor.h"
+#endif
 #include <iostream>
 
+struct wide_callback_result {int v;};
+template<> struct minicoro::awaitable_inline_size<wide_callback_result>
+    : std::integral_constant<std::size_t, 8 * sizeof(void *)> {};
+
+static_assert(minicoro::awaitable<wide_callback_result>::temp_state_size == 8 * sizeof(void *));
+static_assert(minicoro::awaitable<int>::temp_state_size == MINICORO_CALLBACK_INLINE_PTRS * sizeof(void *));
 
 template class minicoro::async_generator<int>;
 template class minicoro::coro_queue<int, 128>;
 template class minicoro::multi_lock<10>;
+template class minicoro::multi_lock_shared<10>;
 template class minicoro::awaitable<const int &>;
 template class minicoro::distributor<const int>;
+template class minicoro::work_stealing_deque<64>;
+template class minicoro::coro_mpmc_queue<int, 64>;
+template class minicoro::coro_segmented_queue<std::string, 16>;
+template class minicoro::timer_wheel<int, std::chrono::system_clock::time_point>;
+template class minicoro::manual_scheduler<>;
+template class minicoro::basic_coro_arena<std::mutex>;
+template class minicoro::coro_rate_limiter<minicoro::timer_wheel_scheduler>;
+template class minicoro::sharded_distributor<int>;
+template class minicoro::shared_distributor<int>;
+template class minicoro::buffered_generator<int, 4>;
+template class minicoro::chunked_generator<const int>;
+template class minicoro::distributor<const std::string &>;
+template class minicoro::simulation<>;
+template class minicoro::shared_awaitable<std::string>;
+template class minicoro::shared_awaitable<void>;
+template class minicoro::single_flight<std::string, int>;
+template class minicoro::coro_barrier<>;
+template class minicoro::coro_barrier<std::function<void()> >;
+template class minicoro::queue_select<minicoro::coro_mpmc_queue<int, 64> >;
+template class minicoro::queue_select<minicoro::coro_queue<int, 128>, 2>;
+template class minicoro::basic_mt_scheduler<minicoro::timer_wheel<minicoro::awaitable<void>::result, std::chrono::system_clock::time_point> >;
+#ifdef __linux__
+template class minicoro::basic_io_reactor<minicoro::timer_wheel<minicoro::awaitable<void>::result, std::chrono::system_clock::time_point> >;
+#endif
 
+minicoro::awaitable<int> select_first(minicoro::coro_queue<int, 128> &a, minicoro::coro_queue<int, 128> &b) {
+    auto itm = co_await minicoro::select(a, b);
+    co_return itm.value;
+}
 
 int main() {
     std::cout << sizeof(minicoro::awaitable<int>) << std::endl;
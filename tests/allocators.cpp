@@ -0,0 +1,139 @@
+#include "../coro_allocators.h"
+#include "check.h"
+
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+static_assert(coro_allocator<pool_allocator>);
+static_assert(coro_allocator<coro_arena>);
+
+coroutine<int, pool_allocator> square(int a) {
+    co_return a*a;
+}
+
+coroutine<int, pool_allocator> sum_squares(int n) {
+    int total = 0;
+    for (int i = 0; i < n; ++i) total += co_await square(i);
+    co_return total;
+}
+
+void test_pool() {
+    int total = sum_squares(100);
+    CHECK_EQUAL(total, 328350);
+}
+
+void test_sizes() {
+    std::vector<std::pair<void *, std::size_t> > blocks;
+    for (std::size_t sz = 1; sz < 20000; sz += 97) {
+        void *p = pool_allocator::alloc(sz);
+        std::fill(reinterpret_cast<char *>(p), reinterpret_cast<char *>(p) + sz, 0x55);
+        blocks.push_back({p, sz});
+    }
+    for (auto &[p, sz]: blocks) pool_allocator::dealloc(p, sz);
+    //released blocks are reused by the same thread
+    void *p = pool_allocator::alloc(100);
+    bool found = false;
+    for (auto &b: blocks) found = found || b.first == p;
+    CHECK(found);
+    pool_allocator::dealloc(p, 100);
+}
+
+//frames allocated in one thread and released in other
+void test_cross_thread() {
+    constexpr int count = 10000;
+    std::vector<awaitable<int> > lst;
+    std::vector<awaitable<int>::result> results;
+    lst.reserve(count);
+    results.reserve(count);
+    auto waiting = [](awaitable<int>::result *r) -> awaitable<int> {
+        return [r](awaitable<int>::result res){*r = std::move(res);};
+    };
+    auto coro = [&](int i) -> coroutine<int, pool_allocator> {
+        results.emplace_back();
+        int v = co_await waiting(&results.back());
+        co_return v + i;
+    };
+    for (int i = 0; i < count; ++i) {
+        lst.push_back(coro(i));
+    }
+    when_all all(lst);
+    std::thread thr([&]{
+        for (auto &r: results) r(1);
+    });
+    thr.join();
+    all.wait();
+    long total = 0;
+    for (auto &x: lst) total += x.await_resume();
+    CHECK_EQUAL(total, static_cast<long>(count) * (count + 1) / 2);
+}
+
+coroutine<int, coro_arena> arena_leaf(coro_arena &, int a) {
+    co_return a + 1;
+}
+
+coroutine<int, coro_arena> arena_tree(coro_arena &arena, int depth) {
+    if (depth == 0) co_return co_await arena_leaf(arena, 0);
+    int a = co_await arena_tree(arena, depth - 1);
+    int b = co_await arena_tree(arena, depth - 1);
+    co_return a + b;
+}
+
+void test_arena() {
+    coro_arena arena(1024);
+    int r = arena_tree(arena, 6);
+    CHECK_EQUAL(r, 64);
+    auto used = arena.used();
+    CHECK_GREATER(used, 64*sizeof(void *));
+
+    awaitable<int>::result res;
+    awaitable<int> awt([&](awaitable<int>::result r){res = std::move(r);});
+    int val = 0;
+    awt.set_callback([&](awaitable<int> &x){val = x;}, arena);
+    CHECK_GREATER(arena.used(), used);
+    res(42);
+    CHECK_EQUAL(val, 42);
+
+    arena.reset();
+    CHECK_EQUAL(arena.used(), 0);
+    r = arena_tree(arena, 3);
+    CHECK_EQUAL(r, 8);
+}
+
+//releases the block after the cache of the thread is destroyed
+struct late_release {
+    void *ptr = nullptr;
+    ~late_release() {
+        //allocation without cache
+        void *p = pool_allocator::alloc(100);
+        pool_allocator::dealloc(p, 100);
+        pool_allocator::dealloc(ptr, pool_allocator::max_block_size);
+    }
+};
+
+void test_release_after_cache() {
+    void *released = nullptr;
+    std::thread([&]{
+        //constructed before the cache, so it is destroyed after the cache
+        static thread_local late_release lr;
+        lr.ptr = pool_allocator::alloc(pool_allocator::max_block_size);
+        released = lr.ptr;
+    }).join();
+    //the block was returned to the global pool, new thread receives it
+    void *reused = nullptr;
+    std::thread([&]{
+        reused = pool_allocator::alloc(pool_allocator::max_block_size);
+        pool_allocator::dealloc(reused, pool_allocator::max_block_size);
+    }).join();
+    CHECK(reused == released);
+}
+
+int main() {
+    test_pool();
+    test_sizes();
+    test_cross_thread();
+    test_arena();
+    test_release_after_cache();
+    return 0;
+}
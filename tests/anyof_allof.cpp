@@ -1,4 +1,5 @@
 #include "../coroutine.h"
+#include <array>
 #include <sstream>
 #include <iostream>
 #include <vector>
@@ -59,11 +60,38 @@ awaitable<void> coro_test_master_all_off() {
     }
 }
 
+awaitable<void> coro_test_master_dynamic(std::ostream &out, unsigned int count) {
+    std::vector<awaitable<unsigned int> > lst;
+    for (unsigned int i = 0; i < count; ++i) {
+        lst.push_back(coro_test(((i * 7) % count) * 20, i));
+    }
+    when_each_dynamic s(lst);
+    if (s.size() != count) exit(3);
+    while(s) {
+        auto r = co_await s;
+        out << lst[r].await_resume() << "|";
+    }
+}
+
+awaitable<void> coro_test_master_fan_out() {
+    std::array<awaitable<unsigned int>, 5> storage;
+    co_await when_all(std::span(storage), [](std::size_t i){
+        return coro_test(static_cast<unsigned int>(50 - i * 10), static_cast<unsigned int>(i * i));
+    });
+    std::vector<unsigned int> res;
+    when_all::collect(std::span(storage), std::back_inserter(res));
+    if (res != std::vector<unsigned int>{0,1,4,9,16}) exit(4);
+}
+
 int main() {
     std::ostringstream buff;
     coro_test_master(buff).await();
     if (buff.view() != "6|2|4|5|1|3|") return 1;
     buff.str({});
     coro_test_master_all_off().await();
+    coro_test_master_dynamic(buff, 5).await();
+    //delays 0,40,80,20,60
+    if (buff.view() != "0|3|1|4|2|") return 1;
+    coro_test_master_fan_out().await();
     return 0;
 }
@@ -0,0 +1,213 @@
+#include "../coro_barrier.h"
+#include "check.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<void> wait_latch(coro_latch &l, std::vector<int> &order, int id) {
+    co_await l.wait();
+    order.push_back(id);
+}
+
+void test_latch() {
+    coro_latch l(3);
+    std::vector<int> order;
+    std::vector<awaitable<void> > w;
+    for (int i = 0; i < 3; ++i) w.push_back(wait_latch(l, order, i));
+    when_all all(w);
+    CHECK(!l.try_wait());
+    l.count_down();
+    l.count_down();
+    CHECK(order.empty());
+    //resumption can be scheduled
+    prepared_coro p = l.count_down();
+    CHECK(l.try_wait());
+    CHECK(order.empty());
+    p.resume();
+    CHECK_EQUAL(order.size(), 3);
+    CHECK_EQUAL(order[0], 0);
+    CHECK_EQUAL(order[2], 2);
+    //already open
+    CHECK(l.wait().is_ready());
+}
+
+//the waiting coroutine owns the latch, it is destroyed during resumption
+awaitable<void> latch_owner(coro_latch *&out, bool &done) {
+    coro_latch l(1);
+    out = &l;
+    co_await l.wait();
+    done = true;
+}
+
+awaitable<void> event_owner(coro_event *&out, bool &done) {
+    coro_event ev;
+    out = &ev;
+    co_await ev.wait();
+    done = true;
+}
+
+void test_owned_by_waiter() {
+    {
+        coro_latch *l = nullptr;
+        bool done = false;
+        auto t = latch_owner(l, done);
+        when_all w(t);
+        CHECK(!done);
+        l->count_down();
+        CHECK(done);
+    }
+    {
+        coro_event *ev = nullptr;
+        bool done = false;
+        auto t = event_owner(ev, done);
+        when_all w(t);
+        CHECK(!done);
+        ev->set();
+        CHECK(done);
+    }
+}
+
+awaitable<void> phase_worker(coro_barrier<std::function<void()> > &b, std::vector<int> &log, int id, int phases) {
+    for (int i = 0; i < phases; ++i) {
+        log.push_back(id);
+        co_await b.arrive_and_wait();
+    }
+}
+
+void test_barrier() {
+    constexpr int workers = 4;
+    constexpr int phases = 1000;
+    std::vector<int> log;
+    int completed = 0;
+    bool ok = true;
+    coro_barrier<std::function<void()> > b(workers, [&]{
+        //each worker logged once in this phase
+        ok = ok && log.size() == static_cast<std::size_t>(workers * (completed + 1));
+        ++completed;
+    });
+    std::vector<awaitable<void> > w;
+    for (int i = 0; i < workers; ++i) w.push_back(phase_worker(b, log, i, phases));
+    sync_await(when_all(w));
+    CHECK(ok);
+    CHECK_EQUAL(completed, phases);
+    CHECK_EQUAL(b.phase(), phases);
+}
+
+awaitable<void> arrive_and_count(coro_barrier<std::function<void()> > &b, int &cnt) {
+    co_await b.arrive_and_wait();
+    ++cnt;
+}
+
+void test_barrier_drop() {
+    int completed = 0;
+    int resumed = 0;
+    coro_barrier<std::function<void()> > b(2, [&]{++completed;});
+    auto w = arrive_and_count(b, resumed);
+    when_all all(w);
+    CHECK_EQUAL(resumed, 0);
+    b.arrive_and_drop();
+    CHECK_EQUAL(resumed, 1);
+    CHECK_EQUAL(completed, 1);
+    //only one participant left
+    b.arrive_and_wait().wait();
+    CHECK_EQUAL(completed, 2);
+}
+
+void test_barrier_mt() {
+    constexpr int threads = 4;
+    constexpr int phases = 10000;
+    std::atomic<int> in_phase = {0};
+    int errors = 0;
+    coro_barrier b(threads, [&]{
+        if (in_phase.exchange(0) != threads) ++errors;
+    });
+    std::vector<std::thread> thr;
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&]{
+            for (int j = 0; j < phases; ++j) {
+                in_phase.fetch_add(1);
+                b.arrive_and_wait().wait();
+            }
+        });
+    }
+    for (auto &t: thr) t.join();
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(b.phase(), phases);
+}
+
+awaitable<void> wait_event(coro_event &ev, int &cnt) {
+    co_await ev.wait();
+    ++cnt;
+}
+
+void test_event_manual() {
+    coro_event ev;
+    int cnt = 0;
+    std::vector<awaitable<void> > w;
+    for (int i = 0; i < 3; ++i) w.push_back(wait_event(ev, cnt));
+    when_all all(w);
+    CHECK(!ev.is_set());
+    ev.set();
+    CHECK_EQUAL(cnt, 3);
+    CHECK(ev.is_set());
+    CHECK(ev.wait().is_ready());
+    ev.reset();
+    CHECK(!ev.wait().is_ready());
+}
+
+void test_event_auto() {
+    coro_event ev(true);
+    int cnt = 0;
+    std::vector<awaitable<void> > w;
+    for (int i = 0; i < 2; ++i) w.push_back(wait_event(ev, cnt));
+    when_all all(w);
+    ev.set();
+    CHECK_EQUAL(cnt, 1);
+    CHECK(!ev.is_set());
+    ev.set();
+    CHECK_EQUAL(cnt, 2);
+    //no waiter, stays signaled for the next one
+    ev.set();
+    CHECK(ev.is_set());
+    CHECK(ev.try_wait());
+    CHECK(!ev.is_set());
+}
+
+void test_event_auto_mt() {
+    constexpr int threads = 4;
+    constexpr int cycles = 10000;
+    coro_event ev(true, true);
+    std::atomic<int> inside = {0};
+    int errors = 0;
+    std::vector<std::thread> thr;
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&]{
+            for (int j = 0; j < cycles; ++j) {
+                //event works as binary semaphore
+                ev.wait().wait();
+                if (inside.fetch_add(1) != 0) ++errors;
+                inside.fetch_sub(1);
+                ev.set();
+            }
+        });
+    }
+    for (auto &t: thr) t.join();
+    CHECK_EQUAL(errors, 0);
+    CHECK(ev.is_set());
+}
+
+int main() {
+    test_latch();
+    test_owned_by_waiter();
+    test_barrier();
+    test_barrier_drop();
+    test_barrier_mt();
+    test_event_manual();
+    test_event_auto();
+    test_event_auto_mt();
+    return 0;
+}
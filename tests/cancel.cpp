@@ -0,0 +1,174 @@
+#include "../coro_cancel.h"
+#include "../coro_distributor.h"
+#include "../coro_mutex.h"
+#include "../coro_queue.h"
+#include "../coro_scheduler.h"
+#include "check.h"
+
+#include <thread>
+
+using namespace MINICORO_NAMESPACE;
+
+//state: 0 - pending, 1 - resolved with value, 2 - resolved with no value
+template<typename T>
+void watch(awaitable<T> &awt, int &state) {
+    state = 0;
+    awt >> [&state](awaitable<T> &r) {
+        bool ok = r.has_value();
+        state = ok ? 1 : 2;
+    };
+}
+
+void test_hierarchy() {
+    cancel_source root;
+    cancel_source child(root.get_token());
+    cancel_source grandchild(child.get_token());
+    CHECK(!grandchild.is_canceled());
+    child.cancel();
+    CHECK(!root.is_canceled());
+    CHECK(child.is_canceled());
+    CHECK(grandchild.is_canceled());
+}
+
+void test_scheduler() {
+    scheduler sch;
+    auto thr = sch.create_thread();
+    cancel_source src;
+    auto s = sch.sleep_for(std::chrono::seconds(60), src.get_token());
+    int st;
+    watch(s, st);
+    CHECK_EQUAL(st, 0);
+    src.cancel();
+    CHECK_EQUAL(st, 2);
+    CHECK(!sch.get_first_scheduled_time().has_value());
+    //not canceled sleep finishes normally
+    cancel_source src2;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    sch.await(sch.sleep_for(std::chrono::milliseconds(10), src2.get_token()));
+}
+
+void test_queue() {
+    coro_queue<int, 4> q;
+    cancel_source src;
+    auto p1 = q.pop(src.get_token());
+    auto p2 = q.pop();
+    int st1, st2;
+    watch(p1, st1);
+    watch(p2, st2);
+    src.cancel();
+    CHECK_EQUAL(st1, 2);
+    CHECK_EQUAL(st2, 0);
+    //item is delivered to the remaining consumer
+    q.push(10);
+    CHECK_EQUAL(st2, 1);
+    //not canceled pop receives value
+    cancel_source src2;
+    q.push(20);
+    auto p3 = q.pop(src2.get_token());
+    CHECK(p3.is_ready());
+    CHECK_EQUAL(p3.await_resume(), 20);
+    auto p4 = q.pop(src2.get_token());
+    int v = 0;
+    p4 >> [&](awaitable<int> &r){v = r;};
+    q.push(30);
+    CHECK_EQUAL(v, 30);
+}
+
+//consumers are unlinked from any position of the list
+void test_queue_unlink() {
+    coro_queue<int, 4> q;
+    cancel_source src[5];
+    std::vector<awaitable<int> > p;
+    for (auto &x: src) p.push_back(q.pop(x.get_token()));
+    int st[5];
+    for (int i = 0; i < 5; ++i) watch(p[i], st[i]);
+    src[2].cancel();
+    src[4].cancel();
+    src[0].cancel();
+    CHECK_EQUAL(st[0], 2);
+    CHECK_EQUAL(st[2], 2);
+    CHECK_EQUAL(st[4], 2);
+    q.push(1);
+    CHECK_EQUAL(st[1], 1);
+    CHECK_EQUAL(st[3], 0);
+    q.push(2);
+    CHECK_EQUAL(st[3], 1);
+    //already resolved, nothing to remove
+    src[1].cancel();
+    //no consumer left, item stays in the queue
+    q.push(3);
+    auto p3 = q.pop();
+    CHECK(p3.is_ready());
+    CHECK_EQUAL(p3.await_resume(), 3);
+    //consumer resolved by close is not canceled
+    cancel_source src2;
+    auto c = q.pop(src2.get_token());
+    int stc;
+    watch(c, stc);
+    q.set_closed(std::make_exception_ptr(std::runtime_error("closed")));
+    CHECK(stc != 0);
+    src2.cancel();
+}
+
+void test_mutex() {
+    coro_mutex mx;
+    auto own = mx.try_lock();
+    cancel_source src;
+    auto l1 = mx.lock(src.get_token());
+    auto l2 = mx.lock();
+    int st1;
+    watch(l1, st1);
+    bool locked = false;
+    l2 >> [&](awaitable<coro_mutex::ownership> &r) {
+        coro_mutex::ownership o = r;
+        locked = true;
+    };
+    src.cancel();
+    CHECK_EQUAL(st1, 2);
+    CHECK(!locked);
+    //ownership passes through abandoned request
+    own.release();
+    CHECK(locked);
+    CHECK(static_cast<bool>(mx.try_lock()));
+}
+
+void test_distributor() {
+    distributor<int> d;
+    cancel_source src;
+    auto a = d(src.get_token());
+    int st;
+    watch(a, st);
+    int received = 0;
+    auto b = d();
+    b >> [&](awaitable<int> &r){received = r;};
+    src.cancel();
+    CHECK_EQUAL(st, 2);
+    d.broadcast(5);
+    CHECK_EQUAL(received, 5);
+    //kick out from the middle, broadcast reaches the others
+    cancel_source many[4];
+    std::vector<awaitable<int> > lst;
+    for (auto &x: many) lst.push_back(d(x.get_token()));
+    int sts[4];
+    for (int i = 0; i < 4; ++i) watch(lst[i], sts[i]);
+    many[1].cancel();
+    many[0].cancel();
+    CHECK_EQUAL(sts[0], 2);
+    CHECK_EQUAL(sts[1], 2);
+    d.broadcast(6);
+    CHECK_EQUAL(sts[2], 1);
+    CHECK_EQUAL(sts[3], 1);
+    CHECK(d.empty());
+    //index is cleared by broadcast
+    many[2].cancel();
+}
+
+int main() {
+    test_hierarchy();
+    test_scheduler();
+    test_queue();
+    test_queue_unlink();
+    test_mutex();
+    test_distributor();
+    return 0;
+}
@@ -118,7 +118,29 @@ void detached_test() {
     detach_test_coro(true);
 }
 
+struct not_suspending_awaiter {
+    bool await_ready() const {return false;}
+    bool await_suspend(std::coroutine_handle<>) {return false;}
+    int await_resume() {return 7;}
+};
 
+void test_sync_await() {
+    CHECK_EQUAL(sync_await(not_suspending_awaiter{}), 7);
+    //result delivered during spinning and after the thread is parked
+    for (unsigned int spin: {100000U, 0U}) {
+        sync_await_spin_count.store(spin, std::memory_order_relaxed);
+        std::thread thr;
+        auto res = sync_await(awaitable<int>([&](awaitable<int>::result r){
+            thr = std::thread([r = std::move(r)]() mutable {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                r = 11;
+            });
+        }));
+        thr.join();
+        CHECK_EQUAL(res, 11);
+    }
+    sync_await_spin_count.store(2000, std::memory_order_relaxed);
+}
 
 int main() {
     std::ostringstream s;
@@ -130,5 +152,6 @@ int main() {
     reusable_test();
     test_pointer_access_coro().wait();
     detached_test();
+    test_sync_await();
     return 0;
 }
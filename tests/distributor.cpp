@@ -1,5 +1,9 @@
 #include "../coro_distributor.h"
 #include "check.h"
+#include "../coro_thread_pool.h"
+
+#include <atomic>
+#include <vector>
 
 
 using namespace minicoro;
@@ -35,6 +39,165 @@ awaitable<void> coro_alert_test(distributor<int, empty_lockable> &dist, alert_fl
 }
 
 
+void test_sharded() {
+    constexpr int count = 1000;
+    sharded_distributor<int, 8> dist;
+    static char idents[count];
+    std::vector<awaitable<int> > lst(count);
+    std::vector<int> received(count, 0);
+    int canceled = 0;
+    for (int i = 0; i < count; ++i) {
+        lst[i] = dist(idents + i);
+        lst[i] >> [&, i](awaitable<int> &r){
+            bool has_value = r.has_value();
+            if (!has_value) {
+                ++canceled;
+            } else {
+                received[i] = r;
+            }
+        };
+    }
+    for (int i = 0; i < count; i += 2) dist.kick_out(idents + i);
+    CHECK_EQUAL(canceled, count / 2);
+    CHECK(!dist.kick_out(idents).operator bool());
+    alert_flag_type flg;
+    awaitable<int> a = dist(flg);
+    bool alerted = false;
+    a >> [&](awaitable<int> &){alerted = true;};
+    dist.alert(flg);
+    CHECK(alerted);
+    dist.broadcast(42);
+    int sum = 0;
+    for (int v: received) sum += v;
+    CHECK_EQUAL(sum, 42 * count / 2);
+    CHECK(dist.empty());
+}
+
+void test_sharded_pool() {
+    constexpr int count = 1000;
+    sharded_distributor<int> dist;
+    coro_thread_pool pool(4);
+    std::atomic<int> sum = {0};
+    std::vector<awaitable<int> > lst(count);
+    for (auto &x: lst) {
+        x = dist();
+        x >> [&](awaitable<int> &r){sum.fetch_add(r);};
+    }
+    dist.broadcast_to(pool, 64, 2);
+    pool.stop();
+    CHECK_EQUAL(sum.load(), 2 * count);
+}
+
+struct counted {
+    static inline int copies = 0;
+    int v;
+    counted(int v):v(v) {}
+    counted(const counted &o):v(o.v) {++copies;}
+};
+
+void test_zero_copy() {
+    std::vector<awaitable<const counted &> > refs(10);
+    distributor<const counted &> rdist;
+    int sum = 0;
+    for (auto &x: refs) {
+        x = rdist();
+        x >> [&](awaitable<const counted &> &r){
+            const counted &c = r;
+            sum += c.v;
+        };
+    }
+    counted val(3);
+    rdist.broadcast(val);
+    CHECK_EQUAL(sum, 30);
+    CHECK_EQUAL(counted::copies, 0);
+
+    shared_distributor<counted> sdist;
+    std::vector<awaitable<std::shared_ptr<const counted> > > lst(10);
+    std::vector<std::shared_ptr<const counted> > received;
+    for (auto &x: lst) {
+        x = sdist();
+        x >> [&](awaitable<std::shared_ptr<const counted> > &r){
+            received.push_back(r);
+        };
+    }
+    auto p = sdist.publish(5);
+    CHECK_EQUAL(received.size(), 10);
+    CHECK_EQUAL(counted::copies, 0);
+    CHECK_EQUAL(p.use_count(), 11);
+    for (auto &x: received) CHECK(x == p);
+}
+
+awaitable<void> ping_pong(distributor<int> &dist, int &cnt, int n) {
+    while (cnt < n) {
+        co_await dist();
+        ++cnt;
+        dist.broadcast(cnt);
+    }
+}
+
+//exposes storage of the list
+class probe_list: public resume_list {
+public:
+    std::size_t storage() const {return _overflow.capacity();}
+};
+
+struct yield_to_list {
+    probe_list &lst;
+    bool await_ready() const {return false;}
+    void await_suspend(std::coroutine_handle<> h) {lst.push(prepared_coro(h));}
+    void await_resume() {}
+};
+
+awaitable<void> hop(probe_list &lst, int &cnt, int n, std::size_t &peak) {
+    while (cnt < n) {
+        co_await yield_to_list{lst};
+        ++cnt;
+        peak = std::max(peak, lst.storage());
+    }
+}
+
+void test_resume_list_reuse() {
+    //each resumed coroutine appends itself again, the list must not grow
+    probe_list lst;
+    int cnt = 0;
+    std::size_t peak = 0;
+    constexpr int n = 100000;
+    awaitable<void> a = hop(lst, cnt, n, peak);
+    awaitable<void> b = hop(lst, cnt, n, peak);
+    when_all all(a, b);
+    lst.resume_all();
+    CHECK(cnt >= n);
+    CHECK(lst.empty());
+    CHECK(peak <= resume_list::inline_count);
+}
+
+void test_resume_list() {
+    //listeners rebroadcast, they are resumed by a loop, not by nested calls
+    distributor<int> dist;
+    int cnt = 0;
+    constexpr int n = 200000;
+    awaitable<void> a = ping_pong(dist, cnt, n);
+    awaitable<void> b = ping_pong(dist, cnt, n);
+    when_all all(a, b);
+    dist.broadcast(0);
+    all.wait();
+    CHECK(cnt >= n);
+
+    resume_list lst;
+    distributor<int> d2;
+    int sum = 0;
+    auto l1 = d2();
+    auto l2 = d2();
+    l1 >> [&](awaitable<int> &r){sum += r.await_resume();};
+    l2 >> [&](awaitable<int> &r){sum += r.await_resume();};
+    d2.broadcast(lst, 5);
+    CHECK_EQUAL(lst.size(), 2);
+    CHECK_EQUAL(sum, 0);
+    lst.resume_all();
+    CHECK(lst.empty());
+    CHECK_EQUAL(sum, 10);
+}
+
 int main() {
     bool ident_a = false;
     bool ident_b = false;
@@ -69,6 +232,12 @@ int main() {
     as.wait();
     CHECK_EQUAL(count_resume, 14);
 
+    test_sharded();
+    test_sharded_pool();
+    test_zero_copy();
+    test_resume_list();
+    test_resume_list_reuse();
+
 
 
 }
@@ -0,0 +1,116 @@
+#include "../coro_executor.h"
+#include "../coro_queue.h"
+#include "../coro_thread_pool.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<bool> switch_to_pool(coro_thread_pool &pool) {
+    co_await resume_on(pool);
+    co_return pool.is_current();
+}
+
+void test_resume_on() {
+    coro_thread_pool pool(2);
+    bool in_pool = switch_to_pool(pool);
+    CHECK(in_pool);
+}
+
+awaitable<std::thread::id> pop_and_report(coro_queue<int, 4> &q, bool use_sticky) {
+    if (use_sticky) {
+        co_await sticky(q.pop());
+    } else {
+        co_await q.pop();
+    }
+    co_return std::this_thread::get_id();
+}
+
+void test_sticky_loop() {
+    for (bool use_sticky: {false, true}) {
+        loop_executor loop;
+        coro_queue<int, 4> q;
+        std::jthread producer;
+        auto task = [&]() -> awaitable<std::thread::id> {
+            //start the task inside of the loop
+            co_await resume_on(loop);
+            auto awt = pop_and_report(q, use_sticky);
+            //consumer suspends here
+            when_all w(awt);
+            producer = std::jthread([&]{q.push(1);});
+            co_await w;
+            co_return awt.await_resume();
+        };
+        std::thread::id id = loop.await(task());
+        bool same = id == std::this_thread::get_id();
+        CHECK_EQUAL(same, use_sticky);
+    }
+}
+
+//operation resolved by the main thread, it signals when the coroutine waits on it
+struct handoff {
+    awaitable<int>::result r;
+    std::atomic<bool> parked = {false};
+
+    awaitable<int> wait() {
+        return [this](awaitable<int>::result res) {
+            r = std::move(res);
+            parked.store(true);
+            parked.notify_all();
+        };
+    }
+};
+
+awaitable<bool> pool_wait(coro_thread_pool &pool, handoff &h) {
+    co_await resume_on(pool);
+    co_await sticky(h.wait());
+    co_return pool.is_current();
+}
+
+void test_sticky_pool() {
+    coro_thread_pool pool(2);
+    handoff h;
+    auto awt = pool_wait(pool, h);
+    std::atomic<bool> done = {false};
+    bool in_pool = false;
+    awt >> [&](awaitable<bool> &r) {
+        in_pool = r;
+        done.store(true);
+        done.notify_all();
+    };
+    //resolve from this thread once the coroutine waits in the pool
+    h.parked.wait(false);
+    h.r(1);
+    done.wait(false);
+    CHECK(in_pool);
+}
+
+struct flag_frame: coro_frame<flag_frame> { // @suppress("Miss copy constructor or assignment operator")
+    int *cnt = nullptr;
+    void do_resume() {++*cnt;}
+};
+
+void test_loop_drain() {
+    //coroutines posted before the stop are not abandoned
+    loop_executor loop;
+    int cnt = 0;
+    flag_frame frm[3];
+    for (auto &f: frm) {
+        f.cnt = &cnt;
+        loop.post(f.get_handle());
+    }
+    std::stop_source src;
+    src.request_stop();
+    loop.run(src.get_token());
+    CHECK_EQUAL(cnt, 3);
+}
+
+int main() {
+    test_resume_on();
+    test_sticky_loop();
+    test_sticky_pool();
+    test_loop_drain();
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "../async_generator.h"
 
 #include "check.h"
+#include "../coro_thread_pool.h"
 
 #include <thread>
 using namespace minicoro;
@@ -80,6 +81,115 @@ int test_end() {
     return r;
 }
 
+generator<int> throwing_gen() {
+    co_yield 1;
+    co_yield 2;
+    throw std::runtime_error("failed");
+}
+
+void test_buffered() {
+    int results[] = {1,1,2,3,5,8,13,21,34,55};
+    {
+        buffered_generator<int, 4> gen(fibo(10));
+        //generator runs ahead
+        CHECK_EQUAL(gen.ready(), 4);
+        auto iter = std::begin(results);
+        for (auto v = gen(); v.has_value(); v = gen()) {
+            int x = v;
+            CHECK_EQUAL(x, *iter);
+            ++iter;
+        }
+        CHECK(iter == std::end(results));
+    }
+    {
+        buffered_generator<int, 2> gen(async_fibo(10));
+        auto iter = std::begin(results);
+        for (auto v = gen(); v.has_value(); v = gen()) {
+            int x = v;
+            CHECK_EQUAL(x, *iter);
+            ++iter;
+        }
+        CHECK(iter == std::end(results));
+    }
+    {
+        buffered_generator<int, 4> gen(throwing_gen());
+        int a = gen();
+        int b = gen();
+        CHECK_EQUAL(a + b, 3);
+        bool thrown = false;
+        try {
+            int c = gen();
+            (void)c;
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        bool has_value = gen().has_value();
+        CHECK(!has_value);
+    }
+    {
+        //destroyed while the generator is parked
+        buffered_generator<int, 2> gen(fibo(1000));
+        int a = gen();
+        CHECK_EQUAL(a, 1);
+    }
+    {
+        coro_thread_pool pool(2);
+        buffered_generator<int, 3, coro_thread_pool> gen(async_fibo(10), pool);
+        auto iter = std::begin(results);
+        for (auto v = gen(); v.has_value(); v = gen()) {
+            int x = v;
+            CHECK_EQUAL(x, *iter);
+            ++iter;
+        }
+        CHECK(iter == std::end(results));
+    }
+}
+
+generator<std::span<const int> > chunks(int count, int chunk) {
+    std::vector<int> buff;
+    for (int i = 0; i < count; i += chunk) {
+        buff.clear();
+        for (int j = i; j < std::min(count, i + chunk); ++j) buff.push_back(j);
+        co_yield std::span<const int>(buff);
+        //empty chunk is skipped
+        if (i == 0) co_yield std::span<const int>();
+    }
+}
+
+awaitable<long> sum_chunked(chunked_generator<const int> &gen) {
+    long sum = 0;
+    for (auto v = gen(); co_await v.has_value(); v = gen()) sum += v;
+    co_return sum;
+}
+
+void test_chunked() {
+    long sum = 0;
+    int cnt = 0;
+    for (int v: chunked_generator(chunks(1000, 64))) {
+        CHECK_EQUAL(v, cnt);
+        sum += v;
+        ++cnt;
+    }
+    CHECK_EQUAL(cnt, 1000);
+    CHECK_EQUAL(sum, 499500);
+
+    chunked_generator gen(chunks(100, 7));
+    long s = sum_chunked(gen);
+    CHECK_EQUAL(s, 4950);
+
+    chunked_generator gen2(chunks(10, 4));
+    int first = gen2();
+    CHECK_EQUAL(first, 0);
+    std::span<const int> rest = gen2.next_chunk();
+    CHECK_EQUAL(rest.size(), 3);
+    std::span<const int> next = gen2.next_chunk();
+    CHECK(next.empty());
+    next = gen2.next_chunk();
+    CHECK_EQUAL(next.size(), 4);
+    CHECK_EQUAL(next[0], 4);
+}
+
 int main() {
 
     int results[] = {1,1,2,3,5,8,13,21,34,55};
@@ -102,4 +212,6 @@ int main() {
 
     async_fibo_test2().await();
     async_fibo_test3().await();
+    test_buffered();
+    test_chunked();
 }
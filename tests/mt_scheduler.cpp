@@ -0,0 +1,88 @@
+#include "../coro_mt_scheduler.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<unsigned int> coro_test(mt_scheduler &sch, unsigned int ms, unsigned int id) {
+    co_await sch.sleep_for(std::chrono::milliseconds(ms));
+    co_return id;
+}
+
+void test_order() {
+    mt_scheduler sch(2);
+    awaitable<unsigned int> lst[] = {
+            coro_test(sch,100,1),
+            coro_test(sch,50,2),
+            coro_test(sch,150,3),
+            coro_test(sch,20,4),
+    };
+    std::vector<unsigned int> res;
+    [&]() -> awaitable<void> {
+        when_each s(lst);
+        while (s) {
+            auto r = co_await s;
+            res.push_back(lst[r].await_resume());
+        }
+    }().await();
+    CHECK_EQUAL(res.size(), 4);
+    CHECK_EQUAL(res[0], 4);
+    CHECK_EQUAL(res[1], 2);
+    CHECK_EQUAL(res[2], 1);
+    CHECK_EQUAL(res[3], 3);
+}
+
+void test_cancel_mt() {
+    constexpr int threads = 4;
+    constexpr int count = 2000;
+    mt_scheduler sch(threads);
+    std::atomic<int> fired = {0};
+    std::atomic<int> canceled = {0};
+    static char idents[threads][count];
+    std::vector<std::thread> thr;
+    for (int t = 0; t < threads; ++t) {
+        thr.emplace_back([&, t]{
+            std::vector<awaitable<void> > sleeps;
+            sleeps.reserve(count);
+            for (int i = 0; i < count; ++i) {
+                //odd sleeps would fire after the end of the test
+                auto dur = std::chrono::milliseconds(i & 1 ? 60000 : 1);
+                sleeps.push_back(sch.sleep_for(dur, &idents[t][i]));
+                sleeps.back() >> [&](awaitable<void> &r) {
+                    bool ok = r.has_value();
+                    if (ok) ++fired; else ++canceled;
+                };
+            }
+            for (int i = 1; i < count; i += 2) {
+                sch.cancel(&idents[t][i]);
+            }
+        });
+    }
+    for (auto &t: thr) t.join();
+    while (fired.load() < threads * count / 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK_EQUAL(canceled.load(), threads * count / 2);
+    CHECK_EQUAL(fired.load(), threads * count / 2);
+}
+
+void test_stop() {
+    int canceled = 0;
+    {
+        mt_scheduler sch(2);
+        auto s = sch.sleep_for(std::chrono::seconds(60));
+        s >> [&](awaitable<void> &r) {
+            bool ok = r.has_value();
+            if (!ok) ++canceled;
+        };
+    }
+    CHECK_EQUAL(canceled, 1);
+}
+
+int main() {
+    test_order();
+    test_cancel_mt();
+    test_stop();
+    return 0;
+}
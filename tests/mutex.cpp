@@ -1,5 +1,7 @@
 #include "../coro_mutex.h"
 #include "check.h"
+#include <atomic>
+#include <thread>
 #include <vector>
 
 using namespace MINICORO_NAMESPACE;
@@ -33,7 +35,184 @@ void test1() {
 }
 
 
+void test_shared() {
+    coro_shared_mutex mx;
+    using own_t = coro_shared_mutex::ownership;
+    using shown_t = coro_shared_mutex::shared_ownership;
+
+    auto w1 = mx.lock();
+    CHECK(w1.is_ready());
+    own_t w1own = w1;
+    std::vector<int> res;
+    std::vector<shown_t> readers;
+    own_t w2own;
+    auto reader = [&](int id) {
+        return [&, id](awaitable<shown_t> &r) {
+            res.push_back(id);
+            readers.push_back(r);
+        };
+    };
+    auto r1 = mx.lock_shared();
+    auto r2 = mx.lock_shared();
+    auto w2 = mx.lock();
+    auto r3 = mx.lock_shared();
+    r1 >> reader(1);
+    r2 >> reader(2);
+    w2 >> [&](awaitable<own_t> &r){
+        res.push_back(10);
+        w2own = r;
+    };
+    r3 >> reader(3);
+    CHECK(res.empty());
+    w1own.release();
+    //both readers in front of the writer are resumed
+    CHECK_EQUAL(res.size(), 2);
+    CHECK_EQUAL(res[0], 1);
+    CHECK_EQUAL(res[1], 2);
+    //writer is waiting, new reader can't join
+    CHECK(!mx.try_lock_shared());
+    readers.clear();
+    CHECK_EQUAL(res.size(), 3);
+    CHECK_EQUAL(res[2], 10);
+    w2own.release();
+    CHECK_EQUAL(res.size(), 4);
+    CHECK_EQUAL(res[3], 3);
+    //reader joins readers
+    auto s = mx.try_lock_shared();
+    CHECK(static_cast<bool>(s));
+    CHECK(!mx.try_lock());
+    readers.clear();
+    s.release();
+    CHECK(static_cast<bool>(mx.try_lock()));
+}
+
+void test_shared_mt() {
+    constexpr int threads = 4;
+    constexpr int cycles = 20000;
+    coro_shared_mutex mx;
+    std::atomic<int> inside = {0};
+    int value = 0;
+    int errors = 0;
+    std::vector<std::thread> thr;
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&, i]{
+            for (int j = 0; j < cycles; ++j) {
+                if ((j + i) % 8 == 0) {
+                    coro_shared_mutex::ownership own = mx.lock();
+                    if (inside.fetch_add(1) != 0) ++errors;
+                    ++value;
+                    inside.fetch_sub(1);
+                } else {
+                    coro_shared_mutex::shared_ownership own = mx.lock_shared();
+                    inside.fetch_add(2);
+                    if (inside.load() & 1) ++errors;
+                    inside.fetch_sub(2);
+                }
+            }
+        });
+    }
+    for (auto &t: thr) t.join();
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(value, threads * cycles / 8);
+}
+
+void test_multi_lock() {
+    coro_mutex a, b;
+    coro_mutex *lst[] = {&a, &b};
+    auto bown = b.try_lock();
+    multi_lock ml(lst);
+    bool locked = false;
+    auto mlw = ml.lock();
+    mlw >> [&](awaitable<void> &){locked = true;};
+    CHECK(!locked);
+    bown.release();
+    CHECK(locked);
+    CHECK(!a.try_lock());
+    CHECK(!b.try_lock());
+    auto own = ml.get_ownership();
+    own[0].release();
+    own[1].release();
+    CHECK(static_cast<bool>(a.try_lock()));
+
+    coro_shared_mutex sa, sb;
+    coro_shared_mutex *slst[] = {&sa, &sb};
+    auto sbown = sb.try_lock();
+    auto rd = sa.try_lock_shared();
+    multi_lock_shared msl(slst);
+    locked = false;
+    auto mslw = msl.lock();
+    mslw >> [&](awaitable<void> &){locked = true;};
+    CHECK(!locked);
+    sbown.release();
+    CHECK(locked);
+    //all mutexes are locked shared
+    CHECK(!sa.try_lock());
+    CHECK(!sb.try_lock());
+    CHECK(static_cast<bool>(sb.try_lock_shared()));
+}
+
+void test_barging() {
+    coro_barging_mutex mx(0);
+    using own_t = coro_barging_mutex::ownership;
+    own_t own = mx.lock();
+    CHECK(own.owns_lock());
+    CHECK(!mx.try_lock());
+    std::vector<int> res;
+    auto l2 = mx.lock();
+    auto l3 = mx.lock();
+    CHECK(!l2.is_ready());
+    l2 >> [&](awaitable<own_t> &r){
+        own_t o = r;
+        res.push_back(2);
+    };
+    l3 >> [&](awaitable<own_t> &r){
+        own_t o = r;
+        res.push_back(3);
+    };
+    //mutex is unlocked before the waiter runs
+    prepared_coro wake = own.release();
+    own_t barger = mx.try_lock();
+    CHECK(barger.owns_lock());
+    //waiter fails to lock and returns to the front of the queue
+    wake.resume();
+    CHECK(res.empty());
+    barger.release();
+    CHECK_EQUAL(res.size(), 2);
+    CHECK_EQUAL(res[0], 2);
+    CHECK_EQUAL(res[1], 3);
+    CHECK(static_cast<bool>(mx.try_lock()));
+}
+
+void test_barging_mt() {
+    constexpr int threads = 4;
+    constexpr int cycles = 20000;
+    coro_barging_mutex mx;
+    std::atomic<int> inside = {0};
+    int value = 0;
+    int errors = 0;
+    std::vector<std::thread> thr;
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&]{
+            for (int j = 0; j < cycles; ++j) {
+                coro_barging_mutex::ownership own = mx.lock();
+                if (inside.fetch_add(1) != 0) ++errors;
+                ++value;
+                inside.fetch_sub(1);
+            }
+        });
+    }
+    for (auto &t: thr) t.join();
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(value, threads * cycles);
+    CHECK(static_cast<bool>(mx.try_lock()));
+}
+
 int main() {
     test1();
+    test_shared();
+    test_shared_mt();
+    test_multi_lock();
+    test_barging();
+    test_barging_mt();
     return 0;
 }
\ No newline at end of file
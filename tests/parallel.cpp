@@ -0,0 +1,62 @@
+#include "../coro_parallel.h"
+#include "../coro_thread_pool.h"
+#include "check.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+void test_for() {
+    coro_thread_pool pool(4);
+    std::vector<int> data(100000);
+    std::iota(data.begin(), data.end(), 0);
+    parallel_for(pool, data, 1000, [](int &x){x = x * 2 + 1;}).await();
+    bool ok = true;
+    for (int i = 0; i < static_cast<int>(data.size()); ++i) ok = ok && data[i] == i * 2 + 1;
+    CHECK(ok);
+    //small range, single chunk
+    std::vector<int> small = {1, 2, 3};
+    parallel_for(pool, small, 1000, [](int &x){x = -x;}).await();
+    CHECK_EQUAL(small[2], -3);
+    std::vector<int> empty;
+    parallel_for(pool, empty, 10, [](int &){}).await();
+}
+
+void test_reduce() {
+    coro_thread_pool pool(4);
+    std::vector<int> data(100000);
+    std::iota(data.begin(), data.end(), 0);
+    long sum = parallel_transform_reduce(pool, data, 512, 10L, std::plus<>(), [](int x){return static_cast<long>(x);});
+    long n = static_cast<long>(data.size());
+    CHECK_EQUAL(sum, n * (n - 1) / 2 + 10);
+    std::vector<int> empty;
+    long e = parallel_transform_reduce(pool, empty, 512, 7L, std::plus<>(), [](int x){return static_cast<long>(x);});
+    CHECK_EQUAL(e, 7);
+}
+
+void test_exception() {
+    coro_thread_pool pool(4);
+    std::vector<int> data(10000, 1);
+    bool thrown = false;
+    try {
+        parallel_for(pool, data, 100, [](int &x){
+            x = 2;
+            throw std::runtime_error("fail");
+        }).await();
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    //at least one chunk was skipped
+    bool skipped = std::count(data.begin(), data.end(), 1) > 0;
+    CHECK(skipped);
+}
+
+int main() {
+    test_for();
+    test_reduce();
+    test_exception();
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include "../coro_queue.h"
+#include "check.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<void> producer(coro_queue<int, 4> &q, int from, int to) {
+    for (int i = from; i < to; ++i) {
+        co_await q.push(i);
+    }
+}
+
+awaitable<int> consumer(coro_queue<int, 4> &q, int count) {
+    int sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += co_await q.pop();
+    }
+    co_return sum;
+}
+
+void test_basic() {
+    coro_queue<int, 4> q;
+    bool done = false;
+    producer(q, 0, 100) >> [&](awaitable<void> &){done = true;};
+    CHECK(!done);
+    int sum = consumer(q, 100);
+    CHECK_EQUAL(sum, 4950);
+    CHECK(done);
+}
+
+void test_pending_pop() {
+    coro_queue<std::string, 2> q;
+    auto a = q.pop();
+    auto b = q.pop();
+    std::vector<std::string> res;
+    a >> [&](awaitable<std::string> &r){res.push_back(r);};
+    b >> [&](awaitable<std::string> &r){res.push_back(r);};
+    q.push("first");
+    q.push("second");
+    CHECK_EQUAL(res.size(), 2);
+    CHECK_EQUAL(res[0], "first");
+    CHECK_EQUAL(res[1], "second");
+}
+
+void test_closed() {
+    coro_queue<int, 2> q;
+    auto a = q.pop();
+    bool thrown = false;
+    a >> [&](awaitable<int> &r){
+        try {
+            r.await_resume();
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+    };
+    q.set_closed(std::make_exception_ptr(std::runtime_error("closed")));
+    CHECK(thrown);
+}
+
+void test_batch() {
+    coro_queue<int, 8> q;
+    std::vector<int> src = {1,2,3,4,5,6,7,8,9,10};
+    auto it = q.push_range(src.begin(), src.end());
+    CHECK_EQUAL(it - src.begin(), 8);
+    int buff[5];
+    std::size_t n = q.pop_many(buff);
+    CHECK_EQUAL(n, 5);
+    CHECK_EQUAL(buff[0], 1);
+    CHECK_EQUAL(buff[4], 5);
+    it = q.push_range(it, src.end());
+    CHECK(it == src.end());
+    auto r = q.pop_batch(buff);
+    CHECK(r.is_ready());
+    n = r.await_resume();
+    CHECK_EQUAL(n, 5);
+    CHECK_EQUAL(buff[0], 6);
+    CHECK_EQUAL(buff[4], 10);
+    auto w = q.pop_batch(buff);
+    std::size_t cnt = 0;
+    w >> [&](awaitable<std::size_t> &r){cnt = r;};
+    CHECK_EQUAL(cnt, 0);
+    it = q.push_range(src.begin(), src.begin() + 3);
+    //consumer is resumed after all items are pushed
+    CHECK_EQUAL(cnt, 3);
+    CHECK_EQUAL(buff[0], 1);
+    CHECK_EQUAL(buff[2], 3);
+}
+
+awaitable<void> mpmc_producer(coro_mpmc_queue<int, 16> &q, int from, int to) {
+    for (int i = from; i < to; ++i) {
+        co_await q.push(i);
+    }
+}
+
+awaitable<long> mpmc_consumer(coro_mpmc_queue<int, 16> &q, int count) {
+    long sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += co_await q.pop();
+    }
+    co_return sum;
+}
+
+void test_mpmc() {
+    constexpr int threads = 4;
+    constexpr int items = 20000;
+    coro_mpmc_queue<int, 16> q;
+    std::atomic<long> total = {0};
+    std::vector<std::thread> thr;
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&q, i]{
+            mpmc_producer(q, i * items, (i + 1) * items).wait();
+        });
+        thr.emplace_back([&q, &total]{
+            long s = mpmc_consumer(q, items);
+            total.fetch_add(s);
+        });
+    }
+    for (auto &t: thr) t.join();
+    long n = static_cast<long>(threads) * items;
+    CHECK_EQUAL(total.load(), n * (n - 1) / 2);
+}
+
+void test_mpmc_batch() {
+    constexpr int items = 50000;
+    coro_mpmc_queue<int, 16> q;
+    std::thread prod([&]{
+        std::vector<int> src(100);
+        for (int i = 0; i < items; i += 100) {
+            for (int j = 0; j < 100; ++j) src[j] = i + j;
+            auto it = src.begin();
+            while (it != src.end()) {
+                it = q.push_range(it, src.end());
+                if (it != src.end()) {
+                    q.push(*it).wait();
+                    ++it;
+                }
+            }
+        }
+    });
+    long sum = 0;
+    int cnt = 0;
+    int buff[32];
+    while (cnt < items) {
+        std::size_t n = q.pop_batch(buff);
+        for (std::size_t i = 0; i < n; ++i) sum += buff[i];
+        cnt += static_cast<int>(n);
+    }
+    prod.join();
+    CHECK_EQUAL(cnt, items);
+    CHECK_EQUAL(sum, static_cast<long>(items) * (items - 1) / 2);
+}
+
+void test_select() {
+    coro_queue<int, 4> q1, q2, q3;
+    queue_select sel(q1, q2, q3);
+    auto a = sel();
+    std::size_t idx = 99;
+    int val = 0;
+    a >> [&](awaitable<queue_select<coro_queue<int, 4>, 3>::item> &r) {
+        auto itm = r.await_resume();
+        idx = itm.index;
+        val = itm.value;
+    };
+    CHECK_EQUAL(idx, 99);
+    q2.push(42);
+    CHECK_EQUAL(idx, 1);
+    CHECK_EQUAL(val, 42);
+    //consumer is no longer registered in q1 and q3
+    q1.push(1);
+    q3.push(3);
+    auto b = q1.pop();
+    CHECK(b.is_ready());
+    CHECK_EQUAL(b.await_resume(), 1);
+    //round-robin, q3 is tested after q2
+    q1.push(2);
+    auto itm = sel().await();
+    CHECK_EQUAL(itm.index, 2);
+    CHECK_EQUAL(itm.value, 3);
+    itm = sel().await();
+    CHECK_EQUAL(itm.index, 0);
+    CHECK_EQUAL(itm.value, 2);
+    //temporary selector
+    q3.push(7);
+    auto c = select(q1, q2, q3)().await();
+    CHECK_EQUAL(c.index, 2);
+    CHECK_EQUAL(c.value, 7);
+}
+
+void test_select_range() {
+    constexpr int producers = 3;
+    constexpr int items = 20000;
+    coro_mpmc_queue<int, 16> qs[producers];
+    std::vector<coro_mpmc_queue<int, 16> *> lst;
+    std::vector<std::thread> thr;
+    for (int i = 0; i < producers; ++i) {
+        lst.push_back(&qs[i]);
+        thr.emplace_back([&qs, i]{
+            mpmc_producer(qs[i], i * items, (i + 1) * items).wait();
+        });
+    }
+    queue_select sel(lst);
+    CHECK_EQUAL(sel.size(), producers);
+    long sum = 0;
+    int last[producers] = {-1, -1, -1};
+    bool ordered = true;
+    for (int i = 0; i < producers * items; ++i) {
+        auto itm = sel().await();
+        sum += itm.value;
+        ordered = ordered && itm.value > last[itm.index];
+        last[itm.index] = itm.value;
+    }
+    for (auto &t: thr) t.join();
+    long n = static_cast<long>(producers) * items;
+    CHECK(ordered);
+    CHECK_EQUAL(sum, n * (n - 1) / 2);
+}
+
+//lock which runs a hook once after it is unlocked. It simulates a push to
+//other queue between delivery of an item and resumption of the consumer
+struct hook_lock {
+    static inline std::function<void()> hook;
+    void lock() {}
+    void unlock() {
+        if (hook) {
+            auto h = std::move(hook);
+            hook = nullptr;
+            h();
+        }
+    }
+};
+
+//q2 receives own item while the selector is being resolved by q1
+template<typename Sel, typename Queue>
+int race_delivery(Sel &sel, Queue &q1, Queue &q2) {
+    auto a = sel();
+    int val = 0;
+    a >> [&](auto &r) {val = r.await_resume().value;};
+    hook_lock::hook = [&]{q1.push(1);};
+    q2.push(2);
+    return val;
+}
+
+void test_select_kept_item() {
+    using queue = coro_basic_queue<limited_queue<int, 4>, hook_lock>;
+    queue q1, q2;
+    {
+        queue_select sel(q1, q2);
+        int first = race_delivery(sel, q1, q2);
+        CHECK_EQUAL(first, 1);
+        //second item is kept for the next wait
+        auto itm = sel().await();
+        CHECK_EQUAL(itm.index, 1);
+        CHECK_EQUAL(itm.value, 2);
+    }
+    {
+        queue_select sel(q1, q2);
+        int first = race_delivery(sel, q1, q2);
+        CHECK_EQUAL(first, 1);
+    }
+    //destroyed selector returned the kept item to its queue
+    auto p = q2.pop();
+    CHECK(p.is_ready());
+    CHECK_EQUAL(p.await_resume(), 2);
+    CHECK(!q1.pop().is_ready());
+}
+
+void test_select_temporary_mt() {
+    //every wait uses a new selector, items delivered concurrently to the
+    //destroyed selector must not be lost
+    constexpr int producers = 3;
+    constexpr int items = 20000;
+    coro_queue<int, 4, std::mutex> qs[producers];
+    std::vector<std::thread> thr;
+    for (int i = 0; i < producers; ++i) {
+        thr.emplace_back([&qs, i]{
+            for (int j = 0; j < items; ++j) qs[i].push(j).wait();
+        });
+    }
+    std::atomic<bool> done = {false};
+    std::thread watchdog([&]{
+        for (int i = 0; i < 3000 && !done; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!done) {
+            std::cerr << "FAILED: item lost by temporary selector" << std::endl;
+            std::_Exit(1);
+        }
+    });
+    int received = 0;
+    for (int i = 0; i < producers * items; ++i) {
+        select(qs[0], qs[1], qs[2])().await();
+        ++received;
+    }
+    done = true;
+    for (auto &t: thr) t.join();
+    watchdog.join();
+    CHECK_EQUAL(received, producers * items);
+}
+
+void test_segmented() {
+    coro_segmented_queue<std::string, 4> q;
+    //grows without suspending the producer
+    for (int i = 0; i < 100; ++i) {
+        auto r = q.push(std::to_string(i));
+        CHECK(r.is_ready());
+    }
+    bool ordered = true;
+    for (int i = 0; i < 50; ++i) {
+        std::string v = q.pop();
+        ordered = ordered && v == std::to_string(i);
+    }
+    //interleave crossing the segment boundary
+    for (int i = 100; i < 110; ++i) {
+        q.push(std::to_string(i));
+        std::string v = q.pop();
+        ordered = ordered && v == std::to_string(i - 50);
+    }
+    for (int i = 60; i < 110; ++i) {
+        std::string v = q.pop();
+        ordered = ordered && v == std::to_string(i);
+    }
+    CHECK(ordered);
+    CHECK(!q.pop().is_ready());
+}
+
+void test_limited_non_pow2() {
+    coro_queue<int, 3> q;
+    bool ordered = true;
+    for (int i = 0; i < 10; ++i) {
+        q.push(i);
+        q.push(i + 100);
+        ordered = ordered && static_cast<int>(q.pop()) == i && static_cast<int>(q.pop()) == i + 100;
+    }
+    CHECK(ordered);
+}
+
+int main() {
+    test_basic();
+    test_pending_pop();
+    test_closed();
+    test_batch();
+    test_mpmc();
+    test_mpmc_batch();
+    test_select();
+    test_select_range();
+    test_select_kept_item();
+    test_select_temporary_mt();
+    test_segmented();
+    test_limited_non_pow2();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "../coro_reactor.h"
+#include "check.h"
+#include <cstring>
+#include <string>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<std::string> reader(io_reactor &r, int fd) {
+    char buf[64];
+    std::string out;
+    while (true) {
+        std::size_t n = co_await r.async_read(fd, buf, sizeof(buf));
+        if (n == 0) break;
+        out.append(buf, n);
+    }
+    co_return out;
+}
+
+awaitable<void> writer(io_reactor &r, int fd) {
+    const char *msg[] = {"hello", " ", "world"};
+    for (auto m: msg) {
+        co_await r.sleep_for(std::chrono::milliseconds(10));
+        std::size_t n = co_await r.async_write(fd, m, std::strlen(m));
+        CHECK_EQUAL(n, std::strlen(m));
+    }
+    r.forget(fd);
+    ::close(fd);
+}
+
+void test_pipe() {
+    io_reactor r;
+    int p[2];
+    CHECK_EQUAL(::pipe2(p, O_NONBLOCK | O_CLOEXEC), 0);
+    auto w = writer(r, p[1]);
+    w >> [](awaitable<void> &x){x.await_resume();};
+    std::string res = r.await(reader(r, p[0]));
+    r.forget(p[0]);
+    ::close(p[0]);
+    CHECK_EQUAL(res, "hello world");
+}
+
+awaitable<std::size_t> acceptor(io_reactor &r, int fd) {
+    int c = co_await r.accept(fd);
+    char buf[16];
+    std::size_t n = co_await r.async_read(c, buf, sizeof(buf));
+    r.forget(c);
+    ::close(c);
+    co_return n;
+}
+
+void test_accept() {
+    io_reactor r;
+    int lsn = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    CHECK(lsn >= 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK_EQUAL(::bind(lsn, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    CHECK_EQUAL(::listen(lsn, 4), 0);
+    socklen_t len = sizeof(addr);
+    ::getsockname(lsn, reinterpret_cast<sockaddr *>(&addr), &len);
+    auto thr = std::jthread([addr]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        int s = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::connect(s, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+        [[maybe_unused]] auto w = ::write(s, "abc", 3);
+        ::close(s);
+    });
+    std::size_t n = r.await(acceptor(r, lsn));
+    r.forget(lsn);
+    ::close(lsn);
+    CHECK_EQUAL(n, 3);
+}
+
+int main() {
+    test_pipe();
+    test_accept();
+    return 0;
+}
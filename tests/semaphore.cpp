@@ -0,0 +1,95 @@
+#include "../coro_semaphore.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+void test_basic() {
+    coro_semaphore sem(2);
+    CHECK(sem.try_acquire());
+    auto a = sem.acquire();
+    CHECK(a.is_ready());
+    auto b = sem.acquire(2);
+    auto c = sem.acquire();
+    CHECK(!b.is_ready());
+    std::vector<int> res;
+    b >> [&](awaitable<void> &){res.push_back(2);};
+    c >> [&](awaitable<void> &){res.push_back(1);};
+    CHECK_EQUAL(sem.available(), -3);
+    sem.release();
+    //first waiter needs two permits, the second one waits behind it
+    CHECK(res.empty());
+    sem.release();
+    CHECK_EQUAL(res.size(), 1);
+    CHECK_EQUAL(res[0], 2);
+    sem.release(2);
+    CHECK_EQUAL(res.size(), 2);
+    CHECK_EQUAL(res[1], 1);
+    CHECK_EQUAL(sem.available(), 1);
+    //not registered request doesn't take permits
+    {
+        sem.try_acquire();
+        auto d = sem.acquire();
+    }
+    CHECK_EQUAL(sem.available(), 0);
+}
+
+awaitable<void> worker(coro_semaphore &sem, std::atomic<int> &inside, std::atomic<int> &max_inside, int cycles) {
+    for (int i = 0; i < cycles; ++i) {
+        co_await sem.acquire();
+        int v = inside.fetch_add(1) + 1;
+        int m = max_inside.load();
+        while (v > m && !max_inside.compare_exchange_weak(m, v));
+        inside.fetch_sub(1);
+        sem.release();
+    }
+}
+
+void test_mt() {
+    constexpr int threads = 6;
+    coro_semaphore sem(3);
+    std::atomic<int> inside = {0};
+    std::atomic<int> max_inside = {0};
+    std::vector<std::thread> thr;
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&]{
+            worker(sem, inside, max_inside, 20000).wait();
+        });
+    }
+    for (auto &t: thr) t.join();
+    CHECK_LESS_EQUAL(max_inside.load(), 3);
+    CHECK_EQUAL(sem.available(), 3);
+}
+
+void test_rate_limiter() {
+    scheduler sch;
+    coro_rate_limiter lim(sch, 200, std::chrono::seconds(1), 5);
+    //the thread is stopped before the limiter is destroyed
+    auto thr = sch.create_thread();
+    auto start = std::chrono::system_clock::now();
+    //burst is available immediately
+    for (int i = 0; i < 5; ++i) CHECK(lim.try_acquire());
+    CHECK(!lim.try_acquire());
+    for (int i = 0; i < 30; ++i) lim.acquire().wait();
+    auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
+    CHECK_GREATER_EQUAL(dur, 145);
+    CHECK_LESS(dur, 5000);
+    //zero tokens per interval is rejected
+    bool thrown = false;
+    try {
+        coro_rate_limiter bad(sch, 0, std::chrono::seconds(1), 5);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main() {
+    test_basic();
+    test_mt();
+    test_rate_limiter();
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "../coro_shared_awaitable.h"
+#include "check.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<const int *> read_shared(shared_awaitable<int> &sa, std::vector<int> &order, int id) {
+    const int &v = co_await sa;
+    order.push_back(id);
+    co_return &v;
+}
+
+void test_many_waiters() {
+    awaitable<int>::result res;
+    shared_awaitable<int> sa(awaitable<int>([&](awaitable<int>::result r){res = std::move(r);}));
+    CHECK(!sa.is_ready());
+    std::vector<int> order;
+    std::vector<awaitable<const int *> > readers;
+    for (int i = 0; i < 5; ++i) readers.push_back(read_shared(sa, order, i));
+    //start readers, they wait
+    when_all w(readers);
+    CHECK(order.empty());
+    res(42);
+    CHECK(sa.is_ready());
+    CHECK_EQUAL(order.size(), 5);
+    const int *first = readers[0].await_resume();
+    for (int i = 0; i < 5; ++i) {
+        CHECK_EQUAL(order[i], i);
+        //all readers received the same object
+        CHECK(readers[i].await_resume() == first);
+    }
+    CHECK_EQUAL(*first, 42);
+    //already resolved
+    const int &v = sa.wait();
+    CHECK(&v == first);
+}
+
+void test_exception() {
+    shared_awaitable<std::string> sa(awaitable<std::string>(std::make_exception_ptr(std::runtime_error("fail"))));
+    CHECK(sa.is_ready());
+    bool thrown = false;
+    try {
+        sa.wait();
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+awaitable<int> backend(std::vector<awaitable<int>::result> &pending) {
+    return [&](awaitable<int>::result r) {pending.push_back(std::move(r));};
+}
+
+awaitable<int> lookup(single_flight<int, int> &sf, std::vector<awaitable<int>::result> &pending, int &calls, int key) {
+    auto res = sf.get(key, [&](const int &) {
+        ++calls;
+        return backend(pending);
+    });
+    const int &v = co_await res;
+    co_return v;
+}
+
+void test_single_flight() {
+    single_flight<int, int> sf;
+    std::vector<awaitable<int>::result> pending;
+    int calls = 0;
+    std::vector<awaitable<int> > clients;
+    for (int i = 0; i < 100; ++i) clients.push_back(lookup(sf, pending, calls, i % 2));
+    when_all w(clients);
+    //one operation per key
+    CHECK_EQUAL(calls, 2);
+    CHECK_EQUAL(sf.in_flight(), 2);
+    pending[0](10);
+    pending[1](11);
+    CHECK_EQUAL(sf.in_flight(), 0);
+    for (int i = 0; i < 100; ++i) {
+        CHECK_EQUAL(clients[i].await_resume(), 10 + i % 2);
+    }
+    //completed result is not kept
+    pending.clear();
+    auto again = lookup(sf, pending, calls, 0);
+    when_all w2(again);
+    CHECK_EQUAL(calls, 3);
+    pending[0](20);
+    CHECK_EQUAL(again.await_resume(), 20);
+}
+
+void test_single_flight_sync() {
+    single_flight<std::string, int> sf;
+    int calls = 0;
+    auto res = sf.get("a", [&](const std::string &k) -> awaitable<int> {
+        ++calls;
+        return static_cast<int>(k.size());
+    });
+    CHECK(res.is_ready());
+    CHECK_EQUAL(res.wait(), 1);
+    CHECK_EQUAL(sf.in_flight(), 0);
+    auto err = sf.get("b", [&](const std::string &) -> awaitable<int> {
+        throw std::runtime_error("fail");
+    });
+    CHECK(err.is_ready());
+    CHECK_EQUAL(sf.in_flight(), 0);
+}
+
+void test_single_flight_destroyed() {
+    std::vector<awaitable<int>::result> pending;
+    int calls = 0;
+    auto sf = std::make_unique<single_flight<int, int> >();
+    auto client = lookup(*sf, pending, calls, 1);
+    auto res = sf->get(1, [&](const int &) {
+        ++calls;
+        return backend(pending);
+    });
+    when_all w(client);
+    CHECK_EQUAL(calls, 1);
+    //request is still pending
+    sf.reset();
+    pending[0](5);
+    CHECK_EQUAL(client.await_resume(), 5);
+    CHECK_EQUAL(res.wait(), 5);
+}
+
+void test_mt() {
+    constexpr int threads = 4;
+    awaitable<int>::result res;
+    shared_awaitable<int> sa(awaitable<int>([&](awaitable<int>::result r){res = std::move(r);}));
+    std::vector<std::thread> thr;
+    std::atomic<int> sum = {0};
+    for (int i = 0; i < threads; ++i) {
+        thr.emplace_back([&]{
+            for (int j = 0; j < 1000; ++j) sum.fetch_add(sa.wait());
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    res(1);
+    for (auto &t: thr) t.join();
+    CHECK_EQUAL(sum.load(), threads * 1000);
+}
+
+int main() {
+    test_many_waiters();
+    test_exception();
+    test_single_flight();
+    test_single_flight_sync();
+    test_single_flight_destroyed();
+    test_mt();
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "../coro_simulation.h"
+#include "../coro_mutex.h"
+#include "../coro_queue.h"
+#include "check.h"
+
+#include <sstream>
+
+using namespace MINICORO_NAMESPACE;
+using namespace std::chrono_literals;
+
+void test_queue_load() {
+    simulation<> sim(42);
+    coro_queue<int, 16, empty_lockable> q;
+    auto arrival = sim.exponential(1ms);
+    constexpr unsigned int clients = 2000;
+    constexpr int requests = 20;
+    sim.spawn(clients, [&](unsigned int) -> awaitable<void> {
+        for (int i = 0; i < requests; ++i) {
+            co_await sim.delay(arrival);
+            auto t0 = sim.now();
+            co_await q.push(i);
+            sim.record("enqueue", sim.now() - t0);
+        }
+    });
+    //4 consumers, 100us per item
+    sim.spawn(4, [&](unsigned int) -> awaitable<void> {
+        while (true) {
+            co_await q.pop();
+            co_await sim.sleep_for(100us);
+            sim.count("processed");
+        }
+    });
+    sim.sample("queue_depth", [&]{return q.size();});
+    auto events = sim.run();
+    CHECK_EQUAL(sim.get_counter("processed"), clients * requests);
+    CHECK_EQUAL(sim.get_histogram("enqueue").count(), clients * requests);
+    CHECK_EQUAL(sim.get_gauge("queue_depth").max(), 16);
+    //producers are faster than consumers, tail latency grows
+    CHECK(sim.get_histogram("enqueue").percentile(0.99) > 1ms);
+    //one delay per request and one sleep per processed item
+    CHECK_EQUAL(events, 2 * clients * requests);
+    //consumers are the bottleneck, 4 of them need 100us per item
+    CHECK(sim.now() - std::chrono::system_clock::time_point{} >= clients * requests * 100us / 4);
+    //consumers still wait for items
+    CHECK_EQUAL(sim.running(), 4);
+    std::ostringstream out;
+    sim.print_report(out);
+    CHECK(out.str().find("\"name\":\"queue_depth\"") != std::string::npos);
+}
+
+void test_mutex_load() {
+    auto run = [](std::chrono::microseconds hold) {
+        simulation<> sim(7);
+        coro_mutex mx;
+        auto think = sim.uniform(0us, 2000us);
+        sim.spawn(100, [&](unsigned int) -> awaitable<void> {
+            for (int i = 0; i < 50; ++i) {
+                co_await sim.delay(think);
+                auto own = co_await sim.measure("lock", mx.lock());
+                co_await sim.sleep_for(hold);
+            }
+        });
+        sim.run();
+        CHECK_EQUAL(sim.running(), 0);
+        CHECK_EQUAL(sim.errors(), 0);
+        return sim.get_histogram("lock").percentile(0.99);
+    };
+    //longer critical section means more contention
+    auto low = run(1us);
+    auto high = run(20us);
+    CHECK(high > low);
+}
+
+void test_deterministic() {
+    auto run = [](std::uint64_t seed) {
+        simulation<> sim(seed);
+        auto lat = sim.lognormal(1ms, 0.8);
+        sim.spawn(10, [&](unsigned int) -> awaitable<void> {
+            for (int i = 0; i < 10; ++i) {
+                auto t0 = sim.now();
+                co_await sim.delay(lat);
+                sim.record("lat", sim.now() - t0);
+            }
+        });
+        sim.run();
+        return sim.get_histogram("lat").percentile(0.9);
+    };
+    CHECK(run(1) == run(1));
+}
+
+int main() {
+    test_queue_load();
+    test_mutex_load();
+    test_deterministic();
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "../coro_thread_pool.h"
+#include "../coro_task_group.h"
+#include "check.h"
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace MINICORO_NAMESPACE;
+
+//task waits on the gate, so test controls when it finishes
+struct gates {
+    std::vector<awaitable<void>::result> waiting;
+
+    awaitable<void> wait() {
+        return [this](awaitable<void>::result r) {
+            waiting.push_back(std::move(r));
+        };
+    }
+    void open_one() {
+        auto r = std::move(waiting.front());
+        waiting.erase(waiting.begin());
+        r();
+    }
+};
+
+awaitable<void> task(gates &g, int id, std::vector<int> &out, bool fail = false) {
+    co_await g.wait();
+    if (fail) throw std::runtime_error("failed");
+    out.push_back(id);
+}
+
+awaitable<void> spawner(task_group &grp, gates &g, std::vector<int> &out, int count, int &spawned) {
+    for (int i = 0; i < count; ++i) {
+        co_await grp.spawn(task(g, i, out));
+        ++spawned;
+    }
+    co_await grp.join();
+}
+
+void test_limit() {
+    task_group grp(2);
+    gates g;
+    std::vector<int> out;
+    int spawned = 0;
+    auto s = spawner(grp, g, out, 5, spawned);
+    bool done = false;
+    s >> [&](awaitable<void> &r) {
+        r.await_resume();
+        done = true;
+    };
+    //third spawn suspends the spawner
+    CHECK_EQUAL(spawned, 2);
+    CHECK_EQUAL(grp.running(), 2);
+    g.open_one();
+    CHECK_EQUAL(spawned, 3);
+    CHECK_EQUAL(grp.running(), 2);
+    while (!g.waiting.empty()) {
+        CHECK(!done);
+        g.open_one();
+    }
+    CHECK(done);
+    CHECK_EQUAL(spawned, 5);
+    CHECK_EQUAL(out.size(), 5);
+    CHECK_EQUAL(grp.running(), 0);
+}
+
+void test_exception() {
+    task_group grp(2);
+    gates g;
+    std::vector<int> out;
+    auto st = grp.get_stop_token();
+    grp.spawn(task(g, 1, out, true));
+    grp.spawn(task(g, 2, out));
+    g.open_one();
+    CHECK(grp.is_canceled());
+    CHECK(st.stop_requested());
+    //task is dropped, group is canceled
+    grp.spawn(task(g, 3, out));
+    CHECK_EQUAL(g.waiting.size(), 1);
+    auto j = grp.join();
+    bool thrown = false;
+    j >> [&](awaitable<void> &r) {
+        try {
+            r.await_resume();
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+    };
+    CHECK(!thrown);
+    g.open_one();
+    CHECK(thrown);
+    CHECK_EQUAL(out.size(), 1);
+    CHECK_EQUAL(out[0], 2);
+    //group is reusable
+    CHECK(!grp.is_canceled());
+    grp.spawn(task(g, 4, out));
+    g.open_one();
+    grp.join().await();
+    CHECK_EQUAL(out.size(), 2);
+}
+
+void test_mt() {
+    constexpr int count = 1000;
+    task_group grp(4);
+    std::atomic<int> counter = {0};
+    coro_thread_pool pool(4);
+    auto work = [&]() -> awaitable<void> {
+        co_await pool.schedule();
+        counter.fetch_add(1);
+    };
+    for (int i = 0; i < count; ++i) {
+        grp.spawn(work()).await();
+    }
+    grp.join().await();
+    CHECK_EQUAL(counter.load(), count);
+    pool.stop();
+}
+
+void test_join_while_spawning() {
+    //join completes in one thread while other thread spawns
+    constexpr int rounds = 20000;
+    task_group grp;
+    std::thread thr([&]{
+        for (int i = 0; i < rounds; ++i) grp.spawn(awaitable<void>());
+    });
+    for (int i = 0; i < rounds; ++i) {
+        grp.spawn(awaitable<void>());
+        grp.join().await();
+    }
+    thr.join();
+    grp.join().await();
+    CHECK_EQUAL(grp.running(), 0);
+}
+
+int main() {
+    test_limit();
+    test_exception();
+    test_mt();
+    test_join_while_spawning();
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "../coro_thread_pool.h"
+#include "../coro_scheduler.h"
+#include "../coro_distributor.h"
+#include "check.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace minicoro;
+
+static std::atomic<int> counter = {0};
+
+awaitable<void> hop_coro(coro_thread_pool &pool, std::thread::id main_id, int cycles) {
+    for (int i = 0; i < cycles; ++i) {
+        co_await pool.schedule();
+        if (std::this_thread::get_id() == main_id) exit(2);
+        if (!pool.is_current()) exit(3);
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void test_schedule() {
+    coro_thread_pool pool(4);
+    std::vector<awaitable<void> > lst;
+    for (int i = 0; i < 200; ++i) {
+        lst.push_back(hop_coro(pool, std::this_thread::get_id(), 50));
+    }
+    when_all all(lst);
+    all.wait();
+    CHECK_EQUAL(counter.load(), 200*50);
+    CHECK(!pool.is_current());
+}
+
+awaitable<bool> sleep_coro(scheduler &sch, coro_thread_pool &pool) {
+    co_await sch.sleep_for(std::chrono::milliseconds(10));
+    co_return pool.is_current();
+}
+
+void test_scheduler_executor() {
+    coro_thread_pool pool(2);
+    scheduler sch;
+    auto thr = sch.create_thread([&](auto &&r){pool(r);});
+    bool b = sleep_coro(sch, pool);
+    CHECK(b);
+}
+
+awaitable<void> listener(distributor<int, std::mutex> &dist, coro_thread_pool &pool, std::atomic<int> &sum) {
+    int v = co_await dist();
+    if (!pool.is_current()) exit(4);
+    sum.fetch_add(v, std::memory_order_relaxed);
+}
+
+void test_broadcast() {
+    coro_thread_pool pool(3);
+    distributor<int, std::mutex> dist;
+    std::atomic<int> sum = {0};
+    std::vector<awaitable<void> > lst;
+    for (int i = 0; i < 100; ++i) lst.push_back(listener(dist, pool, sum));
+    when_all all(lst);
+    distributor<int, std::mutex>::prepared buffer;
+    dist.broadcast(buffer, 3);
+    pool.post(buffer);
+    CHECK(buffer.empty());
+    all.wait();
+    CHECK_EQUAL(sum.load(), 300);
+}
+
+int main() {
+    test_schedule();
+    test_scheduler_executor();
+    test_broadcast();
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "../coro_scheduler.h"
+
+#include "check.h"
+
+#include <random>
+#include <sstream>
+
+using namespace minicoro;
+
+using tp = std::chrono::system_clock::time_point;
+using ms = std::chrono::milliseconds;
+
+//compare wheel against the heap with random operations
+void test_against_heap() {
+    generic_scheduler<int, tp, const void *> heap;
+    timer_wheel<int, tp, const void *, 3, 6> wheel{ms(1)};
+    std::mt19937 rnd(12345);
+    static char idents[100000];
+    tp base = std::chrono::system_clock::now();
+    int mismatches = 0;
+    int id = 1;
+    //timestamps are unique, so both implementations must return the same order
+    auto make_time = [&](long range) {
+        return base + ms(static_cast<long>(rnd() % range)) + std::chrono::nanoseconds(id++);
+    };
+    for (int i = 0; i < 100000; ++i) {
+        auto op = rnd() % 10;
+        if (op < 5) {
+            //mix of short, long and overflowing timeouts
+            const void *ident = (id % 3) ? idents + id : nullptr;
+            int val = id;
+            tp t = make_time(op == 0 ? 1000000000L : op == 1 ? 300000 : 5000);
+            heap.schedule_at(val, t, ident);
+            wheel.schedule_at(val, t, ident);
+        } else if (op < 7) {
+            const void *ident = idents + (id - 1 - static_cast<int>(rnd() % 1000));
+            if (heap.remove_by_ident(ident) != wheel.remove_by_ident(ident)) ++mismatches;
+        } else if (op < 8) {
+            const void *ident = idents + (id - 1 - static_cast<int>(rnd() % 1000));
+            tp t = make_time(10000);
+            if (heap.set_time(ident, t) != wheel.set_time(ident, t)) ++mismatches;
+        } else {
+            auto a = heap.get_first_scheduled_time();
+            if (a != wheel.get_first_scheduled_time()) ++mismatches;
+            if (a) base = std::max(base, *a);
+            if (heap.remove_first() != wheel.remove_first()) ++mismatches;
+        }
+    }
+    while (!heap.empty()) {
+        if (heap.get_first_scheduled_time() != wheel.get_first_scheduled_time()) ++mismatches;
+        if (heap.remove_first() != wheel.remove_first()) ++mismatches;
+    }
+    CHECK_EQUAL(mismatches, 0);
+    CHECK(wheel.empty());
+}
+
+//exposes placement of the nodes
+class probe_wheel: public timer_wheel<int, tp> {
+public:
+    using timer_wheel<int, tp>::timer_wheel;
+    bool overflow_empty() const {return _heads[overflow] == npos;}
+};
+
+//timeouts of absolute clock, which are mostly canceled and never fire
+void test_cancel_system_clock() {
+    constexpr int count = 100000;
+    constexpr int cancels = 2000;
+    static char idents[count];
+    probe_wheel wheel(ms(1));
+    tp base = std::chrono::system_clock::now() + std::chrono::seconds(30);
+    for (int i = 0; i < count; ++i) wheel.schedule_at(i, base + ms(i), idents + i);
+    //nodes are placed in the wheel, so finding the next one doesn't scan all of them
+    CHECK(wheel.overflow_empty());
+    int mismatches = 0;
+    for (int i = 0; i < cancels; ++i) {
+        //cancel the earliest, so the cached first item must be found again
+        if (wheel.remove_by_ident(idents + i) != i) ++mismatches;
+        if (wheel.get_first_scheduled_time() != base + ms(i + 1)) ++mismatches;
+    }
+    CHECK_EQUAL(mismatches, 0);
+    CHECK(wheel.overflow_empty());
+    CHECK_EQUAL(wheel.remove_first(), cancels);
+}
+
+void test_manual() {
+    manual_scheduler<tp, timer_wheel<awaitable<void>::result, tp> > sch;
+    std::ostringstream out;
+    auto do_sleep = [&](int n, int t) -> awaitable<void> {
+        co_await sch.sleep_for(ms(t));
+        out << n << "|";
+    };
+    awaitable<void> lst[] = {do_sleep(1, 1000), do_sleep(2, 500), do_sleep(3, 1500), do_sleep(4, 5)};
+    for (auto &x: lst) x >> [](awaitable<void> &){};
+    tp limit = sch.get_current_time() + ms(1200);
+    while (sch.advance_time_until(limit));
+    CHECK_EQUAL(out.view(), "4|2|1|");
+    CHECK(sch.get_current_time() == limit);
+    CHECK(sch.get_first_scheduled_time() == tp{} + ms(1500));
+    sch.advance_time_until(limit + ms(1000));
+    CHECK_EQUAL(out.view(), "4|2|1|3|");
+    CHECK(sch.get_current_time() == tp{} + ms(1500));
+}
+
+awaitable<unsigned int> coro_test(timer_wheel_scheduler &sch, unsigned int t, unsigned int id) {
+    co_await sch.sleep_for(ms(t));
+    co_return id;
+}
+
+awaitable<void> coro_test_master(timer_wheel_scheduler &sch, std::ostream &out) {
+    awaitable<unsigned int>lst[] = {
+            coro_test(sch,100,1),
+            coro_test(sch,50,2),
+            coro_test(sch,150,3),
+            coro_test(sch,70,4),
+    };
+    alert_flag_type flag;
+    bool alerted = false;
+    bool canceled = false;
+    auto a = sch.sleep_for_alertable(flag, std::chrono::seconds(100));
+    a >> [&](awaitable<void> &){alerted = true;};
+    auto c = sch.sleep_for(std::chrono::seconds(100), &out);
+    c >> [&](awaitable<void> &){canceled = true;};
+    when_each s(lst);
+    while (s) {
+        auto r = co_await s;
+        out << lst[r].await_resume() << "|";
+    }
+    sch.alert(flag);
+    co_await sch.sleep_for(ms(10));
+    CHECK(alerted);
+    CHECK(!canceled);
+    CHECK(static_cast<bool>(sch.cancel(&out)));
+    CHECK(canceled);
+}
+
+void test_scheduler() {
+    std::ostringstream buff;
+    timer_wheel_scheduler sch;
+    sch.await(coro_test_master(sch,buff));
+    CHECK_EQUAL(buff.view(), "2|4|1|3|");
+}
+
+int main() {
+    test_against_heap();
+    test_cancel_system_clock();
+    test_manual();
+    test_scheduler();
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "../coro_trace.h"
+#include <atomic>
+
+struct counting_trace: minicoro::trace_noop {
+    static inline std::atomic<int> created = {0};
+    static inline std::atomic<int> destroyed = {0};
+    static inline std::atomic<int> suspended = {0};
+    static inline std::atomic<int> mutex_wait = {0};
+    static inline std::atomic<int> mutex_acquire = {0};
+    static inline std::atomic<int> parked = {0};
+    static inline std::atomic<int> unparked = {0};
+    static inline std::atomic<int> fired = {0};
+
+    static void on_coro_create(const void *) noexcept {++created;}
+    static void on_coro_destroy(const void *) noexcept {++destroyed;}
+    static void on_suspend(const void *, std::coroutine_handle<>) noexcept {++suspended;}
+    static void on_mutex_wait(const void *, const void *) noexcept {++mutex_wait;}
+    static void on_mutex_acquire(const void *, const void *) noexcept {++mutex_acquire;}
+    static void on_queue_park(const void *, const void *, bool) noexcept {++parked;}
+    static void on_queue_unpark(const void *, bool) noexcept {++unparked;}
+    static void on_timer_fire(const void *, std::chrono::nanoseconds late) noexcept {
+        if (late.count() >= 0) ++fired;
+    }
+};
+
+#define MINICORO_TRACE counting_trace
+
+#include "../coro_mutex.h"
+#include "../coro_queue.h"
+#include "../coro_scheduler.h"
+#include "check.h"
+
+using namespace MINICORO_NAMESPACE;
+
+awaitable<int> consumer(coro_queue<int, 4> &q) {
+    co_return co_await q.pop();
+}
+
+void test_coro_and_queue() {
+    coro_queue<int, 4> q;
+    {
+        auto c = consumer(q);
+        int res = 0;
+        c >> [&](awaitable<int> &r){res = r;};
+        CHECK_EQUAL(counting_trace::created.load(), 1);
+        CHECK_EQUAL(counting_trace::suspended.load(), 1);
+        CHECK_EQUAL(counting_trace::parked.load(), 1);
+        q.push(42);
+        CHECK_EQUAL(counting_trace::unparked.load(), 1);
+        CHECK_EQUAL(res, 42);
+    }
+    CHECK_EQUAL(counting_trace::destroyed.load(), 1);
+}
+
+void test_mutex() {
+    coro_mutex mx;
+    auto own = mx.try_lock();
+    auto l = mx.lock();
+    bool locked = false;
+    l >> [&](awaitable<coro_mutex::ownership> &r) {
+        coro_mutex::ownership o = r;
+        locked = true;
+    };
+    CHECK_EQUAL(counting_trace::mutex_wait.load(), 1);
+    CHECK_EQUAL(counting_trace::mutex_acquire.load(), 0);
+    own.release();
+    CHECK(locked);
+    CHECK_EQUAL(counting_trace::mutex_acquire.load(), 1);
+}
+
+void test_timer() {
+    scheduler sch;
+    sch.await(sch.sleep_for(std::chrono::milliseconds(10)));
+    CHECK_EQUAL(counting_trace::fired.load(), 1);
+}
+
+int main() {
+    test_coro_and_queue();
+    test_mutex();
+    test_timer();
+    return 0;
+}